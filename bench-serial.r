@@ -0,0 +1,44 @@
+Rebol [
+    title: "Serial Extension Benchmark"
+    file: %bench-serial.r
+    type: script
+    license: "Apache 2.0"
+    description: --[
+        Runs SERIAL-BENCHMARK for each I/O engine across a range of WRITE
+        sizes, over pseudo-terminal pairs (so no hardware is needed), and
+        prints a line per run.  Run it before and after a change to the I/O
+        path.
+
+        If a filename is given on the command line, the results are also
+        saved to it as a block, for CI to compare against a stored baseline.
+    ]--
+]
+
+engines: [loop thread blocking]
+chunks: [1 16 256 4096]
+
+results: copy []
+
+for-each 'engine engines [
+    for-each 'chunk chunks [
+        let total: either chunk = 1 [65536] [4194304]  ; 1-byte writes are slow
+        let r: serial-benchmark:engine:chunk:total engine chunk total
+
+        append results spread compose [
+            (engine) (chunk) (r.bytes-per-sec) (r.syscalls-per-kb)
+            (r.latency-p50) (r.latency-p99) (r.latency-p999)
+        ]
+        print [
+            engine "chunk:" chunk
+            "|" r.bytes-per-sec "bytes/sec"
+            "|" any [r.syscalls-per-kb "?"] "syscalls/KB"
+            "| usec p50:" r.latency-p50
+            "p99:" r.latency-p99
+            "p99.9:" r.latency-p999
+        ]
+    ]
+]
+
+if not empty? system.script.args [
+    write to file! first system.script.args mold results
+]
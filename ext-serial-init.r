@@ -13,6 +13,20 @@ port-spec-serial: make system.standard.port-spec-head [
     parity: 'none
     stop-bits: 1
     flow-control: 'none  ; not supported on all systems
+    timeout: null  ; seconds, for blocking READ/WRITE instead of event loop
+    io-engine: 'loop  ; or 'thread for a native I/O thread (not on Windows)
+    latency: 'normal  ; or 'low, OPEN updates to what the device went along with
+    latency-timer: null  ; set by OPEN, USB adapter's batching delay in msec
+    framing: null  ; READ gives BLOCK! of frames, see README
+    shared: 'no  ; or 'yes to share the device with other 'yes ports
+    capture: null  ; FILE! to record all traffic in, see README
+    capture-size: 16777216  ; bytes per capture file before it rotates
+    read-size: null  ; READ waits to have this many bytes, see README
+    read-idle: null  ; ...or for the line to be quiet this many seconds
+    read-latency: null  ; ...or this many seconds after the first byte
+    timestamps: 'no  ; READ gives [usec blob! ...], see README
+    gap: null  ; ...split where the line is quiet this many seconds
+    rs485: 'no  ; or 'yes (or BLOCK!) for driver RS-485 direction control
 ]
 
 sys.util/make-scheme [
@@ -5,14 +5,39 @@ Rebol [
 
 use-librebol: 'no
 
+requires: 'Filesystem  ; builds libuv, whose default loop the device polls on
+
 sources: [mod-serial.c]
 
 depends: compose [
+    serial-framer.c
+    serial-share.c
+    serial-modbus.c
+    serial-checksum.c
+    serial-transact.c
+    serial-xmodem.c
+    serial-coalesce.c
+    serial-stamps.c
+    serial-bus.c
     (spread switch platform-config.os-base [
         'Windows [
             [serial-windows.c]
         ]
     ] else [
-        [serial-posix.c]
+        [
+            serial-posix.c serial-benchmark.c serial-discovery.c
+            serial-capture.c
+        ]
     ])
 ]
+
+libraries: switch platform-config.os-base [
+    'Windows [
+        [%advapi32]  ; registry, for SERIAL-DEVICES
+    ]
+    'OSX [
+        [%pthread]  ; openpty() is in libSystem
+    ]
+] else [
+    [%pthread %util]  ; io-engine: 'thread, openpty() for benchmark and replay
+]
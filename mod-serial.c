@@ -21,17 +21,111 @@
 //
 //=////////////////////////////////////////////////////////////////////////=//
 //
-// This code is being kept compiling, but does not work at present.
-//
 // See README.md for notes about this extension.
 //
 //=//// NOTES /////////////////////////////////////////////////////////////=//
 //
 // A. This code was originally written to use EVENT! and the R3-Alpha device
-//    model.  Ren-C ripped this out and replaced it with libuv.  However, at
-//    time of writing the libuv event loop has not been exposed, e.g. by
-//    a LIBUV-LOOP! type.  Until that is done, this code is just being kept
-//    in a compiling state, with the hope of plugging into that someday.
+//    model.  Ren-C ripped this out and replaced it with libuv.  The POSIX
+//    device registers its descriptor with libuv's default loop, and READ or
+//    WRITE that can't complete immediately run that loop until the transfer
+//    is finished by a poll callback.  So the actor sees each READ and WRITE
+//    as synchronous, while other loop clients keep getting serviced.
+//
+// B. The SerialConnection lives in the port's STATE slot as a HANDLE!, which
+//    is created on first use.  If the port is garbage collected while still
+//    open, the handle's cleaner closes the device.
+//
+// C. READ returns a new BLOB! with only the bytes that arrived since the last
+//    READ, taken out of the connection's fixed-size receive ring.  (It used
+//    to append to the port's DATA, which grew without bound.)  READ:PART
+//    leaves any excess in the ring for the next READ, which gets it without
+//    touching the device.
+//
+// D. WRITE of a BLOCK! of BLOB!s hands them all to the device at once, which
+//    gathers them into a single writev() on POSIX.  Anything the driver can't
+//    take right away is copied into the connection's outbound ring, so the
+//    BLOB!s don't need to be kept alive (e.g. in the port's DATA) afterward.
+//
+// E. `latency: 'low` is a request, which drivers and USB adapters may ignore
+//    or lack the permissions for.  OPEN writes back into the spec what took
+//    effect: LATENCY says whether anything was lowered, and LATENCY-TIMER is
+//    the adapter's latency timer in milliseconds (null if it doesn't have one).
+//
+// F. With `framing:` in the spec, READ returns a BLOCK! of complete frames
+//    instead of a BLOB!, waiting until there's at least one.  The framer is
+//    in %serial-framer.c.  READ:PART then limits the number of frames, with
+//    the rest left in the receive ring.  In blocking mode the block may be
+//    empty if the deadline passes.
+//
+// G. QUERY of an open port gives its counters as an object.  They're reset
+//    by OPEN.  The line error fields come from the driver's own counts, and
+//    are null if it doesn't keep any (ptys, USB adapters without them, and
+//    Windows).  See [B] in %serial-posix.c
+//
+// H. SERIAL-AVAILABLE and SERIAL-QUEUED answer how much there is to READ,
+//    and how much written data hasn't gone out yet, without a READ having
+//    to allocate a BLOB! just to find out.  SERIAL-DRAIN waits until all
+//    written data has been transmitted, so a writer can pace itself by the
+//    device instead of filling up the driver's buffer.
+//
+// I. MODIFY changes one of SPEED, DATA-SIZE, PARITY, STOP-BITS, FLOW-CONTROL
+//    or LATENCY on an open port, e.g. `modify port 'speed 921600`.  Anything
+//    written before it goes out with the old settings.  The spec is updated
+//    only if the device took the change, so it always describes the port.
+//    A change the device fails partway through (e.g. a custom speed it can
+//    only get within 3% of) has the old settings applied again.  See [K] in
+//    %serial-posix.c
+//
+// J. Ports with `shared: 'yes` that OPEN the same device share one handle to
+//    it, and each READ gets everything the device received.  The device is
+//    closed when the last of them is.  See %serial-share.c
+//
+// K. `capture: %file` records everything the port receives and transmits,
+//    timestamped, until it's closed.  SERIAL-REPLAY plays the received side
+//    of a capture back on a pseudo-terminal, at the recorded pace or faster,
+//    for a script to OPEN in place of the device.  See %serial-capture.c
+//
+// L. SERIAL-MODBUS is a Modbus RTU master.  It runs a whole block of requests
+//    without going back to script in between, so the bus isn't left idle
+//    while the interpreter gets to the next poll.  See %serial-modbus.c
+//
+// M. SERIAL-CHECKSUM gives the CRCs and sums that serial protocols append to
+//    their frames, computed in C so checking each frame of a fast stream
+//    doesn't cost more than receiving it.  See %serial-checksum.c
+//
+// N. SERIAL-TRANSACT is a WRITE and the READs of its reply in one call, the
+//    reply collected in the receive ring until it ends with a terminator, is
+//    a given length, or the line goes idle.  See %serial-transact.c
+//
+// O. WRITE of a FILE! sends the file's contents a part at a time, so a large
+//    firmware image is never loaded into a BLOB!.  On Linux the kernel moves
+//    the bytes from the file to the tty itself.  SERIAL-SEND-FILE is the same
+//    with a progress callback.  See [N] in %serial-posix.c
+//
+// P. SERIAL-SEND-XMODEM sends files by XMODEM(-1K) or YMODEM(-G), with the
+//    block and ACK exchange done in C, which script code can't keep up with.
+//    See %serial-xmodem.c
+//
+// Q. With READ-SIZE, READ-IDLE or READ-LATENCY in the spec, READ keeps going
+//    after the first bytes to hand back bigger batches, e.g. for a logging
+//    port at a high rate.  See %serial-coalesce.c
+//
+// R. With `timestamps: 'yes` in the spec, READ returns a BLOCK! of times and
+//    chunks, as `[usec blob! usec blob! ...]`, each time in microseconds on
+//    a monotonic clock for when the chunk's first read() returned.  With a
+//    `gap:` too, chunks are split where the line was quiet that long rather
+//    than at each read().  :PART gives the most chunks to return.  See the
+//    file %serial-stamps.c
+//
+// S. With `rs485:` in the spec, the driver turns an RS-485 transceiver around
+//    for each transmission by RTS.  It's `'yes` for the usual wiring, or a
+//    BLOCK! of the settings that differ from that.  Hardware flow control
+//    uses RTS too, so the two can't go together.  See [P] in %serial-posix.c
+//
+// T. SERIAL-BUS polls the devices on a multi-drop bus in one call, sending
+//    each request as soon as the previous reply is in and the bus has been
+//    turned around.  See %serial-bus.c
 //
 
 #include "sys-core.h"
@@ -41,6 +135,570 @@
 
 #define MAX_SERIAL_DEV_PATH 128
 
+
+//
+//  Serial_Handle_Cleaner: C
+//
+// Called by the GC when the HANDLE! in the port's STATE is unreferenced.
+//
+static void Serial_Handle_Cleaner(void* p, size_t length)
+{
+    assert(length == sizeof(SerialConnection));
+    UNUSED(length);
+
+    SerialConnection* serial = cast(SerialConnection*, p);
+    if (serial->share)
+        Abandon_Shared_Serial(serial);
+    else
+        Abandon_Serial(serial);
+    if (serial->path)
+        rebRelease(serial->path);
+    if (serial->capture_path)
+        rebRelease(serial->capture_path);
+    if (serial->in_ring.buf)
+        rebFree(serial->in_ring.buf);
+    if (serial->out_ring.buf)
+        rebFree(serial->out_ring.buf);
+    if (serial->stamps.buf)
+        rebFree(serial->stamps.buf);
+    rebFree(serial);
+}
+
+
+//
+//  Prep_Serial_Ring: C
+//
+// Rings are kept across a CLOSE and reopen of the same port, but emptied.
+//
+static void Prep_Serial_Ring(SerialRing* ring, Size capacity)
+{
+    assert((capacity & (capacity - 1)) == 0);  // must be power of two
+
+    if (ring->buf and ring->capacity != capacity) {
+        rebFree(ring->buf);
+        ring->buf = nullptr;
+    }
+    if (ring->buf == nullptr) {
+        ring->buf = rebAllocN(Byte, capacity);
+        ring->capacity = capacity;
+    }
+    ring->head = ring->tail = 0;
+}
+
+
+//
+//  Parse_Serial_Settings: C
+//
+// The line settings of a spec, which MODIFY can change on an open port [I].
+// Gives back a panic string if the spec has a bad one, else nullptr.
+//
+static const char* Parse_Serial_Settings(
+    SerialConnection* serial,
+    const Value* spec
+){
+    int baud_rate = rebUnboxInteger("any [",
+        "try match integer! pick", spec, "'speed",
+        "0"
+    "]");
+    if (baud_rate <= 0)  // device's own maximum is checked on open
+        return "panic -[SPEED must be positive INTEGER!]-";
+    serial->baud_rate = cast(SerialBaudRate, baud_rate);
+
+    serial->data_bits = rebUnboxInteger("any [",
+        "try match integer! pick", spec, "'data-size",
+        "0"
+    "]");
+    if (serial->data_bits < 5 or serial->data_bits > 8)
+        return "panic -[DATA-SIZE must be INTEGER [5 .. 8]]-";
+
+    serial->stop_bits = rebUnboxInteger("any [",
+        "try match integer! pick", spec, "'stop-bits",
+        "0"
+    "]");
+    if (serial->stop_bits != 1 and serial->stop_bits != 2)
+        return "panic -[STOP-BITS must be INTEGER [1 or 2]]-";
+
+    int parity = rebUnboxInteger(
+        "switch try pick", spec, "'parity [",
+            " 'none [", rebI(SERIAL_PARITY_NONE), "]",
+            " 'odd [", rebI(SERIAL_PARITY_ODD), "]",
+            " 'even [", rebI(SERIAL_PARITY_EVEN), "]",
+        "] else [-1]"
+    );
+    if (parity == -1)
+        return "panic -[PARITY must be NONE/ODD/EVEN]-";
+    serial->parity = cast(SerialParity, parity);
+
+    int flow_control = rebUnboxInteger(
+        "switch try pick", spec, "'flow-control [",
+            "'none [", rebI(SERIAL_FLOW_CONTROL_NONE), "]",
+            "'hardware [", rebI(SERIAL_FLOW_CONTROL_HARDWARE), "]",
+            "'software [", rebI(SERIAL_FLOW_CONTROL_SOFTWARE), "]",
+        "] else [-1]"
+    );
+    if (flow_control == -1)
+        return ("panic -[FLOW-CONTROL must be NONE/HARDWARE/SOFTWARE]-");
+    serial->flow_control = cast(SerialFlowControl, flow_control);
+
+    int latency = rebUnboxInteger(
+        "switch try pick", spec, "'latency [",
+            "'normal [0]",
+            "'low [1]",
+        "] else [-1]"
+    );
+    if (latency == -1)
+        return "panic -[LATENCY must be NORMAL/LOW]-";
+    serial->low_latency = (latency == 1);
+
+    return nullptr;
+}
+
+
+//
+//  Report_Serial_Latency: C
+//
+static void Report_Serial_Latency(const Value* spec, SerialConnection* serial)
+{
+    rebElide(  // report what the device actually went along with [E]
+        "poke", spec, "'latency",
+            (serial->low_latency_applied
+                or serial->latency_timer_msec == 1) ? "'low" : "'normal",
+        "let ms:", rebI(serial->latency_timer_msec),
+        "poke", spec, "'latency-timer all [ms >= 0, ms]"
+    );
+}
+
+
+//
+//  Pick_Serial_Usec: C
+//
+// A spec field in seconds, as microseconds (0 if null, -1 if bad).  Zero is
+// only good if `zero_ok`, for fields where it doesn't mean the same as null.
+//
+static int64_t Pick_Serial_Usec(
+    const Value* spec,
+    const char* field,
+    bool zero_ok
+){
+    return rebUnboxInteger(
+        "let secs: try pick", spec, field,
+        "case [",
+            "null? secs [0]",
+            "not match [integer! decimal!] secs [-1]",
+            "secs < 0 [-1]",
+            "secs = 0 [", rebI(zero_ok ? 0 : -1), "]",
+            "secs > 2000 [-1]",  // fits in int32_t microseconds
+        "] else [max 1 to integer! round 1000000 * secs]"
+    );
+}
+
+
+//
+//  Prep_Serial_Connection: C
+//
+// Everything OPEN takes from the spec, short of opening the device.  Gives
+// back a panic string if the spec has a problem, else nullptr.
+//
+static const char* Prep_Serial_Connection(
+    SerialConnection* serial,
+    const Value* spec
+){
+    if (serial->path)
+        rebRelease(serial->path);
+    serial->path = rebStable(
+        "try match [file! text!] pick", spec, "'path"
+    );  // released by Serial_Handle_Cleaner()
+    if (not serial->path)
+        return "panic -[SERIAL-PATH must be FILE! or TEXT!]-";
+
+    const char* bad = Parse_Serial_Settings(serial, spec);
+    if (bad)
+        return bad;
+
+    int timeout_msec = rebUnboxInteger(
+        "let timeout: try pick", spec, "'timeout",
+        "case [",
+            "null? timeout [-1]",  // use the event loop
+            "not match [integer! decimal!] timeout [-2]",
+            "timeout < 0 [-2]",
+        "] else [to integer! round 1000 * timeout]"
+    );
+    if (timeout_msec == -2)
+        return "panic -[TIMEOUT must be null or seconds >= 0]-";
+    serial->timeout_msec = timeout_msec;
+
+    int io_engine = rebUnboxInteger(
+        "switch try pick", spec, "'io-engine [",
+            "'loop [", rebI(SERIAL_IO_LOOP), "]",
+            "'thread [", rebI(SERIAL_IO_THREAD), "]",
+        "] else [-1]"
+    );
+    if (io_engine == -1)
+        return "panic -[IO-ENGINE must be LOOP/THREAD]-";
+    if (io_engine == SERIAL_IO_THREAD and timeout_msec >= 0)
+        return "panic -[IO-ENGINE THREAD can't be used with TIMEOUT]-";
+    serial->io_engine = cast(SerialIoEngine, io_engine);
+
+    SerialFramer* framer = &serial->framer;  // see [F]
+    memset(framer, 0, sizeof(SerialFramer));
+
+    int kind = rebUnboxInteger(
+        "let framing: try pick", spec, "'framing",
+        "case [",
+            "null? framing [", rebI(SERIAL_FRAMING_NONE), "]",
+            "blob? framing [", rebI(SERIAL_FRAMING_DELIMITER), "]",
+            "integer? framing [", rebI(SERIAL_FRAMING_FIXED), "]",
+            "block? framing [", rebI(SERIAL_FRAMING_LENGTH_PREFIX), "]",
+            "'slip = framing [", rebI(SERIAL_FRAMING_SLIP), "]",
+            "'cobs = framing [", rebI(SERIAL_FRAMING_COBS), "]",
+        "] else [-1]"
+    );
+    if (kind == -1)
+        return "panic -[FRAMING must be BLOB!, INTEGER!, BLOCK!,"
+            " 'SLIP or 'COBS]-";
+    framer->kind = cast(SerialFraming, kind);
+
+    switch (framer->kind) {
+      case SERIAL_FRAMING_DELIMITER: {
+        Size size;
+        Byte* delimiter = rebBytes(&size, "pick", spec, "'framing");
+        if (size != 0 and size <= SERIAL_MAX_DELIMITER)
+            memcpy(framer->delimiter, delimiter, size);
+        rebFree(delimiter);
+        if (size == 0 or size > SERIAL_MAX_DELIMITER)
+            return "panic -[FRAMING delimiter must be 1 to 8 bytes]-";
+        framer->delimiter_len = size;
+        break; }
+
+      case SERIAL_FRAMING_FIXED: {
+        int fixed = rebUnboxInteger("pick", spec, "'framing");
+        if (fixed <= 0 or fixed > SERIAL_RING_DEFAULT_CAPACITY)
+            return "panic -[FRAMING size must fit receive buffer]-";
+        framer->fixed_size = fixed;
+        break; }
+
+      case SERIAL_FRAMING_LENGTH_PREFIX: {
+        Value* prefix = rebValue(
+            "make (make object! [",
+                "offset: 0 width: 1 endian: 'big adjust: 0",
+            "]) pick", spec, "'framing"
+        );
+        int offset = rebUnboxInteger("pick", prefix, "'offset");
+        int width = rebUnboxInteger("pick", prefix, "'width");
+        int endian = rebUnboxInteger(
+            "switch pick", prefix, "'endian [",
+                "'big [1] 'little [0]",
+            "] else [-1]"
+        );
+        framer->prefix_adjust = rebUnboxInteger(
+            "pick", prefix, "'adjust"
+        );
+        rebRelease(prefix);
+
+        if (
+            offset < 0 or offset > 255
+            or (width != 1 and width != 2 and width != 4)
+            or endian == -1
+        ){
+            return "panic -[FRAMING needs [offset width endian adjust]"
+                " with width 1, 2 or 4 and endian 'big or 'little]-";
+        }
+        framer->prefix_offset = offset;
+        framer->prefix_width = width;
+        framer->prefix_big_endian = (endian == 1);
+        break; }
+
+      case SERIAL_FRAMING_SLIP:
+        framer->delimiter[0] = 0xC0;  // SLIP END
+        framer->delimiter_len = 1;
+        break;
+
+      case SERIAL_FRAMING_COBS:
+        framer->delimiter[0] = 0x00;
+        framer->delimiter_len = 1;
+        break;
+
+      default:
+        break;
+    }
+
+    int shared = rebUnboxInteger(
+        "switch try pick", spec, "'shared [",
+            "'no [0]",
+            "'yes [1]",
+        "] else [-1]"
+    );
+    if (shared == -1)
+        return "panic -[SHARED must be YES/NO]-";
+    serial->shared = (shared == 1);
+
+    if (serial->capture_path) {
+        rebRelease(serial->capture_path);
+        serial->capture_path = nullptr;
+    }
+    if (rebUnboxLogic(
+        "let capture: try pick", spec, "'capture",
+        "not any [null? capture, file? capture]"
+    )){
+        return "panic -[CAPTURE must be null or FILE!]-";
+    }
+    serial->capture_path = rebStable(  // see [K]
+        "let capture: try pick", spec, "'capture",
+        "if capture [file-to-local:full capture]"
+    );  // released by Serial_Handle_Cleaner()
+
+    int64_t capture_size = rebUnboxInteger(
+        "let size: try pick", spec, "'capture-size",
+        "case [",
+            "null? size [", rebI(SERIAL_CAPTURE_DEFAULT_SIZE), "]",
+            "not integer? size [-1]",
+            "size <", rebI(SERIAL_CAPTURE_MIN_SIZE), "[-1]",
+        "] else [size]"
+    );
+    if (capture_size == -1)
+        return "panic -[CAPTURE-SIZE must be an INTEGER! of at least 4096]-";
+    serial->capture_size = capture_size;
+
+    int64_t read_size = rebUnboxInteger(
+        "let size: try pick", spec, "'read-size",
+        "case [",
+            "null? size [0]",
+            "not integer? size [-1]",
+            "size < 1 [-1]",
+            "size >", rebI(SERIAL_RING_MAX_CAPACITY / 2), "[-1]",
+        "] else [size]"
+    );
+    if (read_size == -1)
+        return "panic -[READ-SIZE must be null or an INTEGER! up to 8388608]-";
+    serial->read_size = read_size;
+
+    int64_t idle_usec = Pick_Serial_Usec(spec, "'read-idle", false);
+    int64_t latency_usec = Pick_Serial_Usec(spec, "'read-latency", false);
+    if (idle_usec == -1 or latency_usec == -1)
+        return "panic -[READ-IDLE and READ-LATENCY must be null or seconds"
+            " (up to 2000)]-";
+    serial->read_idle_usec = idle_usec;
+    serial->read_latency_usec = latency_usec;
+
+    SerialRs485* rs485 = &serial->rs485;  // see [S]
+    memset(rs485, 0, sizeof(SerialRs485));
+
+    int use_rs485 = rebUnboxInteger(
+        "let rs485: try pick", spec, "'rs485",
+        "case [",
+            "any [null? rs485, 'no = rs485] [0]",
+            "any ['yes = rs485, block? rs485] [1]",
+        "] else [-1]"
+    );
+    if (use_rs485 == -1)
+        return "panic -[RS485 must be YES/NO or a BLOCK! of settings]-";
+    if (use_rs485 == 1) {  // 'yes is like an empty BLOCK!, all defaults
+        Value* settings = rebValue(
+            "let rs485: pick", spec, "'rs485",
+            "make (make object! [",
+                "rts-on-send: 'high",
+                "delay-before: null delay-after: null",
+                "receive-during-send: 'no",
+            "]) either block? rs485 [rs485] [[]]"
+        );
+        int rts = rebUnboxInteger(
+            "switch pick", settings, "'rts-on-send [",
+                "'high [1] 'low [0]",
+            "] else [-1]"
+        );
+        int receive = rebUnboxInteger(
+            "switch pick", settings, "'receive-during-send [",
+                "'yes [1] 'no [0]",
+            "] else [-1]"
+        );
+        int64_t before_usec = Pick_Serial_Usec(settings, "'delay-before", true);
+        int64_t after_usec = Pick_Serial_Usec(settings, "'delay-after", true);
+        rebRelease(settings);
+
+        if (rts == -1 or receive == -1 or before_usec == -1 or after_usec == -1)
+            return "panic -[RS485 needs [rts-on-send 'high/'low, delay-before"
+                " and delay-after in seconds, receive-during-send YES/NO]]-";
+        if (serial->flow_control == SERIAL_FLOW_CONTROL_HARDWARE)
+            return "panic -[RS485 can't be used with hardware FLOW-CONTROL]-";
+
+        rs485->enabled = true;
+        rs485->rts_high_on_send = (rts == 1);
+        rs485->receive_during_send = (receive == 1);
+        rs485->delay_before_usec = before_usec;
+        rs485->delay_after_usec = after_usec;
+    }
+
+    int timestamps = rebUnboxInteger(  // see [R]
+        "switch try pick", spec, "'timestamps [",
+            "'no [0]",
+            "'yes [1]",
+        "] else [-1]"
+    );
+    if (timestamps == -1)
+        return "panic -[TIMESTAMPS must be YES/NO]-";
+
+    int64_t gap_usec = Pick_Serial_Usec(spec, "'gap", false);
+    if (gap_usec == -1)
+        return "panic -[GAP must be null or seconds (up to 2000)]-";
+    if (gap_usec != 0 and timestamps == 0)
+        return "panic -[GAP needs `timestamps: 'yes`]-";
+    if (timestamps == 1 and (serial->shared or kind != SERIAL_FRAMING_NONE))
+        return "panic -[TIMESTAMPS can't be used with SHARED or FRAMING]-";
+    serial->gap_usec = gap_usec;
+
+    SerialStampRing* stamps = &serial->stamps;
+    if (timestamps == 0 and stamps->buf) {
+        rebFree(stamps->buf);
+        stamps->buf = nullptr;
+    }
+    if (timestamps == 1 and stamps->buf == nullptr)
+        stamps->buf = rebAllocN(SerialStamp, SERIAL_STAMP_CAPACITY);
+    stamps->head = stamps->tail = 0;
+
+    Prep_Serial_Ring(  // sized for batching if asked, see [C] there
+        &serial->in_ring, Coalesced_Ring_Capacity(serial)
+    );
+    Prep_Serial_Ring(&serial->out_ring, SERIAL_RING_DEFAULT_CAPACITY);
+
+    memset(&serial->stats, 0, sizeof(SerialStats));  // see [G]
+
+    return nullptr;
+}
+
+
+//
+//  Report_Serial_Settings: C
+//
+// A port that opened a device someone else already shares gets that device's
+// settings, not the ones it asked for.  See [B] in %serial-share.c
+//
+static void Report_Serial_Settings(const Value* spec, SerialConnection* serial)
+{
+    rebElide(
+        "poke", spec, "'speed", rebI(serial->baud_rate),
+        "poke", spec, "'data-size", rebI(serial->data_bits),
+        "poke", spec, "'stop-bits", rebI(serial->stop_bits),
+        "poke", spec, "'parity pick [none odd even]", rebI(serial->parity + 1),
+        "poke", spec, "'flow-control pick [none hardware software]",
+            rebI(serial->flow_control + 1)
+    );
+}
+
+
+//
+//  Trap_Read_Port_Serial: C
+//
+static Option(Error*) Trap_Read_Port_Serial(SerialConnection* serial)
+{
+    if (serial->share)
+        return Trap_Read_Shared_Serial(serial);
+    return Trap_Read_Serial_Coalesced(serial);  // see [Q]
+}
+
+
+//
+//  Get_Serial_Connection: C
+//
+// The connection in the port's STATE, created on first use.  See [B].
+//
+static SerialConnection* Get_Serial_Connection(const Stable* port)
+{
+    VarList* ctx = Cell_Varlist(port);
+    Stable* state = Stable_Slot_Hack(Varlist_Slot(ctx, STD_PORT_STATE));
+
+    if (Is_Handle(state))
+        return Cell_Handle_Pointer(SerialConnection, state);
+
+    SerialConnection* serial = rebAlloc(SerialConnection);
+    memset(serial, 0, sizeof(SerialConnection));
+    Init_Handle_Cdata_Managed(
+        state, serial, sizeof(SerialConnection), &Serial_Handle_Cleaner
+    );
+    return serial;
+}
+
+
+//
+//  Try_Get_Open_Serial: C
+//
+// For natives that take serial PORT!s as arguments.  Gives back nullptr if the
+// value isn't a PORT! of the serial scheme, or if it hasn't been opened.
+//
+static Option(SerialConnection*) Try_Get_Open_Serial(const Stable* v)
+{
+    if (not rebUnboxLogic(
+        "all [port?", v, "'serial = pick pick", v, "'scheme 'name]"
+    )){
+        return nullptr;
+    }
+
+    VarList* ctx = Cell_Varlist(v);
+    Stable* state = Stable_Slot_Hack(Varlist_Slot(ctx, STD_PORT_STATE));
+    if (not Is_Handle(state))
+        return nullptr;
+
+    SerialConnection* serial = Cell_Handle_Pointer(SerialConnection, state);
+    if (serial->handle == nullptr)
+        return nullptr;
+
+    return serial;
+}
+
+
+//
+//  Trap_Send_File_In_Parts: C
+//
+// For WRITE of a FILE! and SERIAL-SEND-FILE, see [O] at top of file.  Sets
+// *total to the bytes sent.
+//
+// 1. A part is about a quarter second of line time, so progress is reported
+//    a few times a second at any speed, within the bounds of what's sensible
+//    to hold in a buffer when the file can't be sent from the kernel.
+//
+// 2. Nothing is held open between parts, so if the progress callback panics
+//    there's only the path to clean up, and the API frees that.
+//
+static Option(Error*) Trap_Send_File_In_Parts(
+    Sink(int64_t) total,
+    SerialConnection* serial,
+    const Element* file,
+    Option(const Stable*) progress
+){
+    SerialConnection* device = Serial_Device(serial);  // one WRITE at a time
+
+    Size part = device->baud_rate / 40;  // [1]
+    if (part < SERIAL_FILE_PART_MIN)
+        part = SERIAL_FILE_PART_MIN;
+    if (part > SERIAL_FILE_PART_MAX)
+        part = SERIAL_FILE_PART_MAX;
+
+    char* path = rebSpell("file-to-local:full", file);
+
+    *total = 0;
+    Option(Error*) e;
+
+    while (true) {
+        Size sent;
+        int64_t file_size;
+        e = Trap_Send_Serial_File(
+            &sent, &file_size, device, path, *total, part
+        );
+        if (e)
+            break;
+
+        *total += sent;
+        if (progress)  // [2]
+            rebElide(rebRUN(unwrap progress), rebI(*total), rebI(file_size));
+
+        if (sent < part)
+            break;  // end of file
+    }
+
+    rebFree(path);
+    return e;
+}
+
+
 //
 //  export /serial-actor: native [
 //
@@ -64,22 +722,7 @@ DECLARE_NATIVE(SERIAL_ACTOR)
       Read_Slot(spec, spec_slot)
     );
 
-    DECLARE_STABLE (path);
-    Slot* head_ref_slot = Obj_Slot(spec, STD_PORT_SPEC_HEAD_REF);
-    require (
-      Read_Slot(path, head_ref_slot)
-    );
-    if (not Is_File(path))
-        panic (Error_Invalid_Spec_Raw(spec));
-
-    DECLARE_STABLE (state);
-    Slot* state_slot = Obj_Slot(spec, STD_PORT_STATE);
-    require (
-      Read_Slot(state, state_slot)
-    );
-
-    SerialConnection* serial = nullptr;  // in theory get from state...
-    UNUSED(state);  // (SERIAL-RS232! will likely be its own datatype...)
+    SerialConnection* serial = Get_Serial_Connection(port);  // see [B]
 
   //=//// ACTIONS FOR UNOPENED SERIAL PORT ////////////////////////////////=//
 
@@ -89,62 +732,23 @@ DECLARE_NATIVE(SERIAL_ACTOR)
             return LOGIC_OUT(false);
 
           case SYM_OPEN: {
-            serial->path = rebStable(
-                "try match [file! text!] pick", spec, "'serial-path"
-            );  // !!! handle needs release somewhere...
-            if (not serial->path)
-                return "panic -[SERIAL-PATH must be FILE! or TEXT!]-";
-
-            SerialBaudRate max_baud_rate = Get_Serial_Max_Baud_Rate();
-            int baud_rate = rebUnboxInteger("any [",
-                "try match integer pick", spec, "'serial-speed",
-                "0"
-            "]");
-            if (baud_rate <= 0 or baud_rate > max_baud_rate)
-                return rebDelegate("panic [",
-                    "SERIAL-SPEED must be nonzero INTEGER!",
-                    "up to", rebI(max_baud_rate),
-                "]");
-            serial->baud_rate = cast(SerialBaudRate, baud_rate);
-
-            serial->data_bits = rebUnboxInteger("any [",
-                "try match integer! pick", spec, "'serial-data-size"
-                "0"
-            "]");
-            if (serial->data_bits < 5 or serial->data_bits > 8)
-                return "panic -[DATA-SIZE must be INTEGER [5 .. 8]]-";
-
-            serial->stop_bits = rebUnboxInteger(
-                "try match integer! pick", spec, "'serial-stop-bits"
-            );
-            if (serial->stop_bits != 1 and serial->stop_bits != 2)
-                return "panic -[STOP-BITS must be INTEGER [1 or 2]]-";
-
-            int parity = rebUnboxInteger(
-                "switch try pick", spec, "'serial-parity [",
-                    " 'none [", rebI(SERIAL_PARITY_NONE), "]",
-                    " 'odd [", rebI(SERIAL_PARITY_ODD), "]",
-                    " 'even [", rebI(SERIAL_PARITY_EVEN), "]",
-                "] else [-1]"
-            );
-            if (parity == -1)
-                return "panic -[PARITY must be NONE/ODD/EVEN]-";
-            serial->parity = cast(SerialParity, parity);
-
-            int flow_control = rebUnboxInteger(
-                "switch try pick", spec, "'serial-flow-control [",
-                    "'none [", rebI(SERIAL_FLOW_CONTROL_NONE), "]",
-                    "'hardware [", rebI(SERIAL_FLOW_CONTROL_HARDWARE), "]",
-                    "'software [", rebI(SERIAL_FLOW_CONTROL_SOFTWARE), "]",
-                "] else [-1]"
-            );
-            if (flow_control == -1)
-                return ("panic -[FLOW-CONTROL must be NONE/HARDWARE/SOFTWARE]-");
-            serial->flow_control = cast(SerialFlowControl, flow_control);
+            const char* bad = Prep_Serial_Connection(serial, spec);
+            if (bad)
+                return bad;
 
-            e = Trap_Open_Serial(serial);
-            if (e)
-                panic (unwrap e);
+            if (serial->shared) {  // see %serial-share.c
+                e = Trap_Open_Shared_Serial(serial);
+                if (e)
+                    panic (unwrap e);
+                Report_Serial_Settings(spec, serial);
+            }
+            else {
+                e = Trap_Open_Serial(serial);
+                if (e)
+                    panic (unwrap e);
+            }
+
+            Report_Serial_Latency(spec, serial);
 
             return COPY_TO_OUT(port); }
 
@@ -165,48 +769,125 @@ DECLARE_NATIVE(SERIAL_ACTOR)
       case SYM_READ: {
         INCLUDE_PARAMS_OF_READ;
 
-        if (ARG(PART) or ARG(SEEK))
+        if (ARG(SEEK))
             panic (Error_Bad_Refines_Raw());
 
         UNUSED(PARAM(STRING));  // handled in dispatcher
         UNUSED(PARAM(LINES));  // handled in dispatcher
 
-        // Setup the read buffer (allocate a buffer if needed):
-        Stable* data = Stable_Slot_Hack(Varlist_Slot(ctx, STD_PORT_DATA));
-        if (not Is_Blob(data))
-            Init_Blob(data, Make_Binary(32000));
+        SerialRing* ring = &serial->in_ring;
 
-        Binary* bin = Cell_Binary_Known_Mutable(data);
-        serial->length = Flex_Available_Space(bin);
-        if (serial->length < 32000 / 2) {
-            require (
-              Extend_Flex_If_Necessary_But_Dont_Change_Used(bin, 32000)
-            );
+        if (serial->framer.kind != SERIAL_FRAMING_NONE) {  // see [F]
+            REBLEN limit = ARG(PART)
+                ? cast(REBLEN, Int32s(unwrap ARG(PART), 0))
+                : UINT32_MAX;
+
+            Value* frames = rebValue("copy []");
+            REBLEN count = 0;
+            while (count < limit) {
+                Size raw_size;
+                e = Trap_Find_Serial_Frame(&raw_size, &serial->framer, ring);
+                if (e) {
+                    rebRelease(frames);
+                    panic (unwrap e);
+                }
+
+                if (raw_size == 0) {  // partial frame stays in the ring
+                    if (count != 0)
+                        break;
+                    e = Trap_Read_Port_Serial(serial);
+                    if (e) {
+                        rebRelease(frames);
+                        panic (unwrap e);
+                    }
+                    if (serial->actual == 0)  // blocking mode deadline
+                        break;
+                    continue;
+                }
+
+                Byte* bytes = rebAllocN(Byte, raw_size);
+                Size size;
+                if (not Take_Serial_Frame(
+                    &size, bytes, &serial->framer, ring, raw_size
+                )){
+                    rebFree(bytes);  // resync or malformed SLIP/COBS
+                    continue;
+                }
+                rebElide("append", frames, rebR(rebRepossess(bytes, size)));
+                ++count;
+            }
+            Resume_Serial_Reading(serial);
+            return frames;
         }
 
-        serial->length = Flex_Available_Space(bin);
-        serial->data = Binary_Tail(bin);  // write at tail
-        serial->actual = 0;  // Actual for THIS read, not for total.
+        if (serial->stamps.buf) {  // see [R]
+            REBLEN limit = ARG(PART)
+                ? cast(REBLEN, Int32s(unwrap ARG(PART), 0))
+                : UINT32_MAX;
 
-      #if DEBUG_SERIAL_EXTENSION
-        printf("(max read length %d)", serial->length);
-      #endif
+            Value* chunks = rebValue("copy []");
+            REBLEN count = 0;
+            while (count < limit) {
+                int64_t usec;
+                int32_t settle_usec;
+                Size size = Measure_Serial_Stamped_Chunk(
+                    &usec, &settle_usec, serial
+                );
 
-        e = Trap_Read_Serial(serial);  // can recv immediately
-        if (e)
-            panic (unwrap e);
+                if (size == 0) {  // nothing, or chunk that may still grow
+                    if (count != 0)
+                        break;
+                    if (settle_usec != 0)
+                        e = Trap_Read_Serial_Within(serial, settle_usec);
+                    else
+                        e = Trap_Read_Port_Serial(serial);
+                    if (e) {
+                        rebRelease(chunks);
+                        panic (unwrap e);
+                    }
+                    if (serial->actual == 0 and settle_usec == 0)
+                        break;  // blocking mode deadline
+                    continue;
+                }
+
+                Byte* bytes = rebAllocN(Byte, size);
+                Serial_Ring_Consume(ring, bytes, size);
+                rebElide(
+                    "append", chunks, rebI(usec),
+                    "append", chunks, rebR(rebRepossess(bytes, size))
+                );
+                ++count;
+            }
+            Resume_Serial_Reading(serial);
+            return chunks;
+        }
+
+        if (Serial_Ring_Used(ring) == 0) {  // left over from :PART, see [C]
+            e = Trap_Read_Port_Serial(serial);  // may run the loop [A]
+            if (e)
+                panic (unwrap e);
+        }
 
-        // !!! Incomplete reads need event loop interop, see [A] above
+        Size size = Serial_Ring_Used(ring);
+        if (ARG(PART)) {
+            REBLEN limit = Int32s(unwrap ARG(PART), 0);
+            if (limit < size)
+                size = limit;
+        }
+
+        Byte* bytes = rebAllocN(Byte, size);
+        Serial_Ring_Consume(ring, bytes, size);
+        Resume_Serial_Reading(serial);
 
       #if DEBUG_SERIAL_EXTENSION
-        for (len = 0; len < serial->actual; len++) {
+        for (Size len = 0; len < size; len++) {
             if (len % 16 == 0) printf("\n");
-            printf("%02x ", serial->data[len]);
+            printf("%02x ", bytes[len]);
         }
         printf("\n");
       #endif
 
-        return COPY_TO_OUT(port); }
+        return rebRepossess(bytes, size); }
 
       case SYM_WRITE: {
         INCLUDE_PARAMS_OF_WRITE;
@@ -214,39 +895,154 @@ DECLARE_NATIVE(SERIAL_ACTOR)
         if (ARG(SEEK) or ARG(APPEND) or ARG(LINES))
             panic (Error_Bad_Refines_Raw());
 
-        // Determine length. Clip :PART to size of BLOB! if needed.
-
         Element* data = Element_ARG(DATA);
-        Length len = Series_Len_At(data);
-        if (ARG(PART)) {
-            REBLEN n = Int32s(unwrap ARG(PART), 0);
-            if (n <= len)
-                len = n;
+
+        SerialChunk single;
+        SerialChunk* chunks;
+        int num_chunks;
+
+        if (Is_Blob(data)) {  // Clip :PART to size of BLOB! if needed
+            Length len = Series_Len_At(data);
+            if (ARG(PART)) {
+                REBLEN n = Int32s(unwrap ARG(PART), 0);
+                if (n <= len)
+                    len = n;
+            }
+            single.data = Blob_At(data);
+            single.length = len;
+            chunks = &single;
+            num_chunks = 1;
         }
+        else if (Is_Block(data)) {  // batch of BLOB!s, see [D]
+            if (ARG(PART))
+                panic (Error_Bad_Refines_Raw());
 
-        Init(Stable) init = Slot_Init_Hack(Varlist_Slot(ctx, STD_PORT_DATA));
-        Copy_Cell(init, data);
-        Remember_Cell_Is_Lifeguard(init);
+            const Element* tail;
+            const Element* item = List_At(&tail, data);
+            num_chunks = tail - item;
+            if (num_chunks == 0)
+                return COPY_TO_OUT(port);
 
-        serial->length = len;
-        serial->data = Blob_At_Known_Mutable(data);
+            chunks = rebAllocN(SerialChunk, num_chunks);
+            for (int i = 0; item != tail; ++item, ++i) {
+                if (not Is_Blob(item)) {
+                    rebFree(chunks);
+                    return "panic -[Serial WRITE BLOCK! must hold BLOB!s]-";
+                }
+                chunks[i].data = Blob_At(item);
+                chunks[i].length = Series_Len_At(item);
+            }
+        }
+        else if (Is_File(data)) {  // sent a part at a time, see [O]
+            if (ARG(PART))
+                panic (Error_Bad_Refines_Raw());
+
+            int64_t total;
+            e = Trap_Send_File_In_Parts(&total, serial, data, nullptr);
+            if (e)
+                panic (unwrap e);
+
+            return COPY_TO_OUT(port);
+        }
+        else
+            return "panic -[Serial WRITE takes BLOB!, BLOCK! of BLOB!, FILE!]-";
+
+        serial->chunks = chunks;
+        serial->num_chunks = num_chunks;
         serial->actual = 0;
 
-        // "send can happen immediately"
-        //
-        e = Trap_Write_Serial(serial);  // can send immediately
-        Forget_Cell_Was_Lifeguard(init);
+        if (serial->share)  // writes are one at a time anyway, see [D] there
+            e = Trap_Write_Shared_Serial(serial);
+        else
+            e = Trap_Write_Serial(serial);  // runs loop if it must wait [A]
+
+        serial->chunks = nullptr;  // backlog was copied, data not referenced
+        serial->num_chunks = 0;
+        if (chunks != &single)
+            rebFree(chunks);
 
         if (e)
             panic (unwrap e);
 
-        // !!! Incomplete reads need event loop interop, see [A] above
-
         return COPY_TO_OUT(port); }
 
+      case SYM_QUERY: {  // see [G]
+        SerialStats* stats = &Serial_Device(serial)->stats;
+        Value* info = rebValue("make object! [",
+            "bytes-in:", rebI(Serial_Stat_Load(stats->bytes_in)),
+            "bytes-out:", rebI(Serial_Stat_Load(stats->bytes_out)),
+            "reads:", rebI(Serial_Stat_Load(stats->reads)),
+            "writes:", rebI(Serial_Stat_Load(stats->writes)),
+            "would-block:", rebI(Serial_Stat_Load(stats->would_block)),
+            "max-backlog:", rebI(stats->max_backlog),
+            "blocked-usec:", rebI(stats->blocked_usec),
+            "dropped:", rebI(Serial_Stat_Load(serial->stats.dropped)),
+            "frame-errors: overruns: parity-errors: breaks:",
+            "buffer-overruns: null",
+        "]");
+
+        SerialLineErrors errors;
+        if (Get_Serial_Line_Errors(&errors, Serial_Device(serial)))
+            rebElide(
+                "poke", info, "'frame-errors", rebI(errors.frame),
+                "poke", info, "'overruns", rebI(errors.overrun),
+                "poke", info, "'parity-errors", rebI(errors.parity),
+                "poke", info, "'breaks", rebI(errors.brk),
+                "poke", info, "'buffer-overruns", rebI(errors.buf_overrun)
+            );
+
+        return info; }
+
+      case SYM_MODIFY: {  // see [I]
+        INCLUDE_PARAMS_OF_MODIFY;
+
+        Stable* field = ARG(FIELD);
+        Stable* value = ARG(VALUE);
+
+        if (not rebUnboxLogic(
+            "did find [speed data-size parity stop-bits flow-control latency]",
+                rebQ(field)
+        )){
+            return "panic -[MODIFY of serial port can't change that field]-";
+        }
+
+        Value* changed = rebValue("copy", spec);
+        rebElide("poke", changed, rebQ(field), rebQ(value));
+
+        SerialConnection* device = Serial_Device(serial);  // shared: for all
+
+        SerialConnection prior = *device;  // settings to go back to on error
+        const char* bad = Parse_Serial_Settings(device, changed);
+        if (not bad)
+            e = Trap_Modify_Serial(device);
+        rebRelease(changed);
+
+        if (bad or e) {
+            device->baud_rate = prior.baud_rate;
+            device->data_bits = prior.data_bits;
+            device->stop_bits = prior.stop_bits;
+            device->parity = prior.parity;
+            device->flow_control = prior.flow_control;
+            device->low_latency = prior.low_latency;
+            if (bad)
+                return bad;
+
+            Option(Error*) e_prior = Trap_Modify_Serial(device);  // see [I]
+            UNUSED(e_prior);  // the first error is the one to report
+            panic (unwrap e);
+        }
+
+        rebElide("poke", spec, rebQ(field), rebQ(value));
+        Report_Serial_Latency(spec, device);
+
+        return LOGIC_OUT(true); }
+
       case SYM_CLOSE:
         if (serial->handle != nullptr) {  // !!! tolerate double closes?
-            e = Trap_Close_Serial(serial);
+            if (serial->share)
+                e = Trap_Close_Shared_Serial(serial);
+            else
+                e = Trap_Close_Serial(serial);
             if (e)
                 panic (unwrap e);
 
@@ -260,3 +1056,1098 @@ DECLARE_NATIVE(SERIAL_ACTOR)
 
     panic (UNHANDLED);
 }
+
+
+//
+//  export /serial-wait: native [
+//
+//  "Wait for any of the serial ports to have data to READ, return those"
+//
+//      return: "Ports ready to READ, empty if timed out"
+//          [block!]
+//      ports [block!]
+//      :timeout "Seconds to wait (default is to wait indefinitely)"
+//          [integer! decimal!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_WAIT)
+//
+// On Linux this is done with one epoll set for all open serial ports, so the
+// cost per wakeup scales with the number of ready ports.  See [G] in the file
+// %serial-posix.c
+//
+// 1. Ports with `shared: 'yes` on the same device are waited on once, and
+//    all come back ready together.  Only those are looked for duplicates, so
+//    a block of unshared ports costs the same as it did before sharing.
+//
+// 2. A sharing port can have data in its own ring which the device's doesn't
+//    have anymore, since another port's READ handed it out (see [C] in the
+//    file %serial-share.c).  It's ready without asking the device.
+{
+    INCLUDE_PARAMS_OF_SERIAL_WAIT;
+
+    Element* ports = Element_ARG(PORTS);
+
+    int32_t timeout_msec = -1;
+    if (ARG(TIMEOUT)) {
+        timeout_msec = rebUnboxInteger(
+            "to integer! round 1000 *", unwrap ARG(TIMEOUT)
+        );
+        if (timeout_msec < 0)
+            return "panic -[SERIAL-WAIT :TIMEOUT can't be negative]-";
+    }
+
+    const Element* tail;
+    const Element* head = List_At(&tail, ports);
+    int count = tail - head;
+    if (count == 0)
+        return rebValue("copy []");
+
+    SerialConnection** serials = rebAllocN(SerialConnection*, count);
+    int* device_index = rebAllocN(int, count);  // ports sharing a device [1]
+    int num_devices = 0;
+    bool any_shared = false;
+    bool any_buffered = false;
+
+    for (int i = 0; i < count; ++i) {
+        Option(SerialConnection*) serial = Try_Get_Open_Serial(&head[i]);
+        if (not serial) {
+            rebFree(device_index);
+            rebFree(serials);
+            return "panic -[SERIAL-WAIT needs BLOCK! of open serial PORT!s]-";
+        }
+
+        SerialConnection* device = Serial_Device(unwrap serial);
+        if (device != unwrap serial) {
+            Fan_Out_Serial_Share((unwrap serial)->share);
+            if (Serial_Ring_Used(&(unwrap serial)->in_ring) != 0)
+                any_buffered = true;
+            any_shared = true;
+        }
+
+        int d = num_devices;
+        if (device != unwrap serial) {
+            for (d = 0; d < num_devices; ++d)
+                if (serials[d] == device)
+                    break;
+        }
+        if (d == num_devices)
+            serials[num_devices++] = device;
+        device_index[i] = d;
+    }
+
+    Value* result = rebValue("copy []");
+
+    if (any_buffered) {  // sharing ports with data handed out already [2]
+        for (int i = 0; i < count; ++i) {
+            SerialConnection* serial = unwrap Try_Get_Open_Serial(&head[i]);
+            if (Serial_Ring_Used(&serial->in_ring) != 0)
+                rebElide("append", result, &head[i]);
+        }
+        rebFree(device_index);
+        rebFree(serials);
+        return result;
+    }
+
+    int* ready = rebAllocN(int, num_devices);
+    int num_ready;
+    Option(Error*) e = Trap_Wait_Serials(
+        &num_ready, ready, serials, num_devices, timeout_msec
+    );
+    rebFree(serials);
+
+    if (e) {
+        rebFree(ready);
+        rebFree(device_index);
+        rebRelease(result);
+        panic (unwrap e);
+    }
+
+    if (not any_shared) {  // one port per device, in order they came ready
+        for (int k = 0; k < num_ready; ++k)
+            rebElide("append", result, &head[ready[k]]);
+    }
+    else {
+        bool* device_ready = rebAllocN(bool, num_devices);
+        memset(device_ready, 0, num_devices * sizeof(bool));
+        for (int k = 0; k < num_ready; ++k)
+            device_ready[ready[k]] = true;
+
+        for (int i = 0; i < count; ++i) {
+            if (device_ready[device_index[i]])
+                rebElide("append", result, &head[i]);
+        }
+        rebFree(device_ready);
+    }
+
+    rebFree(ready);
+    rebFree(device_index);
+    return result;
+}
+
+
+//
+//  export /serial-benchmark: native [
+//
+//  "Measure serial I/O throughput and latency over a pseudo-terminal pair"
+//
+//      return: "BYTES-PER-SEC, SYSCALLS-PER-KB, LATENCY-P50/P99/P999 (usec)"
+//          [object!]
+//      :engine "LOOP (default), THREAD, or BLOCKING"
+//          [word!]
+//      :chunk "Bytes per WRITE (default 256)"
+//          [integer!]
+//      :total "Bytes to echo for the throughput run (default 1048576)"
+//          [integer!]
+//      :round-trips "Chunks to time the echo of (default 1000)"
+//          [integer!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_BENCHMARK)
+//
+// Not available on Windows.  See notes in %serial-benchmark.c
+{
+    INCLUDE_PARAMS_OF_SERIAL_BENCHMARK;
+
+    SerialBenchParams params;
+    params.io_engine = SERIAL_IO_LOOP;
+    params.timeout_msec = -1;
+    params.chunk_size = 256;
+    params.total_bytes = 1048576;
+    params.round_trips = 1000;
+
+    if (ARG(ENGINE)) {
+        int engine = rebUnboxInteger(
+            "switch", rebQ(unwrap ARG(ENGINE)), "[",
+                "'loop [0] 'thread [1] 'blocking [2]",
+            "] else [-1]"
+        );
+        if (engine == -1)
+            return "panic -[SERIAL-BENCHMARK :ENGINE is LOOP/THREAD/BLOCKING]-";
+        if (engine == 1)
+            params.io_engine = SERIAL_IO_THREAD;
+        else if (engine == 2)
+            params.timeout_msec = 5000;  // only reached if the echo stalls
+    }
+    if (ARG(CHUNK))
+        params.chunk_size = Int32s(unwrap ARG(CHUNK), 1);
+    if (ARG(TOTAL))
+        params.total_bytes = Int32s(unwrap ARG(TOTAL), 1);
+    if (ARG(ROUND_TRIPS))
+        params.round_trips = Int32s(unwrap ARG(ROUND_TRIPS), 1);
+
+    SerialBenchResults results;
+    Option(Error*) e = Trap_Run_Serial_Benchmark(&results, &params);
+    if (e)
+        panic (unwrap e);
+
+    return rebValue("make object! [",
+        "bytes-per-sec:", rebI(cast(int64_t, results.bytes_per_sec)),
+        "syscalls-per-kb: all [",
+            rebDecimal(results.syscalls_per_kb), ">= 0.0,",
+            rebDecimal(results.syscalls_per_kb),
+        "]",
+        "latency-p50:", rebI(cast(int64_t, results.latency_usec[0])),
+        "latency-p99:", rebI(cast(int64_t, results.latency_usec[1])),
+        "latency-p999:", rebI(cast(int64_t, results.latency_usec[2])),
+    "]");
+}
+
+
+//
+//  export /serial-replay: native [
+//
+//  "Play back what a port's CAPTURE received, on a new pseudo-terminal"
+//
+//      return: "Path of the pseudo-terminal, to OPEN as the serial device"
+//          [file!]
+//      capture "File written by a port with CAPTURE in its spec"
+//          [file!]
+//      :speed "Multiple of the recorded pace (default 1)"
+//          [integer! decimal!]
+//      :fast "Ignore the recorded timing, and send as fast as it's read"
+//  ]
+//
+DECLARE_NATIVE(SERIAL_REPLAY)
+//
+// Playback starts when the pseudo-terminal is opened (within 10 seconds), and
+// what's written to it is thrown away.  Not available on Windows.  See [E]
+// in %serial-capture.c
+{
+    INCLUDE_PARAMS_OF_SERIAL_REPLAY;
+
+    double speed = 1.0;
+    if (ARG(SPEED)) {
+        speed = rebUnboxDecimal("to decimal!", unwrap ARG(SPEED));
+        if (speed <= 0.0)
+            return "panic -[SERIAL-REPLAY :SPEED must be positive]-";
+    }
+    if (Bool_ARG(FAST)) {
+        if (ARG(SPEED))
+            return "panic -[SERIAL-REPLAY can't use both :SPEED and :FAST]-";
+        speed = 0.0;
+    }
+
+    char* capture_path = rebSpell(
+        "file-to-local:full", Element_ARG(CAPTURE)
+    );
+
+    char pty_path[MAX_SERIAL_DEV_PATH];
+    Option(Error*) e = Trap_Start_Serial_Replay(
+        pty_path, sizeof(pty_path), capture_path, speed
+    );
+    rebFree(capture_path);
+    if (e)
+        panic (unwrap e);
+
+    return rebValue("as file!", rebT(pty_path));
+}
+
+
+//
+//  export /serial-modbus: native [
+//
+//  "Run Modbus RTU requests one after another, as fast as the bus allows"
+//
+//      return: "Each response's PDU (function code first), or ERROR!"
+//          [block!]
+//      port "Open serial port, not shared"
+//          [port!]
+//      requests "Unit IDs, each followed by a request PDU BLOB!"
+//          [block!]
+//      :timeout "Seconds to wait for each response (default 1)"
+//          [integer! decimal!]
+//      :turnaround "Seconds to wait after a broadcast to unit 0 (default 0.1)"
+//          [integer! decimal!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_MODBUS)
+//
+// e.g. `serial-modbus port [1 #{03 0000 000A} 2 #{04 0064 0002}]` reads ten
+// holding registers from unit 1 and two input registers from unit 2.  An
+// exception response comes back as a PDU too, with the function code's
+// 0x80 bit set.  A broadcast's result is an empty BLOB!.  See notes in the
+// file %serial-modbus.c
+{
+    INCLUDE_PARAMS_OF_SERIAL_MODBUS;
+
+    Option(SerialConnection*) serial = Try_Get_Open_Serial(Element_ARG(PORT));
+    if (not serial)
+        return "panic -[SERIAL-MODBUS needs an open serial PORT!]-";
+    if ((unwrap serial)->share)
+        return "panic -[SERIAL-MODBUS can't use a `shared: 'yes` port]-";
+
+    SerialModbusParams params;
+    params.timeout_usec = 1000000;
+    params.turnaround_usec = 100000;
+
+    if (ARG(TIMEOUT)) {
+        params.timeout_usec = rebUnboxInteger(
+            "to integer! round 1000000 *", unwrap ARG(TIMEOUT)
+        );
+        if (params.timeout_usec <= 0)
+            return "panic -[SERIAL-MODBUS :TIMEOUT must be positive]-";
+    }
+    if (ARG(TURNAROUND)) {
+        params.turnaround_usec = rebUnboxInteger(
+            "to integer! round 1000000 *", unwrap ARG(TURNAROUND)
+        );
+        if (params.turnaround_usec < 0)
+            return "panic -[SERIAL-MODBUS :TURNAROUND can't be negative]-";
+    }
+
+    const Element* tail;
+    const Element* at = List_At(&tail, Element_ARG(REQUESTS));
+    if ((tail - at) % 2 != 0)
+        return "panic -[SERIAL-MODBUS needs unit ID and PDU BLOB! pairs]-";
+
+    Length count = (tail - at) / 2;
+    if (count == 0)
+        return rebValue("copy []");
+
+    SerialModbusTransaction* txns = rebAllocN(SerialModbusTransaction, count);
+    for (Length n = 0; n < count; ++n, at += 2) {
+        int unit = rebUnboxInteger(
+            "if all [integer?", &at[0], "blob?", &at[1], "] [", &at[0], "]",
+            "else [-1]"
+        );
+        Size pdu_size = (unit == -1) ? 0 : Series_Len_At(&at[1]);
+        if (
+            unit < 0 or unit > 255
+            or pdu_size == 0 or pdu_size > SERIAL_MODBUS_MAX_PDU
+        ){
+            rebFree(txns);
+            return "panic -[SERIAL-MODBUS needs unit IDs 0-255, and PDUs of"
+                " 1 to 253 bytes]-";
+        }
+        txns[n].unit = unit;
+        txns[n].pdu = Blob_At(&at[1]);
+        txns[n].pdu_size = pdu_size;
+    }
+
+    Option(Error*) e = Trap_Run_Modbus_Transactions(
+        unwrap serial, txns, count, &params
+    );
+    Resume_Serial_Reading(unwrap serial);
+    if (e) {
+        rebFree(txns);
+        panic (unwrap e);
+    }
+
+    Value* result = rebValue("make block!", rebI(count));
+    for (Length n = 0; n < count; ++n) {
+        if (txns[n].error) {
+            DECLARE_ELEMENT (error);
+            Init_Error(error, unwrap txns[n].error);
+            rebElide("append", result, rebQ(error));
+            continue;
+        }
+
+        if (txns[n].response_size == 0) {  // broadcast
+            rebElide("append", result, "copy #{}");
+            continue;
+        }
+
+        Byte* bytes = rebAllocN(Byte, txns[n].response_size);
+        memcpy(bytes, txns[n].response, txns[n].response_size);
+        rebElide(
+            "append", result, rebR(rebRepossess(bytes, txns[n].response_size))
+        );
+    }
+
+    rebFree(txns);
+    return result;
+}
+
+
+//
+//  Prep_Serial_Reply_Rules: C
+//
+// The rules for when a reply is complete, which SERIAL-TRANSACT and SERIAL-BUS
+// take the same way.  Gives back a panic string if they're bad, else nullptr.
+//
+static const char* Prep_Serial_Reply_Rules(
+    SerialTransaction* txn,
+    Option(const Stable*) terminator,
+    Option(const Stable*) length,
+    Option(const Stable*) idle,
+    Option(const Stable*) timeout
+){
+    txn->request = nullptr;
+    txn->request_size = 0;
+    txn->terminator = nullptr;
+    txn->terminator_size = 0;
+    txn->length = 0;
+    txn->idle_usec = 0;
+    txn->timeout_usec = 1000000;
+
+    if (terminator) {
+        txn->terminator = Blob_At(unwrap terminator);
+        txn->terminator_size = Series_Len_At(unwrap terminator);
+        if (txn->terminator_size == 0)
+            return "panic -[Reply :TERMINATOR can't be empty]-";
+    }
+    if (length)
+        txn->length = Int32s(unwrap length, 1);
+    if (idle) {
+        txn->idle_usec = rebUnboxInteger(
+            "to integer! round 1000000 *", unwrap idle
+        );
+        if (txn->idle_usec <= 0)
+            return "panic -[Reply :IDLE must be positive]-";
+    }
+    if (timeout) {
+        txn->timeout_usec = rebUnboxInteger(
+            "to integer! round 1000000 *", unwrap timeout
+        );
+        if (txn->timeout_usec <= 0)
+            return "panic -[Reply :TIMEOUT must be positive]-";
+    }
+
+    if (
+        txn->terminator_size == 0 and txn->length == 0 and txn->idle_usec == 0
+    ){
+        return "panic -[Reply needs :TERMINATOR, :LENGTH or :IDLE]-";
+    }
+    return nullptr;
+}
+
+
+//
+//  export /serial-transact: native [
+//
+//  "Write a request to the port, and read the reply once it's complete"
+//
+//      return: "Reply, or null if it wasn't complete in time"
+//          [null? blob!]
+//      port "Open serial port, not shared"
+//          [port!]
+//      request [blob!]
+//      :terminator "Reply ends with these bytes"
+//          [blob!]
+//      :length "Reply is this many bytes"
+//          [integer!]
+//      :idle "Reply ends when nothing arrives for this many seconds"
+//          [integer! decimal!]
+//      :timeout "Seconds to wait for the whole reply (default 1)"
+//          [integer! decimal!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_TRANSACT)
+//
+// e.g. `serial-transact:terminator port #{2A49444E3F0D} #{0A}` sends "*IDN?"
+// and returns the reply up to and including its linefeed.  At least one of
+// :TERMINATOR, :LENGTH and :IDLE is needed, and the reply is complete when
+// the first of them is met.  See notes in %serial-transact.c
+{
+    INCLUDE_PARAMS_OF_SERIAL_TRANSACT;
+
+    Option(SerialConnection*) serial = Try_Get_Open_Serial(Element_ARG(PORT));
+    if (not serial)
+        return "panic -[SERIAL-TRANSACT needs an open serial PORT!]-";
+    if ((unwrap serial)->share)
+        return "panic -[SERIAL-TRANSACT can't use a `shared: 'yes` port]-";
+
+    SerialTransaction txn;
+    const char* bad = Prep_Serial_Reply_Rules(
+        &txn, ARG(TERMINATOR), ARG(LENGTH), ARG(IDLE), ARG(TIMEOUT)
+    );
+    if (bad)
+        return bad;
+    txn.request = Blob_At(Element_ARG(REQUEST));
+    txn.request_size = Series_Len_At(Element_ARG(REQUEST));
+
+    Size reply_size;
+    Option(Error*) e = Trap_Transact_Serial(&reply_size, unwrap serial, &txn);
+    if (e)
+        panic (unwrap e);
+
+    if (reply_size == 0)
+        return nullptr;
+
+    Byte* bytes = rebAllocN(Byte, reply_size);
+    Serial_Ring_Consume(&(unwrap serial)->in_ring, bytes, reply_size);
+    Resume_Serial_Reading(unwrap serial);
+    return rebRepossess(bytes, reply_size);
+}
+
+
+//
+//  export /serial-bus: native [
+//
+//  "Send requests to the devices on a bus in turn, and collect the replies"
+//
+//      return: "Each reply, or ERROR! if it wasn't complete in time"
+//          [block!]
+//      port "Open serial port, not shared"
+//          [port!]
+//      requests "BLOB!s, each addressed to a device as its protocol does"
+//          [block!]
+//      :terminator "Replies end with these bytes"
+//          [blob!]
+//      :length "Replies are this many bytes"
+//          [integer!]
+//      :idle "Replies end when nothing arrives for this many seconds"
+//          [integer! decimal!]
+//      :timeout "Seconds to wait for each whole reply (default 1)"
+//          [integer! decimal!]
+//      :turnaround "Seconds after a reply before the next request (default 0)"
+//          [integer! decimal!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_BUS)
+//
+// e.g. `serial-bus:terminator:turnaround port [#{0152} #{0252}] #{0D} 0.001`
+// sends "R" to devices 1 and 2 in a protocol whose replies end with a CR,
+// giving each a millisecond to release the bus after it replies.  The reply
+// rules are SERIAL-TRANSACT's.  See notes in %serial-bus.c
+{
+    INCLUDE_PARAMS_OF_SERIAL_BUS;
+
+    Option(SerialConnection*) serial = Try_Get_Open_Serial(Element_ARG(PORT));
+    if (not serial)
+        return "panic -[SERIAL-BUS needs an open serial PORT!]-";
+    if ((unwrap serial)->share)
+        return "panic -[SERIAL-BUS can't use a `shared: 'yes` port]-";
+
+    SerialBusParams params;
+    const char* bad = Prep_Serial_Reply_Rules(
+        &params.rules, ARG(TERMINATOR), ARG(LENGTH), ARG(IDLE), ARG(TIMEOUT)
+    );
+    if (bad)
+        return bad;
+
+    params.turnaround_usec = 0;
+    if (ARG(TURNAROUND)) {
+        params.turnaround_usec = rebUnboxInteger(
+            "to integer! round 1000000 *", unwrap ARG(TURNAROUND)
+        );
+        if (params.turnaround_usec < 0)
+            return "panic -[SERIAL-BUS :TURNAROUND can't be negative]-";
+    }
+
+    const Element* tail;
+    const Element* at = List_At(&tail, Element_ARG(REQUESTS));
+    Length count = tail - at;
+    if (count == 0)
+        return rebValue("copy []");
+
+    for (const Element* item = at; item != tail; ++item) {
+        if (not Is_Blob(item) or Series_Len_At(item) == 0)
+            return "panic -[SERIAL-BUS requests must be non-empty BLOB!s]-";
+    }
+
+    SerialBusExchange* exchanges = rebAllocN(SerialBusExchange, count);
+    for (Length n = 0; n < count; ++n) {
+        exchanges[n].request = Blob_At(&at[n]);
+        exchanges[n].request_size = Series_Len_At(&at[n]);
+    }
+
+    Option(Error*) e = Trap_Run_Serial_Bus(
+        unwrap serial, exchanges, count, &params
+    );
+    Resume_Serial_Reading(unwrap serial);
+    if (e) {
+        for (Length n = 0; n < count; ++n) {
+            if (exchanges[n].reply)
+                rebFree(exchanges[n].reply);
+        }
+        rebFree(exchanges);
+        panic (unwrap e);
+    }
+
+    Value* result = rebValue("make block!", rebI(count));
+    for (Length n = 0; n < count; ++n) {
+        if (exchanges[n].reply == nullptr) {
+            DECLARE_ELEMENT (error);
+            Init_Error(error, Error_User("No complete reply in time"));
+            rebElide("append", result, rebQ(error));
+            continue;
+        }
+        rebElide("append", result, rebR(
+            rebRepossess(exchanges[n].reply, exchanges[n].reply_size)
+        ));
+    }
+
+    rebFree(exchanges);
+    return result;
+}
+
+
+//
+//  export /serial-checksum: native [
+//
+//  "Checksum of BLOB! data, as a serial protocol would compute it"
+//
+//      return: [integer!]
+//      method "CRC32 CRC32C CRC16-MODBUS CRC16-CCITT CRC16-XMODEM LRC XOR"
+//          [word!]
+//      data [blob!]
+//      :part "Bytes of DATA to checksum (default is to its tail)"
+//          [integer!]
+//      :prior "Checksum of the data before DATA, to continue it from"
+//          [integer!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_CHECKSUM)
+//
+// CRC16-CCITT is the variant that starts at 0xFFFF (a.k.a. "CCITT-FALSE").
+// Continuing with :PRIOR gives the same result as checksumming all the data
+// at once, so a frame can be checked as it arrives.  See %serial-checksum.c
+{
+    INCLUDE_PARAMS_OF_SERIAL_CHECKSUM;
+
+    int method = rebUnboxInteger(
+        "switch", rebQ(Element_ARG(METHOD)), "[",
+            "'crc32 [", rebI(SERIAL_CHECKSUM_CRC32), "]",
+            "'crc32c [", rebI(SERIAL_CHECKSUM_CRC32C), "]",
+            "'crc16-modbus [", rebI(SERIAL_CHECKSUM_CRC16_MODBUS), "]",
+            "'crc16-ccitt [", rebI(SERIAL_CHECKSUM_CRC16_CCITT), "]",
+            "'crc16-xmodem [", rebI(SERIAL_CHECKSUM_CRC16_XMODEM), "]",
+            "'lrc [", rebI(SERIAL_CHECKSUM_LRC), "]",
+            "'xor [", rebI(SERIAL_CHECKSUM_XOR), "]",
+        "] else [-1]"
+    );
+    if (method == -1)
+        return "panic -[SERIAL-CHECKSUM doesn't know that METHOD]-";
+
+    Size size = Series_Len_At(Element_ARG(DATA));
+    if (ARG(PART)) {
+        int32_t part = Int32s(unwrap ARG(PART), 0);
+        if (cast(Size, part) < size)
+            size = part;
+    }
+
+    uint32_t checksum = Empty_Serial_Checksum(cast(SerialChecksum, method));
+    if (ARG(PRIOR)) {
+        int64_t prior = rebUnboxInteger(unwrap ARG(PRIOR));
+        if (prior < 0 or prior > 0xFFFFFFFF)
+            return "panic -[SERIAL-CHECKSUM :PRIOR must be 0 to FFFFFFFFh]-";
+        checksum = cast(uint32_t, prior);
+    }
+
+    checksum = Continue_Serial_Checksum(
+        cast(SerialChecksum, method),
+        checksum,
+        Blob_At(Element_ARG(DATA)),
+        size
+    );
+    return rebInteger(checksum);
+}
+
+
+//
+//  export /serial-send-file: native [
+//
+//  "Send a file's contents to the port, a part at a time"
+//
+//      return: "Bytes sent"
+//          [integer!]
+//      port [port!]
+//      file [file!]
+//      :progress "Called with bytes sent so far and file size after each part"
+//          [<unrun> frame!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_SEND_FILE)
+//
+// Same as WRITE of the FILE!, but with progress.  See [O] at top of file.
+{
+    INCLUDE_PARAMS_OF_SERIAL_SEND_FILE;
+
+    Option(SerialConnection*) serial = Try_Get_Open_Serial(Element_ARG(PORT));
+    if (not serial)
+        return "panic -[SERIAL-SEND-FILE needs an open serial PORT!]-";
+
+    int64_t total;
+    Option(Error*) e = Trap_Send_File_In_Parts(
+        &total, unwrap serial, Element_ARG(FILE), ARG(PROGRESS)
+    );
+    if (e)
+        panic (unwrap e);
+
+    return rebInteger(total);
+}
+
+
+//
+//  export /serial-send-xmodem: native [
+//
+//  "Send files to a receiver by XMODEM, XMODEM-1K or YMODEM"
+//
+//      return: "Bytes of file data sent"
+//          [integer!]
+//      port "Open serial port, not shared"
+//          [port!]
+//      files "A FILE!, or for YMODEM a BLOCK! of them"
+//          [file! block!]
+//      :protocol "XMODEM, XMODEM-1K (default) or YMODEM"
+//          [word!]
+//      :timeout "Seconds for the receiver to ask for each file (default 60)"
+//          [integer! decimal!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_SEND_XMODEM)
+//
+// The receiver picks the checksum or CRC, and YMODEM-G by asking with 'G'.
+// YMODEM sends the files' names without their directories.  See notes in
+// the file %serial-xmodem.c
+{
+    INCLUDE_PARAMS_OF_SERIAL_SEND_XMODEM;
+
+    Option(SerialConnection*) serial = Try_Get_Open_Serial(Element_ARG(PORT));
+    if (not serial)
+        return "panic -[SERIAL-SEND-XMODEM needs an open serial PORT!]-";
+    if ((unwrap serial)->share)
+        return "panic -[SERIAL-SEND-XMODEM can't use a `shared: 'yes` port]-";
+
+    SerialXmodemParams params;
+    params.protocol = SERIAL_XMODEM_1K;
+    params.start_msec = 60000;
+
+    if (ARG(PROTOCOL)) {
+        int protocol = rebUnboxInteger(
+            "switch", rebQ(unwrap ARG(PROTOCOL)), "[",
+                "'xmodem [", rebI(SERIAL_XMODEM), "]",
+                "'xmodem-1k [", rebI(SERIAL_XMODEM_1K), "]",
+                "'ymodem [", rebI(SERIAL_YMODEM), "]",
+            "] else [-1]"
+        );
+        if (protocol == -1)
+            return "panic -[SERIAL-SEND-XMODEM :PROTOCOL is XMODEM/XMODEM-1K"
+                "/YMODEM]-";
+        params.protocol = cast(SerialXmodemProtocol, protocol);
+    }
+    if (ARG(TIMEOUT)) {
+        params.start_msec = rebUnboxInteger(
+            "to integer! round 1000 *", unwrap ARG(TIMEOUT)
+        );
+        if (params.start_msec <= 0)
+            return "panic -[SERIAL-SEND-XMODEM :TIMEOUT must be positive]-";
+    }
+
+    const Element* at;
+    const Element* tail;
+    if (Is_Block(Element_ARG(FILES)))
+        at = List_At(&tail, Element_ARG(FILES));
+    else {
+        at = Element_ARG(FILES);
+        tail = at + 1;
+    }
+
+    Length count = tail - at;
+    if (count == 0)
+        return "panic -[SERIAL-SEND-XMODEM needs at least one FILE!]-";
+    if (count > 1 and params.protocol != SERIAL_YMODEM)
+        return "panic -[SERIAL-SEND-XMODEM can only send one file by XMODEM]-";
+    for (const Element* item = at; item != tail; ++item) {
+        if (not Is_File(item))
+            return "panic -[SERIAL-SEND-XMODEM BLOCK! must hold FILE!s]-";
+    }
+
+    SerialXmodemFile* files = rebAllocN(SerialXmodemFile, count);
+    for (Length n = 0; n < count; ++n) {
+        char* path = rebSpell("file-to-local:full", &at[n]);
+        const char* name = path;  // without directories
+        for (const char* c = path; *c != '\0'; ++c) {
+            if (*c == '/' or *c == '\\')
+                name = c + 1;
+        }
+        files[n].path = path;
+        files[n].name = name;
+    }
+
+    int64_t total;
+    Option(Error*) e = Trap_Send_Xmodem(
+        &total, unwrap serial, files, count, &params
+    );
+    Resume_Serial_Reading(unwrap serial);
+
+    for (Length n = 0; n < count; ++n)
+        rebFree(m_cast(char*, files[n].path));
+    rebFree(files);
+
+    if (e)
+        panic (unwrap e);
+
+    return rebInteger(total);
+}
+
+
+//
+//  export /serial-available: native [
+//
+//  "Number of received bytes that a READ of the port could return"
+//
+//      return: [integer!]
+//      port [port!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_AVAILABLE)
+//
+// See [H] at top of file.  Bytes the driver has count, as well as those
+// already in the port's receive buffer.
+{
+    INCLUDE_PARAMS_OF_SERIAL_AVAILABLE;
+
+    Option(SerialConnection*) serial = Try_Get_Open_Serial(Element_ARG(PORT));
+    if (not serial)
+        return "panic -[SERIAL-AVAILABLE needs an open serial PORT!]-";
+
+    SerialConnection* device = Serial_Device(unwrap serial);
+
+    Size input;
+    Size output;
+    Option(Error*) e = Trap_Get_Serial_Queues(&input, &output, device);
+    if (e)
+        panic (unwrap e);
+
+    Size buffered = Serial_Ring_Used(&(unwrap serial)->in_ring);
+    if (device != unwrap serial)  // not handed out to the sharing ports yet
+        buffered += Serial_Ring_Used(&device->in_ring);
+
+    return rebInteger(input + buffered);
+}
+
+
+//
+//  export /serial-queued: native [
+//
+//  "Number of written bytes that the port has not transmitted yet"
+//
+//      return: [integer!]
+//      port [port!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_QUEUED)
+//
+// See [H] at top of file.  Counts bytes the driver has as well as the port's
+// own outbound backlog.
+{
+    INCLUDE_PARAMS_OF_SERIAL_QUEUED;
+
+    Option(SerialConnection*) serial = Try_Get_Open_Serial(Element_ARG(PORT));
+    if (not serial)
+        return "panic -[SERIAL-QUEUED needs an open serial PORT!]-";
+
+    SerialConnection* device = Serial_Device(unwrap serial);
+
+    Size input;
+    Size output;
+    Option(Error*) e = Trap_Get_Serial_Queues(&input, &output, device);
+    if (e)
+        panic (unwrap e);
+
+    return rebInteger(output + Serial_Ring_Used(&device->out_ring));
+}
+
+
+//
+//  export /serial-drain: native [
+//
+//  "Wait until all data written to the port has been transmitted"
+//
+//      return: "null if timed out"
+//          [logic?]
+//      port [port!]
+//      :timeout "Seconds to wait (default is to wait indefinitely)"
+//          [integer! decimal!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_DRAIN)
+//
+// See [H] at top of file, and [J] in %serial-posix.c
+{
+    INCLUDE_PARAMS_OF_SERIAL_DRAIN;
+
+    Option(SerialConnection*) serial = Try_Get_Open_Serial(Element_ARG(PORT));
+    if (not serial)
+        return "panic -[SERIAL-DRAIN needs an open serial PORT!]-";
+
+    int32_t timeout_msec = -1;
+    if (ARG(TIMEOUT)) {
+        timeout_msec = rebUnboxInteger(
+            "to integer! round 1000 *", unwrap ARG(TIMEOUT)
+        );
+        if (timeout_msec < 0)
+            return "panic -[SERIAL-DRAIN :TIMEOUT can't be negative]-";
+    }
+
+    bool drained;
+    Option(Error*) e = Trap_Drain_Serial(
+        &drained, Serial_Device(unwrap serial), timeout_msec
+    );
+    if (e)
+        panic (unwrap e);
+
+    return LOGIC_OUT(drained);
+}
+
+
+//
+//  Make_Serial_Device_Object: C
+//
+static Value* Make_Serial_Device_Object(const SerialDevice* device)
+{
+    Value* info = rebValue("make object! [",
+        "path: to file!", rebT(device->path),
+        "driver: vendor-id: product-id: interface:",
+        "serial-number: manufacturer: product: null",
+    "]");
+
+    if (device->driver[0] != '\0')
+        rebElide("poke", info, "'driver", rebT(device->driver));
+    if (device->vendor_id != -1)
+        rebElide("poke", info, "'vendor-id", rebI(device->vendor_id));
+    if (device->product_id != -1)
+        rebElide("poke", info, "'product-id", rebI(device->product_id));
+    if (device->interface != -1)
+        rebElide("poke", info, "'interface", rebI(device->interface));
+    if (device->serial_number[0] != '\0')
+        rebElide("poke", info, "'serial-number", rebT(device->serial_number));
+    if (device->manufacturer[0] != '\0')
+        rebElide("poke", info, "'manufacturer", rebT(device->manufacturer));
+    if (device->product[0] != '\0')
+        rebElide("poke", info, "'product", rebT(device->product));
+
+    return info;
+}
+
+
+//
+//  export /serial-devices: native [
+//
+//  "List the serial devices attached to the system"
+//
+//      return: "Objects with PATH, DRIVER, VENDOR-ID, PRODUCT-ID, INTERFACE,"
+//              "SERIAL-NUMBER, MANUFACTURER and PRODUCT (null if unknown)"
+//          [block!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_DEVICES)
+//
+// See notes in %serial-discovery.c
+{
+    INCLUDE_PARAMS_OF_SERIAL_DEVICES;
+
+    const SerialDevice* devices;
+    Length count;
+    Option(Error*) e = Trap_Get_Serial_Devices(&devices, &count);
+    if (e)
+        panic (unwrap e);
+
+    Value* result = rebValue("copy []");
+    for (Length n = 0; n < count; ++n) {
+        Value* info = Make_Serial_Device_Object(&devices[n]);
+        rebElide("append", result, rebR(info));
+    }
+
+    return result;
+}
+
+
+//
+//  export /serial-find-device: native [
+//
+//  "Find an attached serial device by its USB serial number"
+//
+//      return: "Same fields as SERIAL-DEVICES gives, null if not attached"
+//          [null? object!]
+//      serial-number [text!]
+//      :interface "Which port of a multi-port adapter (default is lowest)"
+//          [integer!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_FIND_DEVICE)
+//
+// Doesn't rescan unless devices were plugged or unplugged since the last
+// time, see [C] and [D] in %serial-discovery.c
+{
+    INCLUDE_PARAMS_OF_SERIAL_FIND_DEVICE;
+
+    char serial_number[SERIAL_DEVICE_TEXT];
+    Size len = rebSpellInto(
+        serial_number, sizeof(serial_number), Element_ARG(SERIAL_NUMBER)
+    );
+    if (len >= sizeof(serial_number))
+        return nullptr;  // longer than any we keep
+
+    int32_t interface = -1;
+    if (ARG(INTERFACE))
+        interface = Int32s(unwrap ARG(INTERFACE), 0);
+
+    const SerialDevice* device;
+    Option(Error*) e = Trap_Find_Serial_Device(
+        &device, serial_number, interface
+    );
+    if (e)
+        panic (unwrap e);
+
+    if (device == nullptr)
+        return nullptr;
+
+    return Make_Serial_Device_Object(device);
+}
+
+
+//
+//  export /serial-open-all: native [
+//
+//  "Open many serial ports at once, setting up their devices concurrently"
+//
+//      return: "The ports, with an ERROR! for each that couldn't be opened"
+//          [block!]
+//      ports "Serial PORT!s that aren't open yet"
+//          [block!]
+//      :workers "How many devices to set up at a time (default 16)"
+//          [integer!]
+//  ]
+//
+DECLARE_NATIVE(SERIAL_OPEN_ALL)
+//
+// A problem with a spec is a panic, as it would be for OPEN, and nothing is
+// opened.  A device that can't be opened only gets an ERROR! in its place.
+// See [L] in %serial-posix.c
+//
+// 1. Ports sharing a device are looked up and opened through a registry that
+//    the worker threads can't touch, see [E] in %serial-share.c.  OPEN them
+//    one at a time instead.
+//
+// 2. The same PORT! twice would have two workers opening one connection at
+//    once, and its settings prepared twice.
+{
+    INCLUDE_PARAMS_OF_SERIAL_OPEN_ALL;
+
+    Element* ports = Element_ARG(PORTS);
+
+    Length max_workers = 16;
+    if (ARG(WORKERS))
+        max_workers = Int32s(unwrap ARG(WORKERS), 1);
+
+    const Element* tail;
+    const Element* head = List_At(&tail, ports);
+    Length count = tail - head;
+    if (count == 0)
+        return rebValue("copy []");
+
+    SerialConnection** serials = rebAllocN(SerialConnection*, count);
+    Value** specs = rebAllocN(Value*, count);
+
+    const char* bad = nullptr;
+    Length n = 0;
+    for (; n < count and not bad; ++n) {
+        if (not rebUnboxLogic(
+            "all [port?", &head[n], "'serial = pick pick", &head[n],
+                "'scheme 'name]"
+        )){
+            bad = "panic -[SERIAL-OPEN-ALL needs BLOCK! of serial PORT!s]-";
+            break;
+        }
+
+        serials[n] = Get_Serial_Connection(&head[n]);
+        specs[n] = rebValue("pick", &head[n], "'spec");
+
+        for (Length i = 0; i < n and not bad; ++i) {  // [2]
+            if (serials[i] == serials[n])
+                bad = "panic -[SERIAL-OPEN-ALL given the same port twice]-";
+        }
+        if (bad)
+            continue;
+
+        if (serials[n]->handle != nullptr)
+            bad = "panic -[SERIAL-OPEN-ALL given a port that's already open]-";
+        else
+            bad = Prep_Serial_Connection(serials[n], specs[n]);
+
+        if (not bad and serials[n]->shared)  // registry is one thread's [1]
+            bad = "panic -[SERIAL-OPEN-ALL can't open `shared: 'yes` ports]-";
+    }
+
+    Value* result = nullptr;
+    if (not bad) {
+        Option(Error*)* errors = rebAllocN(Option(Error*), count);
+        Open_Serials(errors, serials, count, max_workers);
+
+        result = rebValue("copy", ports);
+        for (Length i = 0; i < count; ++i) {
+            if (errors[i]) {
+                DECLARE_ELEMENT (error);
+                Init_Error(error, unwrap errors[i]);
+                rebElide("poke", result, rebI(i + 1), rebQ(error));
+            }
+            else
+                Report_Serial_Latency(specs[i], serials[i]);
+        }
+        rebFree(errors);
+    }
+
+    for (Length i = 0; i < n; ++i)  // n is how many specs were fetched
+        rebRelease(specs[i]);
+    rebFree(specs);
+    rebFree(serials);
+
+    if (bad)
+        return bad;
+
+    return result;
+}
@@ -14,23 +14,677 @@ typedef enum {
     SERIAL_FLOW_CONTROL_SOFTWARE
 } SerialFlowControl;
 
+typedef enum {
+    SERIAL_IO_LOOP,  // descriptor is serviced by the libuv loop
+    SERIAL_IO_THREAD  // a native thread owns the descriptor (POSIX only)
+} SerialIoEngine;
+
+// Received bytes are kept in a fixed-capacity ring owned by the connection,
+// so a long-running port's memory use is capped and the read path does not
+// reallocate.  `head` and `tail` are free-running counts of bytes produced
+// and consumed; masking with (capacity - 1) gives the index, so capacity must
+// be a power of two.
+//
+// Only the producer writes `head` and only the consumer writes `tail`, with
+// release stores paired to acquire loads.  So a ring is safe to share between
+// exactly one producer thread and one consumer thread (see the POSIX I/O
+// thread), without locks.  On x86 these compile to plain moves.
+//
+#define SERIAL_RING_DEFAULT_CAPACITY  65536
+#define SERIAL_RING_MAX_CAPACITY  16777216  // receive ring sized for batching
+
+typedef struct {
+    Byte* buf;
+    Size capacity;
+    Size head;  // bytes ever written into the ring
+    Size tail;  // bytes ever consumed from the ring
+} SerialRing;
+
+// With `timestamps: 'yes` in the spec, each read() that adds to the receive
+// ring also records where its bytes start in the ring and when it returned,
+// in a ring of its own.  It's filled and drained by the same threads as the
+// receive ring, with the same discipline.
+//
+#define SERIAL_STAMP_CAPACITY  4096  // must be power of two
+
+typedef struct {
+    Size position;  // the receive ring's head before the read's bytes
+    int64_t usec;  // Serial_Usec() when the read() returned
+} SerialStamp;
+
+typedef struct {
+    SerialStamp* buf;  // nullptr if the port isn't timestamping
+    Size head;
+    Size tail;
+} SerialStampRing;
+
+// WRITE hands the device a list of chunks (e.g. a BLOCK! of BLOB!s) so they
+// can be gathered into a single writev() instead of a syscall apiece.
+//
+typedef struct {
+    const Byte* data;
+    Size length;
+} SerialChunk;
+
+// READ can split the received bytes into frames in C instead of returning
+// them raw.  Frames are found in place in the receive ring, so a partial frame
+// just stays there until the rest of it arrives.  SLIP and COBS frames end in
+// a delimiter byte too, and are decoded as they are taken out of the ring.
+//
+typedef enum {
+    SERIAL_FRAMING_NONE,
+    SERIAL_FRAMING_DELIMITER,  // ends with a byte sequence (not returned)
+    SERIAL_FRAMING_FIXED,  // every frame is the same size
+    SERIAL_FRAMING_LENGTH_PREFIX,  // header holds length of what follows
+    SERIAL_FRAMING_SLIP,  // RFC 1055
+    SERIAL_FRAMING_COBS  // Consistent Overhead Byte Stuffing, 0 terminated
+} SerialFraming;
+
+#define SERIAL_MAX_DELIMITER  8
+
+typedef struct {
+    SerialFraming kind;
+
+    Byte delimiter[SERIAL_MAX_DELIMITER];  // also set for SLIP and COBS
+    Size delimiter_len;
+
+    Size fixed_size;
+
+    Size prefix_offset;  // where the length field starts in the frame
+    uint8_t prefix_width;  // 1, 2 or 4 bytes
+    bool prefix_big_endian;
+    int32_t prefix_adjust;  // frame size is offset + width + length + adjust
+
+    Size scanned;  // bytes at the ring's tail known not to start a delimiter
+    bool discarding;  // ring filled without a boundary, drop up to the next
+} SerialFramer;
+
+// Per-port counters, reported by QUERY.  They are cheap enough to be always
+// on: each has a single writer (the I/O thread for the syscall counts in
+// `io-engine: 'thread`, else the interpreter), so they are bumped with plain
+// relaxed stores and no locks.  See Serial_Stat_Add().
+//
+typedef struct {
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t reads;  // read syscalls
+    uint64_t writes;  // write syscalls
+    uint64_t would_block;  // reads finding nothing, writes getting EAGAIN
+    uint64_t max_backlog;  // most bytes ever waiting in the outbound ring
+    uint64_t blocked_usec;  // time READ/WRITE spent waiting on the device
+    uint64_t dropped;  // shared device bytes this port's full ring missed
+} SerialStats;
+
+// Counts the driver keeps of line errors (Linux TIOCGICOUNT), for spotting
+// a link that is dropping bytes.  Not all drivers have them (ptys don't).
+//
+typedef struct {
+    uint32_t frame;
+    uint32_t overrun;  // UART's receive FIFO overflowed
+    uint32_t parity;
+    uint32_t brk;
+    uint32_t buf_overrun;  // tty layer's buffer overflowed
+} SerialLineErrors;
+
+// With `rs485:` in the spec, the driver switches an RS-485 transceiver
+// between sending and receiving by raising RTS around each transmission
+// (Linux TIOCSRS485, or the DCB's RTS toggle on Windows), so the bus is
+// turned around with no round trip through user space.
+//
+typedef struct {
+    bool enabled;
+    bool rts_high_on_send;  // else RTS is low while sending, high after
+    bool receive_during_send;  // receiver stays on, hearing our own bytes
+    int32_t delay_before_usec;  // RTS changed this long before sending...
+    int32_t delay_after_usec;  // ...and changed back this long after
+} SerialRs485;
+
+typedef struct SerialShareStruct SerialShare;
+
+// A connection can record everything it receives and transmits, with when it
+// happened, into a memory-mapped file that rotates when full.  SERIAL-REPLAY
+// plays the received side of such a file back on a pseudo-terminal.  POSIX
+// only, see %serial-capture.c
+//
+#define SERIAL_CAPTURE_DEFAULT_SIZE  16777216
+#define SERIAL_CAPTURE_MIN_SIZE  4096
+
+typedef enum {
+    SERIAL_CAPTURE_RECEIVED = 1,
+    SERIAL_CAPTURE_TRANSMITTED = 2
+} SerialCaptureDirection;
+
+typedef struct SerialCaptureStruct SerialCapture;
+
 typedef struct {
     void* handle;  // TtyFileDescriptor on Linux, HANDLE on Windows
     Api(Stable*) path;  // device path string (in OS local format)
     void* prior_attr;  // termios: retain prev settings to revert on close
     SerialBaudRate baud_rate;
+    SerialBaudRate max_baud_rate;  // reported by device on open, 0 if unknown
     uint8_t data_bits;  // 5, 6, 7 or 8
     SerialParity parity;
     uint8_t stop_bits;  // 1 or 2
     SerialFlowControl flow_control;
+    int32_t timeout_msec;  // -1 to use the event loop, else blocking mode
+    SerialIoEngine io_engine;
+    bool low_latency;  // minimize driver/adapter input batching
 
-    Byte* data;
-    Size length;
-    Size actual;
+    bool low_latency_applied;  // driver has ASYNC_LOW_LATENCY in effect
+    int latency_timer_msec;  // USB adapter input batching, -1 if unknown
+    int prior_latency_timer_msec;  // to put back on close, -1 if untouched
+    bool set_low_latency;  // we turned ASYNC_LOW_LATENCY on, clear on close
+
+    SerialRs485 rs485;
+    bool set_rs485;  // we turned the driver's RS-485 mode on, off on close
+
+    void* poll;  // uv_poll_t on POSIX, registered with the libuv loop
+    int awaiting;  // libuv UV_READABLE and/or UV_WRITABLE still outstanding
+    int pending_errno;  // error seen by a loop callback, reported by waiter
+    void* thread;  // SerialThread in SERIAL_IO_THREAD mode
+
+    uintptr_t wait_tick;  // which Trap_Wait_Serials() call marked this
+    int wait_index;  // position in that call's list of connections
+    bool wait_disarmed;  // multiplexer stopped watching (receive ring full)
+
+    SerialRing in_ring;  // receive buffer, filled by Trap_Read_Serial()
+    SerialFramer framer;  // how READ splits in_ring into frames, if at all
+    SerialRing out_ring;  // bytes WRITE accepted that the driver didn't take
+
+    const SerialChunk* chunks;  // WRITE sources, in order
+    int num_chunks;
+    Size actual;  // bytes accepted by last WRITE, or added to in_ring by READ
+
+    SerialStats stats;
+
+    bool shared;  // open through the registry in %serial-share.c
+    SerialShare* share;  // device this port subscribes to, when open+shared
+    Size share_seen;  // in_ring head as of the last READ, when shared
+
+    Api(Stable*) capture_path;  // local file to record traffic in, if any
+    Size capture_size;  // bytes per file before it rotates
+    SerialCapture* capture;  // recording, while open
+
+    Size read_size;  // READ batches until this much, if not 0...
+    int32_t read_idle_usec;  // ...or the line is idle this long, if not 0...
+    int32_t read_latency_usec;  // ...or this long after the first byte
+
+    SerialStampRing stamps;  // when each read() returned, if timestamping
+    int32_t gap_usec;  // stamped chunks split at this much silence, or 0
 } SerialConnection;
 
-extern SerialBaudRate Get_Serial_Max_Baud_Rate(void);
+// One device opened on behalf of every port with `shared: 'yes` for it.  The
+// device's own connection is never a port's; each port subscribes, gets its
+// own copy of what's received, and writes through the device's connection.
+//
+#define MAX_SERIAL_SHARE_KEY 256
+
+struct SerialShareStruct {
+    SerialShare* next;  // in the registry
+    char key[MAX_SERIAL_SHARE_KEY];  // resolved device path
+    SerialConnection device;
+    SerialConnection** subscribers;
+    Length num_subscribers;
+    Length subscribers_capacity;
+};
+
+INLINE SerialConnection* Serial_Device(SerialConnection* serial)
+  { return serial->share ? &serial->share->device : serial; }
+
 extern Option(Error*) Trap_Read_Serial(SerialConnection* serial);
+extern void Resume_Serial_Reading(SerialConnection* serial);
 extern Option(Error*) Trap_Open_Serial(SerialConnection* serial);
 extern Option(Error*) Trap_Write_Serial(SerialConnection* serial);
 extern Option(Error*) Trap_Close_Serial(SerialConnection* serial);
+extern Option(Error*) Trap_Modify_Serial(SerialConnection* serial);
+extern bool Get_Serial_Share_Key(
+    char* key,
+    Size size,
+    SerialConnection* serial
+);
+extern Option(Error*) Trap_Open_Shared_Serial(SerialConnection* serial);
+extern Option(Error*) Trap_Close_Shared_Serial(SerialConnection* serial);
+extern void Abandon_Shared_Serial(SerialConnection* serial);
+extern Option(Error*) Trap_Read_Shared_Serial(SerialConnection* serial);
+extern Option(Error*) Trap_Write_Shared_Serial(SerialConnection* serial);
+extern void Fan_Out_Serial_Share(SerialShare* share);
+
+extern void Open_Serials(
+    Option(Error*)* errors,
+    SerialConnection** serials,
+    Length count,
+    Length max_workers
+);
+extern void Abandon_Serial(SerialConnection* serial);
+extern Option(Error*) Trap_Get_Serial_Queues(
+    Sink(Size) input,
+    Sink(Size) output,
+    SerialConnection* serial
+);
+extern Option(Error*) Trap_Drain_Serial(
+    Sink(bool) drained,
+    SerialConnection* serial,
+    int32_t timeout_msec
+);
+extern bool Get_Serial_Line_Errors(
+    SerialLineErrors* errors,
+    SerialConnection* serial
+);
+extern Option(Error*) Trap_Wait_Serials(
+    int* num_ready,
+    int ready[],
+    SerialConnection* serials[],
+    int count,
+    int32_t timeout_msec
+);
+
+// SERIAL-BENCHMARK drives a connection over a pseudo-terminal pair whose far
+// end echoes everything back, so the I/O path can be measured (and watched
+// for regressions) without serial hardware.
+//
+typedef struct {
+    SerialIoEngine io_engine;
+    int32_t timeout_msec;  // >= 0 to measure blocking mode
+    Size chunk_size;  // bytes per Trap_Write_Serial()
+    Size total_bytes;  // for the throughput run
+    int round_trips;  // for the latency run
+} SerialBenchParams;
+
+typedef struct {
+    double bytes_per_sec;  // echoed payload over the throughput run
+    double syscalls_per_kb;  // read and write calls, negative if unknown
+    double latency_usec[3];  // round trip p50, p99 and p99.9
+} SerialBenchResults;
+
+extern Option(Error*) Trap_Run_Serial_Benchmark(
+    SerialBenchResults* results,
+    const SerialBenchParams* params
+);
+
+// WRITE of a FILE! sends it in parts of about a quarter second of line time,
+// within these bounds.  See [N] in %serial-posix.c
+//
+#define SERIAL_FILE_PART_MIN  256
+#define SERIAL_FILE_PART_MAX  65536
+
+extern Option(Error*) Trap_Send_Serial_File(
+    Sink(Size) sent,
+    Sink(int64_t) file_size,
+    SerialConnection* serial,
+    const char* file_path,
+    int64_t offset,
+    Size limit
+);
+
+// READ-SIZE, READ-IDLE and READ-LATENCY in the spec batch up what READ gives
+// back, see %serial-coalesce.c
+//
+extern Size Coalesced_Ring_Capacity(const SerialConnection* serial);
+extern Option(Error*) Trap_Read_Serial_Coalesced(SerialConnection* serial);
+
+extern Option(Error*) Trap_Read_Serial_Within(
+    SerialConnection* serial,
+    int32_t timeout_usec
+);
+
+// SERIAL-CHECKSUM and the protocol code share these, which can be continued
+// from the checksum of the data before.  See %serial-checksum.c
+//
+typedef enum {
+    SERIAL_CHECKSUM_CRC32,  // IEEE, as in zlib and Ethernet
+    SERIAL_CHECKSUM_CRC32C,  // Castagnoli
+    SERIAL_CHECKSUM_CRC16_MODBUS,
+    SERIAL_CHECKSUM_CRC16_CCITT,  // "CCITT-FALSE", starts at 0xFFFF
+    SERIAL_CHECKSUM_CRC16_XMODEM,  // same polynomial, starts at 0
+    SERIAL_CHECKSUM_LRC,  // two's complement of the byte sum
+    SERIAL_CHECKSUM_XOR
+} SerialChecksum;
+
+extern uint32_t Empty_Serial_Checksum(SerialChecksum method);
+extern uint32_t Continue_Serial_Checksum(
+    SerialChecksum method,
+    uint32_t prior,
+    const Byte* data,
+    Size size
+);
+
+// SERIAL-MODBUS runs Modbus RTU master transactions back to back in C.  Each
+// request is a unit ID and a PDU (function code, then data), and is answered
+// with the response's PDU or an error.  See %serial-modbus.c
+//
+#define SERIAL_MODBUS_MAX_ADU  256
+#define SERIAL_MODBUS_MAX_PDU  253  // ADU less unit ID and CRC
+
+typedef struct {
+    uint8_t unit;  // 0 is a broadcast, which gets no response
+    const Byte* pdu;
+    Size pdu_size;
+
+    Byte response[SERIAL_MODBUS_MAX_PDU];  // function code first
+    Size response_size;
+    Option(Error*) error;  // timeout, CRC failure...
+} SerialModbusTransaction;
+
+typedef struct {
+    int32_t timeout_usec;  // for a response, from when the request is sent
+    int32_t turnaround_usec;  // to let slaves act on a broadcast
+} SerialModbusParams;
+
+extern Option(Error*) Trap_Run_Modbus_Transactions(
+    SerialConnection* serial,
+    SerialModbusTransaction* txns,
+    Length count,
+    const SerialModbusParams* params
+);
+
+// SERIAL-TRANSACT writes a request and collects the reply in C, until any of
+// the rules given is met.  See %serial-transact.c
+//
+typedef struct {
+    const Byte* request;
+    Size request_size;
+
+    const Byte* terminator;  // reply ends with this, if terminator_size != 0
+    Size terminator_size;
+    Size length;  // reply is this long, if not 0
+    int32_t idle_usec;  // reply ends when the line goes quiet, if not 0
+    int32_t timeout_usec;  // for the whole reply, from when it's written
+} SerialTransaction;
+
+extern Option(Error*) Trap_Write_Serial_Request(
+    SerialConnection* serial,
+    const Byte* data,
+    Size size,
+    int64_t deadline_usec  // Serial_Usec()
+);
+extern Option(Error*) Trap_Transact_Serial(
+    Sink(Size) reply_size,
+    SerialConnection* serial,
+    const SerialTransaction* txn
+);
+
+// SERIAL-BUS runs a transaction with each of many devices on one bus, back
+// to back, sending each request as soon as the reply before it is complete
+// and the bus has been given time to turn around.  See %serial-bus.c
+//
+typedef struct {
+    const Byte* request;  // addressed to its device in the protocol's way
+    Size request_size;
+
+    Byte* reply;  // rebAllocN()'d, or nullptr if it wasn't complete in time
+    Size reply_size;
+} SerialBusExchange;
+
+typedef struct {
+    SerialTransaction rules;  // the reply rules, request fields unused
+    int32_t turnaround_usec;  // after a reply, before the next request
+} SerialBusParams;
+
+extern Option(Error*) Trap_Run_Serial_Bus(
+    SerialConnection* serial,
+    SerialBusExchange* exchanges,
+    Length count,
+    const SerialBusParams* params
+);
+
+// SERIAL-SEND-XMODEM sends files by the XMODEM family of protocols, the
+// receiver choosing checksum or CRC, and YMODEM-G.  See %serial-xmodem.c
+//
+typedef enum {
+    SERIAL_XMODEM,  // 128-byte blocks
+    SERIAL_XMODEM_1K,  // 1024-byte blocks, if the receiver asks for CRC
+    SERIAL_YMODEM  // XMODEM-1K with file names and sizes, batches of files
+} SerialXmodemProtocol;
+
+typedef struct {
+    const char* path;  // local file to send
+    const char* name;  // for the receiver, YMODEM only
+} SerialXmodemFile;
+
+typedef struct {
+    SerialXmodemProtocol protocol;
+    int32_t start_msec;  // for the receiver to ask for each file
+} SerialXmodemParams;
+
+extern Option(Error*) Trap_Send_Xmodem(
+    Sink(int64_t) total,
+    SerialConnection* serial,
+    const SerialXmodemFile* files,
+    Length count,
+    const SerialXmodemParams* params
+);
+
+extern Option(Error*) Trap_Open_Serial_Capture(SerialConnection* serial);
+extern void Capture_Serial_Bytes(
+    SerialCapture* capture,
+    SerialCaptureDirection direction,
+    const Byte* data,
+    Size size
+);
+extern int Close_Serial_Capture(SerialConnection* serial);
+extern Option(Error*) Trap_Start_Serial_Replay(
+    char* pty_path,
+    Size pty_path_size,
+    const char* capture_path,
+    double speed
+);
+
+extern Size Measure_Serial_Stamped_Chunk(
+    Sink(int64_t) usec,
+    Sink(int32_t) settle_usec,
+    SerialConnection* serial
+);
+
+extern Option(Error*) Trap_Find_Serial_Frame(
+    Sink(Size) raw_size,
+    SerialFramer* framer,
+    SerialRing* ring
+);
+extern bool Take_Serial_Frame(
+    Sink(Size) size,
+    Byte* dest,
+    SerialFramer* framer,
+    SerialRing* ring,
+    Size raw_size
+);
+
+// What discovery knows about a serial device.  The USB fields are -1 or empty
+// for devices that aren't on USB (or whose adapter doesn't report them).
+//
+#define SERIAL_DEVICE_TEXT  64
+
+typedef struct {
+    char path[SERIAL_DEVICE_TEXT];  // e.g. "/dev/ttyUSB0" or "COM3"
+    char driver[SERIAL_DEVICE_TEXT];
+    int32_t vendor_id;
+    int32_t product_id;
+    int32_t interface;  // which port of a multi-port adapter
+    char serial_number[SERIAL_DEVICE_TEXT];
+    char manufacturer[SERIAL_DEVICE_TEXT];
+    char product[SERIAL_DEVICE_TEXT];
+} SerialDevice;
+
+extern Option(Error*) Trap_Get_Serial_Devices(
+    Sink(const SerialDevice*) devices,
+    Sink(Length) count
+);
+extern Option(Error*) Trap_Find_Serial_Device(
+    Sink(const SerialDevice*) device,
+    const char* serial_number,
+    int32_t interface
+);
+
+
+//=//// LINE TIMING ///////////////////////////////////////////////////////=//
+//
+// Protocol timing (reply deadlines, Modbus silences, READ batching, the
+// timestamps) is in microseconds of one monotonic clock, see [B] in the file
+// %serial-stamps.c, and derived from the port's character time.
+//
+
+extern int64_t Serial_Usec(void);
+
+// Bits on the line per character: start, data, parity and stop bits.
+//
+INLINE int Serial_Char_Bits(const SerialConnection* serial) {
+    return 1 + serial->data_bits + serial->stop_bits
+        + (serial->parity == SERIAL_PARITY_NONE ? 0 : 1);
+}
+
+// Line time of one character, rounded up so that waits derived from it are
+// never short.
+//
+INLINE int64_t Serial_Char_Usec(const SerialConnection* serial) {
+    int64_t bits = Serial_Char_Bits(serial);
+    return (bits * 1000000 + serial->baud_rate - 1) / serial->baud_rate;
+}
+
+
+//=//// SERIAL RING ///////////////////////////////////////////////////////=//
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define Serial_Ring_Load(var) \
+        __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+    #define Serial_Ring_Store(var,value) \
+        __atomic_store_n(&(var), (value), __ATOMIC_RELEASE)
+    #define Serial_Stat_Load(var) \
+        __atomic_load_n(&(var), __ATOMIC_RELAXED)
+    #define Serial_Stat_Add(var,n) \
+        __atomic_store_n(&(var), (var) + (n), __ATOMIC_RELAXED)
+#else  // rings are not shared across threads on these platforms
+    #define Serial_Ring_Load(var)  (var)
+    #define Serial_Ring_Store(var,value)  ((var) = (value))
+    #define Serial_Stat_Load(var)  (var)
+    #define Serial_Stat_Add(var,n)  ((var) += (n))
+#endif
+
+INLINE void Serial_Stat_Max(uint64_t* stat, uint64_t value) {
+    if (value > *stat)
+        Serial_Stat_Add(*stat, value - *stat);
+}
+
+INLINE Size Serial_Ring_Used(const SerialRing* ring) {
+    return Serial_Ring_Load(ring->head) - Serial_Ring_Load(ring->tail);
+}
+
+INLINE Size Serial_Ring_Free(const SerialRing* ring)
+  { return ring->capacity - Serial_Ring_Used(ring); }
+
+// The free space as (up to) two contiguous segments, the second one wrapping
+// around to the start of the buffer.  Suitable for feeding readv().
+//
+INLINE void Serial_Ring_Free_Segments(
+    const SerialRing* ring,
+    Byte* seg[2],
+    Size len[2]
+){
+    Size at = ring->head & (ring->capacity - 1);
+    Size free = Serial_Ring_Free(ring);
+    Size first = ring->capacity - at;
+    if (first > free)
+        first = free;
+
+    seg[0] = ring->buf + at;
+    len[0] = first;
+    seg[1] = ring->buf;
+    len[1] = free - first;
+}
+
+// The buffered bytes as (up to) two contiguous segments, oldest first.
+//
+INLINE void Serial_Ring_Used_Segments(
+    const SerialRing* ring,
+    const Byte* seg[2],
+    Size len[2]
+){
+    Size at = ring->tail & (ring->capacity - 1);
+    Size used = Serial_Ring_Used(ring);
+    Size first = ring->capacity - at;
+    if (first > used)
+        first = used;
+
+    seg[0] = ring->buf + at;
+    len[0] = first;
+    seg[1] = ring->buf;
+    len[1] = used - first;
+}
+
+INLINE void Serial_Ring_Commit(SerialRing* ring, Size n) {
+    assert(n <= Serial_Ring_Free(ring));
+    Serial_Ring_Store(ring->head, ring->head + n);
+}
+
+INLINE void Serial_Ring_Discard(SerialRing* ring, Size n) {
+    assert(n <= Serial_Ring_Used(ring));
+    Serial_Ring_Store(ring->tail, ring->tail + n);
+}
+
+// The byte `offset` bytes after the oldest one, which must be in the ring.
+//
+INLINE Byte Serial_Ring_Peek(const SerialRing* ring, Size offset) {
+    return ring->buf[(ring->tail + offset) & (ring->capacity - 1)];
+}
+
+// Copy `n` bytes into the ring, which must have room for them.
+//
+INLINE void Serial_Ring_Produce(SerialRing* ring, const Byte* src, Size n) {
+    assert(n <= Serial_Ring_Free(ring));
+
+    Size at = ring->head & (ring->capacity - 1);
+    Size first = ring->capacity - at;
+    if (first > n)
+        first = n;
+
+    memcpy(ring->buf + at, src, first);
+    memcpy(ring->buf, src + first, n - first);
+    Serial_Ring_Store(ring->head, ring->head + n);
+}
+
+// Copy up to `limit` of the oldest bytes out of the ring and release them.
+//
+INLINE Size Serial_Ring_Consume(SerialRing* ring, Byte* dest, Size limit) {
+    Size n = Serial_Ring_Used(ring);
+    if (n > limit)
+        n = limit;
+
+    Size at = ring->tail & (ring->capacity - 1);
+    Size first = ring->capacity - at;
+    if (first > n)
+        first = n;
+
+    memcpy(dest, ring->buf + at, first);
+    memcpy(dest + first, ring->buf, n - first);
+    Serial_Ring_Store(ring->tail, ring->tail + n);
+    return n;
+}
+
+// `mark` is the head as of the last read, whose caller was told about the
+// bytes before it.  Bytes after it that have since been consumed anyway were
+// seen too, so if there are any the mark moves up to the oldest byte left.
+//
+INLINE Size Serial_Ring_Read_Mark(const SerialRing* ring, Size mark) {
+    Size head = Serial_Ring_Load(ring->head);
+    if (head - mark > head - ring->tail)
+        return ring->tail;
+    return mark;
+}
+
+// Record that the bytes about to be committed at `position` in the receive
+// ring arrived at `usec`.  Must come before the commit, so the consumer never
+// sees bytes without their stamp.  If the stamp ring is full, the bytes are
+// taken as part of the read before them.
+//
+INLINE void Push_Serial_Stamp(
+    SerialStampRing* stamps,
+    Size position,
+    int64_t usec
+){
+    Size head = stamps->head;
+    if (head - Serial_Ring_Load(stamps->tail) == SERIAL_STAMP_CAPACITY)
+        return;
+
+    SerialStamp* stamp = &stamps->buf[head & (SERIAL_STAMP_CAPACITY - 1)];
+    stamp->position = position;
+    stamp->usec = usec;
+    Serial_Ring_Store(stamps->head, head + 1);
+}
@@ -0,0 +1,362 @@
+//
+//  file: %serial-benchmark.c
+//  summary: "Serial throughput and latency measurement over a pty pair"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. The connection is opened on the slave side of an openpty() pair through
+//    the ordinary Trap_Open_Serial(), so every engine can be measured.  A
+//    forked child copies whatever arrives on the master side straight back.
+//    Using a process instead of a thread keeps the echo's own syscalls out
+//    of the counts, and lets it exit by itself: its read() of the master
+//    fails with EIO once the connection closes the last slave descriptor.
+//
+// B. The throughput run keeps at most a window of bytes in flight, since
+//    Trap_Write_Serial() doesn't read: with more outstanding, the echo could
+//    fill the pty's return buffer and block, and then so would the writer.
+//
+// C. Syscalls are counted with the process-wide syscr/syscw totals from
+//    /proc/self/io, which include the I/O thread of `io-engine: 'thread`
+//    but not poll() or epoll_wait().  There's no equivalent elsewhere.
+//
+// D. A pty has no baud rate, so this measures the extension and the kernel's
+//    tty layer, not a line.  Results are comparable between runs on the same
+//    machine, which is what catching regressions needs.
+//
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/wait.h>
+#if defined(__APPLE__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    #include <util.h>
+#elif defined(__FreeBSD__)
+    #include <libutil.h>
+#else
+    #include <pty.h>
+#endif
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+#define SERIAL_BENCH_WINDOW  2048  // bytes in flight, see [B]
+#define SERIAL_BENCH_RING_CAPACITY  65536
+
+
+//
+//  Bench_Usec: C
+//
+static int64_t Bench_Usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return cast(int64_t, ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+//
+//  Read_Proc_Syscalls: C
+//
+// See [C] at top of file.  Returns -1 if not available.
+//
+static int64_t Read_Proc_Syscalls(void)
+{
+  #if defined(__linux__)
+    FILE* f = fopen("/proc/self/io", "r");
+    if (not f)
+        return -1;
+
+    int64_t total = 0;
+    int found = 0;
+    char line[128];
+    long long n;
+    while (fgets(line, sizeof(line), f)) {
+        if (
+            sscanf(line, "syscr: %lld", &n) == 1
+            or sscanf(line, "syscw: %lld", &n) == 1
+        ){
+            total += n;
+            ++found;
+        }
+    }
+    fclose(f);
+    return found == 2 ? total : -1;
+  #else
+    return -1;
+  #endif
+}
+
+
+//
+//  Run_Echo: C
+//
+// Body of the forked child, see [A].  Only async-signal-safe calls.
+//
+static void Run_Echo(int master)
+{
+    Byte buf[4096];
+    while (true) {
+        ssize_t n = read(master, buf, sizeof(buf));
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n <= 0)
+            _exit(0);  // EIO: the connection closed the slave
+
+        for (ssize_t sent = 0; sent < n; ) {
+            ssize_t w = write(master, buf + sent, n - sent);
+            if (w < 0 and errno == EINTR)
+                continue;
+            if (w < 0)
+                _exit(1);
+            sent += w;
+        }
+    }
+}
+
+
+//
+//  Trap_Send_Bench_Chunk: C
+//
+static Option(Error*) Trap_Send_Bench_Chunk(
+    SerialConnection* serial,
+    const Byte* data,
+    Size size
+){
+    SerialChunk chunk;
+    chunk.data = data;
+    chunk.length = size;
+    serial->chunks = &chunk;
+    serial->num_chunks = 1;
+
+    Option(Error*) e = Trap_Write_Serial(serial);
+
+    serial->chunks = nullptr;
+    serial->num_chunks = 0;
+    return e;
+}
+
+
+//
+//  Trap_Receive_Bench_Bytes: C
+//
+// Adds what the next Trap_Read_Serial() gets to *received, and throws it away.
+//
+static Option(Error*) Trap_Receive_Bench_Bytes(
+    Size* received,
+    SerialConnection* serial
+){
+    Option(Error*) e = Trap_Read_Serial(serial);
+    if (e)
+        return e;
+
+    Size used = Serial_Ring_Used(&serial->in_ring);
+    if (used == 0)  // only possible in blocking mode
+        return Error_User("Serial benchmark echo timed out");
+
+    Serial_Ring_Discard(&serial->in_ring, used);
+    *received += used;
+    return SUCCESS;
+}
+
+
+static int Compare_Int64(const void* a, const void* b)
+{
+    int64_t x = *cast(const int64_t*, a);
+    int64_t y = *cast(const int64_t*, b);
+    return (x > y) - (x < y);
+}
+
+
+//
+//  Trap_Bench_Connection: C
+//
+static Option(Error*) Trap_Bench_Connection(
+    SerialBenchResults* results,
+    SerialConnection* serial,
+    const SerialBenchParams* params,
+    const Byte* pattern
+){
+    Option(Error*) e;
+
+  //=//// THROUGHPUT ////////////////////////////////////////////////////=//
+
+    Size window = params->chunk_size;  // see [B]
+    if (window < SERIAL_BENCH_WINDOW)
+        window = SERIAL_BENCH_WINDOW;
+
+    int64_t syscalls_before = Read_Proc_Syscalls();
+    int64_t start = Bench_Usec();
+
+    Size sent = 0;
+    Size received = 0;
+    while (received < params->total_bytes) {
+        Size size = params->total_bytes - sent;
+        if (size > params->chunk_size)
+            size = params->chunk_size;
+
+        if (size != 0 and (sent - received) + size <= window) {
+            if ((e = Trap_Send_Bench_Chunk(serial, pattern, size)))
+                return e;
+            sent += size;
+            continue;
+        }
+
+        if ((e = Trap_Receive_Bench_Bytes(&received, serial)))
+            return e;
+    }
+
+    int64_t elapsed = Bench_Usec() - start;
+    int64_t syscalls_after = Read_Proc_Syscalls();
+
+    results->bytes_per_sec = (elapsed == 0)
+        ? 0.0
+        : cast(double, params->total_bytes) * 1000000.0 / elapsed;
+
+    if (syscalls_before < 0 or syscalls_after < 0)
+        results->syscalls_per_kb = -1.0;
+    else
+        results->syscalls_per_kb = 1024.0
+            * cast(double, syscalls_after - syscalls_before)
+            / params->total_bytes;
+
+  //=//// LATENCY ///////////////////////////////////////////////////////=//
+
+    Size size = params->chunk_size;
+    if (size > SERIAL_BENCH_WINDOW)
+        size = SERIAL_BENCH_WINDOW;
+
+    int64_t* samples = rebAllocN(int64_t, params->round_trips);
+
+    for (int i = 0; i < params->round_trips; ++i) {
+        int64_t t0 = Bench_Usec();
+
+        e = Trap_Send_Bench_Chunk(serial, pattern, size);
+        Size got = 0;
+        while (not e and got < size)
+            e = Trap_Receive_Bench_Bytes(&got, serial);
+        if (e) {
+            rebFree(samples);
+            return e;
+        }
+
+        samples[i] = Bench_Usec() - t0;
+    }
+
+    qsort(samples, params->round_trips, sizeof(int64_t), &Compare_Int64);
+
+    const double percentiles[3] = { 0.50, 0.99, 0.999 };
+    for (int p = 0; p < 3; ++p) {
+        int index = cast(int, percentiles[p] * params->round_trips + 0.999999);
+        if (index < 1)
+            index = 1;
+        results->latency_usec[p] = samples[index - 1];
+    }
+
+    rebFree(samples);
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Run_Serial_Benchmark: C
+//
+// See notes at top of file.
+//
+Option(Error*) Trap_Run_Serial_Benchmark(
+    SerialBenchResults* results,
+    const SerialBenchParams* params
+){
+    assert(params->chunk_size > 0 and params->round_trips > 0);
+
+    int master;
+    int slave;
+    char name[128];
+    if (openpty(&master, &slave, name, nullptr, nullptr) == -1)
+        return Error_OS(errno);
+
+    struct termios attr;  // master side must pass bytes through untouched
+    if (tcgetattr(master, &attr) == 0) {
+        cfmakeraw(&attr);
+        tcsetattr(master, TCSANOW, &attr);
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        int errsave = errno;
+        close(master);
+        close(slave);
+        return Error_OS(errsave);
+    }
+    if (pid == 0) {
+        close(slave);  // else our copy keeps the pty from hanging up [A]
+        Run_Echo(master);
+    }
+    close(master);
+
+    SerialConnection serial;
+    memset(&serial, 0, sizeof(serial));
+    serial.path = rebStable("as file!", rebT(name));
+    serial.baud_rate = 115200;  // ignored by a pty, see [D]
+    serial.data_bits = 8;
+    serial.stop_bits = 1;
+    serial.parity = SERIAL_PARITY_NONE;
+    serial.flow_control = SERIAL_FLOW_CONTROL_NONE;
+    serial.timeout_msec = params->timeout_msec;
+    serial.io_engine = params->io_engine;
+
+    serial.in_ring.capacity = SERIAL_BENCH_RING_CAPACITY;
+    serial.in_ring.buf = rebAllocN(Byte, SERIAL_BENCH_RING_CAPACITY);
+    serial.out_ring.capacity = SERIAL_BENCH_RING_CAPACITY;
+    serial.out_ring.buf = rebAllocN(Byte, SERIAL_BENCH_RING_CAPACITY);
+
+    Byte* pattern = rebAllocN(Byte, params->chunk_size);
+    for (Size n = 0; n < params->chunk_size; ++n)
+        pattern[n] = cast(Byte, n * 131 + 7);
+
+    Option(Error*) e = Trap_Open_Serial(&serial);
+    close(slave);  // connection has its own descriptor now
+
+    if (not e) {
+        e = Trap_Bench_Connection(results, &serial, params, pattern);
+        if (e)
+            Abandon_Serial(&serial);
+        else
+            e = Trap_Close_Serial(&serial);
+    }
+
+    if (e)
+        kill(pid, SIGTERM);  // echo may not have seen the hangup yet
+    int status;
+    while (waitpid(pid, &status, 0) == -1 and errno == EINTR)
+        continue;
+
+    rebFree(pattern);
+    rebFree(serial.in_ring.buf);
+    rebFree(serial.out_ring.buf);
+    rebRelease(serial.path);
+
+    return e;
+}
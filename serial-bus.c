@@ -0,0 +1,159 @@
+//
+//  file: %serial-bus.c
+//  summary: "Transactions with many devices on one bus, back to back"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. On a multi-drop bus (typically RS-485) one master polls many devices,
+//    and only one may talk at a time.  Polling from script means a trip
+//    through the interpreter between each reply and the next request, and
+//    the bus sits idle for it.  Here the whole round is one call: each
+//    request goes out as soon as the reply before it is complete, by the
+//    rules of %serial-transact.c, and the turnaround has passed.
+//
+// B. The turnaround is the time a device needs after its reply to turn its
+//    transceiver back to receiving, before the master may drive the bus.
+//    It's counted from when the reply's last byte came in.  Bytes arriving
+//    during it can't be a reply to anything, and are dropped.
+//
+// C. A device that doesn't reply in time may still be in the middle of its
+//    reply, or may answer late.  So before the next request the line has to
+//    be quiet for the turnaround, or four character times if that's longer,
+//    lest the stray bytes be taken for the next device's reply.  Waiting for
+//    that gives up at the timeout, as a device that never stops isn't going
+//    to be talked over anyway.
+//
+// D. The requests are addressed to their devices by the protocol, e.g. an
+//    address byte first, which this doesn't need to know about.  Bytes in
+//    the receive ring before a request is written are dropped, as for any
+//    transaction, so replies can't be attributed to the wrong request.
+//
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+
+//
+//  Trap_Idle_Serial_Bus: C
+//
+// Waits until `until_usec`, dropping whatever arrives.  If `quiet_usec` is
+// not 0, anything arriving moves that on to `quiet_usec` later, though not
+// past `limit_usec`.  See [B] and [C] at top of file.
+//
+static Option(Error*) Trap_Idle_Serial_Bus(
+    SerialConnection* serial,
+    int64_t until_usec,
+    int32_t quiet_usec,
+    int64_t limit_usec
+){
+    SerialRing* in = &serial->in_ring;
+    Serial_Ring_Discard(in, Serial_Ring_Used(in));
+
+    while (true) {
+        int64_t left = until_usec - Serial_Usec();
+        if (left <= 0)
+            return SUCCESS;
+
+        Option(Error*) e = Trap_Read_Serial_Within(serial, cast(int32_t, left));
+        if (e)
+            return e;
+
+        if (serial->actual == 0)
+            continue;
+
+        Serial_Ring_Discard(in, Serial_Ring_Used(in));
+        if (quiet_usec != 0) {
+            until_usec = Serial_Usec() + quiet_usec;
+            if (until_usec > limit_usec)
+                until_usec = limit_usec;
+        }
+    }
+}
+
+
+//
+//  Trap_Run_Serial_Bus: C
+//
+// Runs each exchange in turn, see [A] at top of file.  A reply that isn't
+// complete in time leaves the exchange's reply as nullptr, and the round
+// carries on with the next device.  If an error is returned, replies that
+// were collected are still the caller's to free.
+//
+Option(Error*) Trap_Run_Serial_Bus(
+    SerialConnection* serial,
+    SerialBusExchange* exchanges,
+    Length count,
+    const SerialBusParams* params
+){
+    int64_t char_usec = Serial_Char_Usec(serial);
+
+    int32_t quiet_usec = params->turnaround_usec;  // see [C]
+    if (quiet_usec < 4 * char_usec)
+        quiet_usec = cast(int32_t, 4 * char_usec);
+
+    for (Length n = 0; n < count; ++n) {
+        exchanges[n].reply = nullptr;
+        exchanges[n].reply_size = 0;
+    }
+
+    SerialRing* in = &serial->in_ring;
+    SerialTransaction txn = params->rules;
+
+    for (Length n = 0; n < count; ++n) {
+        SerialBusExchange* exchange = &exchanges[n];
+
+        txn.request = exchange->request;
+        txn.request_size = exchange->request_size;
+
+        Size reply_size;
+        Option(Error*) e = Trap_Transact_Serial(&reply_size, serial, &txn);
+        if (e)
+            return e;
+
+        int64_t now = Serial_Usec();
+
+        if (reply_size == 0) {  // see [C]
+            e = Trap_Idle_Serial_Bus(
+                serial, now + quiet_usec, quiet_usec, now + txn.timeout_usec
+            );
+            if (e)
+                return e;
+            continue;
+        }
+
+        exchange->reply = rebAllocN(Byte, reply_size);
+        exchange->reply_size = Serial_Ring_Consume(
+            in, exchange->reply, reply_size
+        );
+
+        if (params->turnaround_usec != 0 and n + 1 != count) {  // see [B]
+            e = Trap_Idle_Serial_Bus(
+                serial, now + params->turnaround_usec, 0, 0
+            );
+            if (e)
+                return e;
+        }
+    }
+
+    return SUCCESS;
+}
@@ -0,0 +1,558 @@
+//
+//  file: %serial-capture.c
+//  summary: "Recording serial traffic to disk, and replaying it on a pty"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. A capture file is a SerialCaptureHeader followed by records, each a
+//    SerialCaptureRecord and then its bytes, padded to a multiple of 8.  All
+//    fields are in the host's byte order.  Timestamps are CLOCK_MONOTONIC
+//    nanoseconds, and the header has the CLOCK_REALTIME of the same moment
+//    for lining them up with other logs.  A record whose direction is 0
+//    ends the file.
+//
+// B. The file is sized up front with posix_fallocate() and memory-mapped, so
+//    recording is a clock_gettime() (no syscall, on Linux's vDSO) and a
+//    memcpy().  Reserving the blocks means a full disk is an error at OPEN,
+//    rather than a SIGBUS when a page is first touched.  Data reaches the
+//    disk by the kernel's writeback, so it survives the process crashing.
+//
+// C. When a file fills up it's cut down to what was used and renamed with
+//    ".1" on the end (replacing any earlier one), and a new file is started.
+//    So disk use is bounded at twice CAPTURE-SIZE.  If the rotation fails,
+//    recording stops and CLOSE reports why, but the port keeps working.
+//
+// D. Records are written by whichever thread makes the read() and write()
+//    calls: the interpreter, or the I/O thread in `io-engine: 'thread`.
+//    Either way it's one thread per connection, so there's no locking.
+//
+// E. Replay writes the received records of a capture into the master side
+//    of a pseudo-terminal, for a script to OPEN the slave side as if it were
+//    the device.  Timing starts when the slave is opened, so nothing is lost
+//    to the script not having opened it yet.  What the script writes is read
+//    and thrown away, so it never blocks.  A detached thread does the work
+//    and ends when the slave is closed, making no API calls (its memory is
+//    from malloc() for that reason).
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__APPLE__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    #include <util.h>
+#elif defined(__FreeBSD__)
+    #include <libutil.h>
+#else
+    #include <pty.h>
+#endif
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+#define SERIAL_CAPTURE_MAGIC  "SERCAP01"
+
+#define SERIAL_REPLAY_OPEN_MSEC  10000  // how long to wait for the slave [E]
+
+typedef struct {
+    char magic[8];
+    uint64_t realtime_nsec;  // wall clock when the file was started
+    uint64_t monotonic_nsec;  // same moment, on the records' clock
+    uint64_t reserved;
+} SerialCaptureHeader;
+
+typedef struct {
+    uint64_t nsec;
+    uint32_t size;  // of the bytes following, not counting padding
+    uint8_t direction;  // SerialCaptureDirection, or 0 at the end
+    uint8_t unused[3];
+} SerialCaptureRecord;
+
+struct SerialCaptureStruct {
+    char path[PATH_MAX];
+    int fd;
+    Byte* map;  // nullptr once recording has stopped [C]
+    Size size;
+    Size used;
+    int failure;  // errno of why recording stopped, if it did
+};
+
+
+//
+//  Capture_Nsec: C
+//
+static uint64_t Capture_Nsec(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return cast(uint64_t, ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+INLINE Size Capture_Padded(Size size)
+  { return (size + 7) & ~cast(Size, 7); }
+
+
+//
+//  Start_Capture_File: C
+//
+// Creates and maps a new file at capture->path, see [B].  Returns an errno.
+//
+static int Start_Capture_File(SerialCapture* capture)
+{
+    int fd = open(
+        capture->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644
+    );
+    if (fd == -1)
+        return errno;
+
+    int failure = posix_fallocate(fd, 0, capture->size);  // not via errno
+    if (failure != 0) {
+        close(fd);
+        return failure;
+    }
+
+    void* map = mmap(
+        nullptr, capture->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+    );
+    if (map == MAP_FAILED) {
+        failure = errno;
+        close(fd);
+        return failure;
+    }
+
+    SerialCaptureHeader* header = cast(SerialCaptureHeader*, map);
+    memcpy(header->magic, SERIAL_CAPTURE_MAGIC, 8);
+    header->realtime_nsec = Capture_Nsec(CLOCK_REALTIME);
+    header->monotonic_nsec = Capture_Nsec(CLOCK_MONOTONIC);
+    header->reserved = 0;
+
+    capture->fd = fd;
+    capture->map = cast(Byte*, map);
+    capture->used = sizeof(SerialCaptureHeader);
+    return 0;
+}
+
+
+//
+//  Finish_Capture_File: C
+//
+// Unmaps the current file and cuts it down to what was used.  Returns errno.
+//
+static int Finish_Capture_File(SerialCapture* capture)
+{
+    int failure = 0;
+    if (munmap(capture->map, capture->size) != 0)
+        failure = errno;
+    if (ftruncate(capture->fd, capture->used) != 0 and failure == 0)
+        failure = errno;
+    if (close(capture->fd) != 0 and failure == 0)
+        failure = errno;
+
+    capture->map = nullptr;
+    capture->fd = -1;
+    return failure;
+}
+
+
+//
+//  Rotate_Serial_Capture: C
+//
+// See [C] at top of file.
+//
+static void Rotate_Serial_Capture(SerialCapture* capture)
+{
+    char rotated[PATH_MAX + 2];
+    snprintf(rotated, sizeof(rotated), "%s.1", capture->path);
+
+    int failure = Finish_Capture_File(capture);
+    if (failure == 0 and rename(capture->path, rotated) != 0)
+        failure = errno;
+    if (failure == 0)
+        failure = Start_Capture_File(capture);
+
+    capture->failure = failure;
+}
+
+
+//
+//  Trap_Open_Serial_Capture: C
+//
+// Starts recording into the connection's capture_path, if it has one.
+//
+Option(Error*) Trap_Open_Serial_Capture(SerialConnection* serial)
+{
+    assert(serial->capture == nullptr);
+
+    if (serial->capture_path == nullptr)
+        return SUCCESS;
+
+    SerialCapture* capture = rebAlloc(SerialCapture);
+    Size len = rebSpellInto(capture->path, PATH_MAX, serial->capture_path);
+    if (len >= PATH_MAX) {
+        rebFree(capture);
+        return Error_User("Serial CAPTURE path too long for PATH_MAX");
+    }
+
+    capture->size = serial->capture_size & ~cast(Size, 7);  // records fit
+    capture->failure = 0;
+
+    int failure = Start_Capture_File(capture);
+    if (failure != 0) {
+        rebFree(capture);
+        return Error_OS(failure);
+    }
+
+    serial->capture = capture;
+    return SUCCESS;
+}
+
+
+//
+//  Capture_Serial_Bytes: C
+//
+// Records bytes the connection just received or transmitted.  Runs on the
+// thread doing the I/O, see [D], so no API calls.
+//
+void Capture_Serial_Bytes(
+    SerialCapture* capture,
+    SerialCaptureDirection direction,
+    const Byte* data,
+    Size size
+){
+    uint64_t nsec = Capture_Nsec(CLOCK_MONOTONIC);
+
+    while (size != 0 and capture->map) {
+        Size room = capture->size - capture->used;
+        if (room < sizeof(SerialCaptureRecord) + 8) {
+            Rotate_Serial_Capture(capture);
+            continue;
+        }
+
+        Size n = room - sizeof(SerialCaptureRecord);
+        if (n > size)
+            n = size;
+
+        Byte* at = capture->map + capture->used;
+        SerialCaptureRecord* record = cast(SerialCaptureRecord*, at);
+        record->nsec = nsec;
+        record->size = n;
+        record->direction = direction;
+        memcpy(at + sizeof(SerialCaptureRecord), data, n);
+
+        capture->used += Capture_Padded(sizeof(SerialCaptureRecord) + n);
+
+        data += n;
+        size -= n;
+    }
+}
+
+
+//
+//  Close_Serial_Capture: C
+//
+// Returns an errno if recording stopped early or the file couldn't be
+// finished, else 0.  No Error*, so the GC can use it too.
+//
+int Close_Serial_Capture(SerialConnection* serial)
+{
+    SerialCapture* capture = serial->capture;
+    if (capture == nullptr)
+        return 0;
+
+    int failure = capture->failure;
+    if (capture->map) {
+        int finish_failure = Finish_Capture_File(capture);
+        if (failure == 0)
+            failure = finish_failure;
+    }
+
+    rebFree(capture);
+    serial->capture = nullptr;
+    return failure;
+}
+
+
+//=//// REPLAY ////////////////////////////////////////////////////////////=//
+//
+// See [E] at top of file.
+//
+
+typedef struct {
+    int master;
+    const Byte* map;
+    Size size;
+    double speed;  // multiple of the recorded pace, 0 for as fast as possible
+} SerialReplay;
+
+
+//
+//  Pump_Replay: C
+//
+// Throws away what the script writes until the deadline (or until the master
+// is writable, if `writing`).  Returns false once the slave is closed.
+//
+static bool Pump_Replay(int master, int64_t deadline_nsec, bool writing)
+{
+    while (true) {
+        int timeout_msec = -1;
+        if (deadline_nsec >= 0) {
+            int64_t left = deadline_nsec - Capture_Nsec(CLOCK_MONOTONIC);
+            if (left <= 0 and not writing)
+                return true;
+            timeout_msec = left <= 0 ? 0 : cast(int, (left + 999999) / 1000000);
+        }
+
+        struct pollfd pfd;
+        pfd.fd = master;
+        pfd.events = POLLIN | (writing ? POLLOUT : 0);
+        pfd.revents = 0;
+
+        int n = poll(&pfd, 1, timeout_msec);
+        if (n == -1 and errno != EINTR)
+            return false;
+        if (n <= 0)
+            continue;
+
+        if (pfd.revents & POLLIN) {
+            Byte discard[1024];
+            if (read(master, discard, sizeof(discard)) == -1 and errno == EIO)
+                return false;  // (Linux reports the hangup this way)
+        }
+        if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))
+            return false;
+        if (writing and (pfd.revents & POLLOUT))
+            return true;
+    }
+}
+
+
+//
+//  Await_Replay_Slave: C
+//
+// The master reports POLLHUP while nothing has the slave open.
+//
+static bool Await_Replay_Slave(int master)
+{
+    for (int waited = 0; waited < SERIAL_REPLAY_OPEN_MSEC; waited += 10) {
+        struct pollfd pfd;
+        pfd.fd = master;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) == 0 or not (pfd.revents & POLLHUP))
+            return true;
+
+        struct timespec ts = { 0, 10000000 };
+        nanosleep(&ts, nullptr);
+    }
+    return false;
+}
+
+
+//
+//  Play_Replay: C
+//
+static void Play_Replay(SerialReplay* replay)
+{
+    int64_t start_nsec = Capture_Nsec(CLOCK_MONOTONIC);
+    int64_t first_nsec = -1;
+
+    Size at = sizeof(SerialCaptureHeader);
+    while (at + sizeof(SerialCaptureRecord) <= replay->size) {
+        const SerialCaptureRecord* record = cast(
+            const SerialCaptureRecord*, replay->map + at
+        );
+        if (record->direction == 0)
+            break;
+
+        const Byte* data = replay->map + at + sizeof(SerialCaptureRecord);
+        at += Capture_Padded(sizeof(SerialCaptureRecord) + record->size);
+
+        if (record->direction != SERIAL_CAPTURE_RECEIVED)
+            continue;
+
+        if (first_nsec == -1)
+            first_nsec = record->nsec;
+
+        if (replay->speed > 0.0) {
+            int64_t due = start_nsec + cast(int64_t,
+                (record->nsec - first_nsec) / replay->speed
+            );
+            if (not Pump_Replay(replay->master, due, false))
+                return;
+        }
+
+        Size left = record->size;
+        while (left != 0) {
+            ssize_t n = write(replay->master, data, left);
+            if (n == -1 and errno != EAGAIN and errno != EINTR)
+                return;
+            if (n > 0) {
+                data += n;
+                left -= n;
+                continue;
+            }
+            if (not Pump_Replay(replay->master, -1, true))
+                return;
+        }
+    }
+
+    Pump_Replay(replay->master, -1, false);  // until the slave is closed
+}
+
+
+//
+//  Serial_Replay_Main: C
+//
+static void* Serial_Replay_Main(void* arg)
+{
+    SerialReplay* replay = cast(SerialReplay*, arg);
+
+    if (Await_Replay_Slave(replay->master))
+        Play_Replay(replay);
+
+    munmap(m_cast(Byte*, replay->map), replay->size);
+    close(replay->master);
+    free(replay);
+    return nullptr;
+}
+
+
+//
+//  Trap_Start_Serial_Replay: C
+//
+// Gives the path of the pseudo-terminal's slave side in pty_path.  The
+// records are checked here, so the thread can trust their sizes.
+//
+Option(Error*) Trap_Start_Serial_Replay(
+    char* pty_path,
+    Size pty_path_size,
+    const char* capture_path,
+    double speed
+){
+    int fd = open(capture_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return Error_OS(errno);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int errsave = errno;
+        close(fd);
+        return Error_OS(errsave);
+    }
+    Size size = st.st_size;
+
+    if (size < sizeof(SerialCaptureHeader)) {
+        close(fd);
+        return Error_User("Not a serial capture file");
+    }
+
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int errsave = errno;
+    close(fd);  // mapping stays valid
+    if (map == MAP_FAILED)
+        return Error_OS(errsave);
+
+    const Byte* bytes = cast(const Byte*, map);
+    bool valid = (memcmp(bytes, SERIAL_CAPTURE_MAGIC, 8) == 0);
+
+    Size at = sizeof(SerialCaptureHeader);
+    while (valid and at + sizeof(SerialCaptureRecord) <= size) {
+        const SerialCaptureRecord* record = cast(
+            const SerialCaptureRecord*, bytes + at
+        );
+        if (record->direction == 0)
+            break;
+        if (
+            record->direction > SERIAL_CAPTURE_TRANSMITTED
+            or record->size > size - at - sizeof(SerialCaptureRecord)
+        ){
+            valid = false;
+        }
+        at += Capture_Padded(sizeof(SerialCaptureRecord) + record->size);
+    }
+
+    if (not valid) {
+        munmap(map, size);
+        return Error_User("Not a serial capture file");
+    }
+
+    int master;
+    int slave;
+    char name[128];
+    if (openpty(&master, &slave, name, nullptr, nullptr) == -1) {
+        errsave = errno;
+        munmap(map, size);
+        return Error_OS(errsave);
+    }
+    close(slave);  // so the master sees when the script opens it [E]
+
+    if (strlen(name) >= pty_path_size) {
+        munmap(map, size);
+        close(master);
+        return Error_User("Serial replay pty name too long");
+    }
+    strcpy(pty_path, name);
+
+    struct termios attr;  // master side must pass bytes through untouched
+    if (tcgetattr(master, &attr) == 0) {
+        cfmakeraw(&attr);
+        tcsetattr(master, TCSANOW, &attr);
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    SerialReplay* replay = cast(SerialReplay*, malloc(sizeof(SerialReplay)));
+    if (replay == nullptr) {
+        munmap(map, size);
+        close(master);
+        return Error_OS(ENOMEM);
+    }
+    replay->master = master;
+    replay->map = bytes;
+    replay->size = size;
+    replay->speed = speed;
+
+    pthread_attr_t attrs;
+    pthread_attr_init(&attrs);
+    pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    int failure = pthread_create(&thread, &attrs, &Serial_Replay_Main, replay);
+    pthread_attr_destroy(&attrs);
+    if (failure != 0) {
+        free(replay);
+        munmap(map, size);
+        close(master);
+        return Error_OS(failure);
+    }
+
+    return SUCCESS;
+}
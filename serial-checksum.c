@@ -0,0 +1,274 @@
+//
+//  file: %serial-checksum.c
+//  summary: "Checksums used by serial protocols, computed over byte ranges"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. Each checksum can be continued from the checksum of the data before it
+//    (as zlib's crc32() can), so a frame's checksum can be computed chunk by
+//    chunk as READs return, with no state other than the number so far.
+//    Empty_Serial_Checksum() is where a checksum of no data starts.
+//
+// B. The CRCs use "slice-by-8": eight 256-entry tables, where table k gives
+//    the effect of a byte with k bytes after it, so each step of the loop
+//    consumes eight bytes with eight independent lookups.  That's over a
+//    gigabyte a second on current machines, orders of magnitude more than
+//    any serial line.  The tables are built on first use, which is always
+//    on the interpreter thread.
+//
+// C. The reflected CRCs (CRC32, CRC32C and Modbus' CRC16) share one routine,
+//    as a 16-bit reflected CRC works the same in a 32-bit register.  CCITT
+//    and XMODEM are the same unreflected CRC16, started at 0xFFFF and 0.
+//
+// D. x86's SSE4.2 has an instruction for CRC32C (the Castagnoli polynomial,
+//    not the IEEE one in zlib and Ethernet), used when the CPU has it.  The
+//    IEEE CRC32 could be folded with PCLMULQDQ, but at the rates in [B] the
+//    complexity wouldn't buy anything a serial port could notice.
+//
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+    #define SERIAL_CRC32C_SSE42  1  // see [D]
+#else
+    #define SERIAL_CRC32C_SSE42  0
+#endif
+
+
+typedef uint32_t ReflectedCrcTables[8][256];
+
+static ReflectedCrcTables g_crc32_tables;
+static ReflectedCrcTables g_crc32c_tables;
+static ReflectedCrcTables g_crc16_modbus_tables;
+static uint16_t g_crc16_ccitt_tables[8][256];
+
+static bool g_checksum_tables_built = false;
+
+#if SERIAL_CRC32C_SSE42
+    static bool g_have_sse42 = false;
+#endif
+
+
+//
+//  Build_Reflected_Crc_Tables: C
+//
+static void Build_Reflected_Crc_Tables(ReflectedCrcTables t, uint32_t poly)
+{
+    for (int i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+        t[0][i] = crc;
+    }
+
+    for (int k = 1; k < 8; ++k) {
+        for (int i = 0; i < 256; ++i)
+            t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+    }
+}
+
+
+//
+//  Build_Checksum_Tables: C
+//
+static void Build_Checksum_Tables(void)
+{
+    Build_Reflected_Crc_Tables(g_crc32_tables, 0xEDB88320);
+    Build_Reflected_Crc_Tables(g_crc32c_tables, 0x82F63B78);
+    Build_Reflected_Crc_Tables(g_crc16_modbus_tables, 0xA001);
+
+    uint16_t (*t)[256] = g_crc16_ccitt_tables;
+    for (int i = 0; i < 256; ++i) {
+        uint16_t crc = i << 8;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        t[0][i] = crc;
+    }
+    for (int k = 1; k < 8; ++k) {
+        for (int i = 0; i < 256; ++i)
+            t[k][i] = (t[k - 1][i] << 8) ^ t[0][t[k - 1][i] >> 8];
+    }
+
+  #if SERIAL_CRC32C_SSE42
+    g_have_sse42 = __builtin_cpu_supports("sse4.2");
+  #endif
+
+    g_checksum_tables_built = true;
+}
+
+
+//
+//  Reflected_Crc: C
+//
+// See [B] and [C] at top of file.  Works on the CRC register, so the caller
+// does any inverting before and after.
+//
+static uint32_t Reflected_Crc(
+    const ReflectedCrcTables t,
+    uint32_t crc,
+    const Byte* data,
+    Size size
+){
+    while (size >= 8) {
+        uint32_t one = crc ^ (
+            data[0] | (data[1] << 8) | (data[2] << 16)
+            | (cast(uint32_t, data[3]) << 24)
+        );
+        crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF]
+            ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24]
+            ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+
+    for (; size != 0; --size)
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+
+    return crc;
+}
+
+
+//
+//  Ccitt_Crc16: C
+//
+// The unreflected CRC16 with polynomial 0x1021, see [C].
+//
+static uint16_t Ccitt_Crc16(uint16_t crc, const Byte* data, Size size)
+{
+    uint16_t (*t)[256] = g_crc16_ccitt_tables;
+
+    while (size >= 8) {
+        uint16_t one = crc ^ ((data[0] << 8) | data[1]);
+        crc = t[7][one >> 8] ^ t[6][one & 0xFF]
+            ^ t[5][data[2]] ^ t[4][data[3]] ^ t[3][data[4]]
+            ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+
+    for (; size != 0; --size)
+        crc = (crc << 8) ^ t[0][(crc >> 8) ^ *data++];
+
+    return crc;
+}
+
+
+#if SERIAL_CRC32C_SSE42
+
+//
+//  Crc32c_Sse42: C
+//
+// See [D] at top of file.  Eight bytes per instruction once aligned.
+//
+__attribute__((target("sse4.2")))
+static uint32_t Crc32c_Sse42(uint32_t crc, const Byte* data, Size size)
+{
+    for (; size != 0 and (i_cast(uintptr_t, data) & 7) != 0; --size)
+        crc = __builtin_ia32_crc32qi(crc, *data++);
+
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+    }
+    crc = cast(uint32_t, crc64);
+
+    for (; size != 0; --size)
+        crc = __builtin_ia32_crc32qi(crc, *data++);
+
+    return crc;
+}
+
+#endif
+
+
+//
+//  Empty_Serial_Checksum: C
+//
+// The checksum of no data, to continue from.  See [A] at top of file.
+//
+uint32_t Empty_Serial_Checksum(SerialChecksum method)
+{
+    switch (method) {
+      case SERIAL_CHECKSUM_CRC16_MODBUS:
+      case SERIAL_CHECKSUM_CRC16_CCITT:
+        return 0xFFFF;
+
+      default:
+        return 0;
+    }
+}
+
+
+//
+//  Continue_Serial_Checksum: C
+//
+// The checksum of the data that `prior` was the checksum of, followed by
+// `data`.  See [A] at top of file.
+//
+uint32_t Continue_Serial_Checksum(
+    SerialChecksum method,
+    uint32_t prior,
+    const Byte* data,
+    Size size
+){
+    if (not g_checksum_tables_built)
+        Build_Checksum_Tables();
+
+    switch (method) {
+      case SERIAL_CHECKSUM_CRC32:
+        return ~Reflected_Crc(g_crc32_tables, ~prior, data, size);
+
+      case SERIAL_CHECKSUM_CRC32C:
+      #if SERIAL_CRC32C_SSE42
+        if (g_have_sse42)
+            return ~Crc32c_Sse42(~prior, data, size);
+      #endif
+        return ~Reflected_Crc(g_crc32c_tables, ~prior, data, size);
+
+      case SERIAL_CHECKSUM_CRC16_MODBUS:
+        return Reflected_Crc(g_crc16_modbus_tables, prior & 0xFFFF, data, size);
+
+      case SERIAL_CHECKSUM_CRC16_CCITT:
+      case SERIAL_CHECKSUM_CRC16_XMODEM:
+        return Ccitt_Crc16(prior & 0xFFFF, data, size);
+
+      case SERIAL_CHECKSUM_LRC: {  // negated sum, so undo that to continue
+        Byte sum = -cast(Byte, prior);
+        for (; size != 0; --size)
+            sum += *data++;
+        return cast(Byte, -sum); }
+
+      case SERIAL_CHECKSUM_XOR: {
+        Byte x = prior;
+        for (; size != 0; --size)
+            x ^= *data++;
+        return x; }
+
+      default:
+        assert(false);
+        return 0;
+    }
+}
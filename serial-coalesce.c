@@ -0,0 +1,151 @@
+//
+//  file: %serial-coalesce.c
+//  summary: "When READ delivers: as bytes arrive, or batched up"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. By default READ returns as soon as anything has arrived, which is what
+//    a control port wants.  At high rates that's a READ (and a BLOB!) per few
+//    bytes the driver hands over.  With READ-SIZE, READ-IDLE or READ-LATENCY
+//    in the spec, READ keeps collecting after the first bytes until it has
+//    READ-SIZE of them, or the line has been idle for READ-IDLE, or it's been
+//    READ-LATENCY since the first byte, whichever comes first.  READ-SIZE on
+//    its own waits for that many bytes.
+//
+// B. This isn't done with the tty's VMIN and VTIME, which every engine leaves
+//    at 0 so that read() never blocks on its own (see the settings code in
+//    %serial-posix.c).  VTIME is in deciseconds and only times the gap after
+//    the first byte, so it couldn't express a sub-millisecond idle or an
+//    overall latency anyway.  The waits here are timed reads, which are the
+//    loop's timers, poll() in blocking mode, or the I/O thread's wakeups.
+//
+// C. The receive ring has to hold what arrives during READ-LATENCY, with room
+//    to spare for the script to get around to READ again.  So OPEN sizes it
+//    for four times that at the port's speed, and at least twice READ-SIZE,
+//    but never less than the usual capacity.
+//
+// D. Shared ports don't batch, since one device's reads serve them all.
+//
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+
+//
+//  Coalesced_Ring_Capacity: C
+//
+// See [C] at top of file.
+//
+Size Coalesced_Ring_Capacity(const SerialConnection* serial)
+{
+    int64_t bytes_per_sec = serial->baud_rate / Serial_Char_Bits(serial);
+
+    int64_t want = 2 * cast(int64_t, serial->read_size);
+    int64_t during = bytes_per_sec * serial->read_latency_usec / 1000000;
+    if (4 * during > want)
+        want = 4 * during;
+
+    if (want < 0)
+        want = 0;
+
+    Size capacity = SERIAL_RING_DEFAULT_CAPACITY;
+    while (capacity < cast(Size, want) and capacity < SERIAL_RING_MAX_CAPACITY)
+        capacity *= 2;
+    return capacity;
+}
+
+
+//
+//  Trap_Read_Serial_Coalesced: C
+//
+// Trap_Read_Serial(), then more per the port's policy, see [A].  Sets
+// serial->actual to the total added to the ring.
+//
+// 1. With only READ-SIZE there's nothing to time, so it's the same as READ
+//    waiting again.  That only returns once bytes beyond those already in
+//    the ring have arrived, and counts just those, in every engine (the I/O
+//    thread's ring fills on its own, see Trap_Read_Serial_Threaded()).  In
+//    blocking mode it may come back empty at the TIMEOUT, which ends the
+//    batch short.
+//
+// 2. Only what each wait added is counted, as bytes in the ring before this
+//    was called (e.g. a partial frame) were already reported.
+//
+Option(Error*) Trap_Read_Serial_Coalesced(SerialConnection* serial)
+{
+    Option(Error*) e = Trap_Read_Serial(serial);
+    if (e or serial->actual == 0)
+        return e;
+
+    if (
+        serial->read_size == 0
+        and serial->read_idle_usec == 0
+        and serial->read_latency_usec == 0
+    ){
+        return SUCCESS;
+    }
+
+    SerialRing* in = &serial->in_ring;
+    Size total = serial->actual;
+    int64_t first_usec = Serial_Usec();
+
+    while (true) {
+        Size used = Serial_Ring_Used(in);
+        if (serial->read_size != 0 and used >= serial->read_size)
+            break;
+        if (used == in->capacity)
+            break;
+
+        int64_t wait = -1;  // no limit
+        if (serial->read_latency_usec != 0) {
+            wait = first_usec + serial->read_latency_usec - Serial_Usec();
+            if (wait <= 0)
+                break;
+        }
+        bool idle_wait = false;
+        if (
+            serial->read_idle_usec != 0
+            and (wait == -1 or serial->read_idle_usec < wait)
+        ){
+            wait = serial->read_idle_usec;
+            idle_wait = true;
+        }
+
+        if (wait == -1)
+            e = Trap_Read_Serial(serial);  // [1]
+        else
+            e = Trap_Read_Serial_Within(serial, cast(int32_t, wait));
+        if (e)
+            return e;
+
+        if (serial->actual == 0) {
+            if (idle_wait or wait == -1)
+                break;
+            continue;  // READ-LATENCY has passed, checked at the top
+        }
+        total += serial->actual;  // [2]
+    }
+
+    serial->actual = total;
+    return SUCCESS;
+}
@@ -0,0 +1,439 @@
+//
+//  file: %serial-discovery.c
+//  summary: "Listing serial devices, with a cache kept fresh by inotify"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. Devices are found in /sys/class/tty.  Entries without a `device` link
+//    are virtual (ptys, consoles) and are skipped.  So are UART ports whose
+//    `type` is 0 (PORT_UNKNOWN): the 8250 driver registers ttyS0..ttyS31
+//    whether or not there is a UART behind them.
+//
+// B. The USB fields come from the first directory with an idVendor file,
+//    going up from the tty's device.  That is one level up for ttyACM (the
+//    tty's device is the USB interface) and two for ttyUSB (which has a
+//    usb-serial port in between).  The interface directory on the way gives
+//    bInterfaceNumber, which tells apart the ports of a multi-port adapter
+//    since they share a serial number.
+//
+// C. Scanning sysfs is a few hundred syscalls per device, so the result is
+//    cached.  An inotify watch on /dev says when device nodes come or go;
+//    udev creates the node only after the sysfs entry is complete.  The
+//    watch is checked with a nonblocking read() on each request, so if
+//    nothing was plugged or unplugged a request costs one syscall.  If
+//    inotify isn't available, every request rescans.
+//
+// D. Lookup by serial number goes through an open-addressed hash table over
+//    the cached list, so reconnecting to one adapter among hundreds doesn't
+//    compare against all of them.  Ports of a multi-port adapter are on the
+//    same probe chain, and are matched by interface number if one is given.
+//
+// E. The cache belongs to the interpreter thread, like the rest of the
+//    extension's state outside of the I/O thread.
+//
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#if defined(__linux__)
+    #include <sys/inotify.h>
+#endif
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+#define SERIAL_SYSFS_TTY  "/sys/class/tty"
+
+
+static SerialDevice* g_devices = nullptr;
+static Length g_num_devices = 0;
+static Length g_devices_capacity = 0;
+
+static int32_t* g_by_serial = nullptr;  // indices into g_devices, or -1 [D]
+static Length g_by_serial_capacity = 0;  // power of two
+
+static bool g_devices_stale = true;
+static int g_watch_fd = -1;  // inotify descriptor, see [C]
+
+
+#if defined(__linux__)
+
+//
+//  Read_Sysfs_Text: C
+//
+// Reads a one-line sysfs attribute into buf without its newline.  Leaves buf
+// empty and returns false if the attribute isn't there.
+//
+static bool Read_Sysfs_Text(
+    char* buf,
+    Size size,
+    const char* dir,
+    const char* attribute
+){
+    buf[0] = '\0';
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, attribute) >= PATH_MAX)
+        return false;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n <= 0)
+        return false;
+
+    while (n > 0 and (buf[n - 1] == '\n' or buf[n - 1] == ' '))
+        --n;
+    buf[n] = '\0';
+    return true;
+}
+
+
+//
+//  Read_Link_Name: C
+//
+// The last path component of where a sysfs symlink points, e.g. the driver.
+//
+static void Read_Link_Name(
+    char* buf,
+    Size size,
+    const char* dir,
+    const char* link
+){
+    buf[0] = '\0';
+
+    char path[PATH_MAX];
+    char target[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, link) >= PATH_MAX)
+        return;
+
+    ssize_t n = readlink(path, target, sizeof(target) - 1);
+    if (n <= 0)
+        return;
+    target[n] = '\0';
+
+    const char* slash = strrchr(target, '/');
+    snprintf(buf, size, "%s", slash ? slash + 1 : target);
+}
+
+
+//
+//  Read_Usb_Info: C
+//
+// See [B] at top of file.
+//
+static void Read_Usb_Info(SerialDevice* device, const char* device_dir)
+{
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", device_dir);
+
+    char text[SERIAL_DEVICE_TEXT];
+    for (int level = 0; level < 4; ++level) {
+        if (
+            device->interface == -1
+            and Read_Sysfs_Text(text, sizeof(text), dir, "bInterfaceNumber")
+        ){
+            device->interface = strtol(text, nullptr, 16);
+        }
+
+        if (Read_Sysfs_Text(text, sizeof(text), dir, "idVendor")) {
+            device->vendor_id = strtol(text, nullptr, 16);
+            if (Read_Sysfs_Text(text, sizeof(text), dir, "idProduct"))
+                device->product_id = strtol(text, nullptr, 16);
+
+            Read_Sysfs_Text(
+                device->serial_number, SERIAL_DEVICE_TEXT, dir, "serial"
+            );
+            Read_Sysfs_Text(
+                device->manufacturer, SERIAL_DEVICE_TEXT, dir, "manufacturer"
+            );
+            Read_Sysfs_Text(
+                device->product, SERIAL_DEVICE_TEXT, dir, "product"
+            );
+            return;
+        }
+
+        char* slash = strrchr(dir, '/');
+        if (slash == nullptr or slash == dir)
+            return;
+        *slash = '\0';
+    }
+}
+
+
+//
+//  Watch_Serial_Devices: C
+//
+// See [C] at top of file.  Returns true if the cache may be out of date.
+//
+static bool Watch_Serial_Devices(void)
+{
+    if (g_watch_fd == -1) {
+        g_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (g_watch_fd == -1)
+            return true;
+
+        uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+        if (inotify_add_watch(g_watch_fd, "/dev", mask) == -1) {
+            close(g_watch_fd);
+            g_watch_fd = -1;
+            return true;
+        }
+        return true;  // watch is new, so whatever was cached before is suspect
+    }
+
+    bool changed = false;
+    char events[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        ssize_t n = read(g_watch_fd, events, sizeof(events));
+        if (n > 0) {
+            changed = true;  // any node in /dev, the names aren't worth parsing
+            continue;
+        }
+        if (n == -1 and errno == EINTR)
+            continue;
+        break;  // EAGAIN: all caught up
+    }
+    return changed;
+}
+
+#endif  // defined(__linux__)
+
+
+//
+//  Hash_Serial_Number: C
+//
+// FNV-1a.
+//
+static uint32_t Hash_Serial_Number(const char* serial_number)
+{
+    uint32_t hash = 2166136261u;
+    for (const char* cp = serial_number; *cp != '\0'; ++cp) {
+        hash ^= cast(Byte, *cp);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+#if defined(__linux__)  // only a scan of sysfs fills the cache
+
+//
+//  Index_Serial_Devices: C
+//
+// Rebuilds the table for Trap_Find_Serial_Device(), see [D].
+//
+static void Index_Serial_Devices(void)
+{
+    Length capacity = 16;
+    while (capacity < g_num_devices * 2)
+        capacity *= 2;
+
+    if (capacity != g_by_serial_capacity) {
+        if (g_by_serial)
+            rebFree(g_by_serial);
+        g_by_serial = rebAllocN(int32_t, capacity);
+        g_by_serial_capacity = capacity;
+    }
+    for (Length n = 0; n < capacity; ++n)
+        g_by_serial[n] = -1;
+
+    for (Length i = 0; i < g_num_devices; ++i) {
+        const char* serial_number = g_devices[i].serial_number;
+        if (serial_number[0] == '\0')
+            continue;
+
+        Length at = Hash_Serial_Number(serial_number) & (capacity - 1);
+        while (g_by_serial[at] != -1)
+            at = (at + 1) & (capacity - 1);
+        g_by_serial[at] = i;
+    }
+}
+
+
+//
+//  Compare_Serial_Devices: C
+//
+static int Compare_Serial_Devices(const void* a, const void* b)
+{
+    return strcmp(
+        cast(const SerialDevice*, a)->path,
+        cast(const SerialDevice*, b)->path
+    );
+}
+
+#endif  // defined(__linux__)
+
+
+//
+//  Trap_Scan_Serial_Devices: C
+//
+// Refills the cache from sysfs.  See [A] at top of file.
+//
+static Option(Error*) Trap_Scan_Serial_Devices(void)
+{
+  #if defined(__linux__)
+    DIR* dir = opendir(SERIAL_SYSFS_TTY);
+    if (dir == nullptr)
+        return Error_OS(errno);
+
+    g_num_devices = 0;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        if (strlen(entry->d_name) + 5 >= SERIAL_DEVICE_TEXT)
+            continue;  // no room for "/dev/" + name
+
+        char tty_dir[PATH_MAX];
+        snprintf(
+            tty_dir, sizeof(tty_dir), SERIAL_SYSFS_TTY "/%.255s", entry->d_name
+        );
+
+        char type[SERIAL_DEVICE_TEXT];
+        if (
+            Read_Sysfs_Text(type, sizeof(type), tty_dir, "type")
+            and strcmp(type, "0") == 0
+        ){
+            continue;  // no UART there
+        }
+
+        char link[PATH_MAX];
+        char device_dir[PATH_MAX];
+        snprintf(
+            link, sizeof(link), SERIAL_SYSFS_TTY "/%.255s/device", entry->d_name
+        );
+        if (realpath(link, device_dir) == nullptr)
+            continue;  // virtual tty
+
+        if (g_num_devices == g_devices_capacity) {
+            Length capacity = g_devices_capacity ? g_devices_capacity * 2 : 16;
+            SerialDevice* devices = rebAllocN(SerialDevice, capacity);
+            if (g_devices) {
+                memcpy(
+                    devices, g_devices, g_num_devices * sizeof(SerialDevice)
+                );
+                rebFree(g_devices);
+            }
+            g_devices = devices;
+            g_devices_capacity = capacity;
+        }
+
+        SerialDevice* device = &g_devices[g_num_devices];
+        memset(device, 0, sizeof(SerialDevice));
+        strcpy(device->path, "/dev/");
+        strcat(device->path, entry->d_name);
+        Read_Link_Name(
+            device->driver, sizeof(device->driver), device_dir, "driver"
+        );
+        device->vendor_id = -1;
+        device->product_id = -1;
+        device->interface = -1;
+        Read_Usb_Info(device, device_dir);
+
+        ++g_num_devices;
+    }
+
+    closedir(dir);
+
+    qsort(
+        g_devices, g_num_devices, sizeof(SerialDevice), &Compare_Serial_Devices
+    );
+    Index_Serial_Devices();
+    return SUCCESS;
+  #else
+    return Error_User("Serial device discovery needs Linux sysfs");
+  #endif
+}
+
+
+//
+//  Trap_Get_Serial_Devices: C
+//
+// The list is valid until the next call into discovery.
+//
+Option(Error*) Trap_Get_Serial_Devices(
+    Sink(const SerialDevice*) devices,
+    Sink(Length) count
+){
+  #if defined(__linux__)
+    if (Watch_Serial_Devices())
+        g_devices_stale = true;
+  #endif
+
+    if (g_devices_stale or g_watch_fd == -1) {
+        Option(Error*) e = Trap_Scan_Serial_Devices();
+        if (e)
+            return e;
+        g_devices_stale = false;
+    }
+
+    *devices = g_devices;
+    *count = g_num_devices;
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Find_Serial_Device: C
+//
+// Gives back nullptr if there's no such device.  An interface of -1 matches
+// any port of the adapter (the one with the lowest path).  See [D].
+//
+Option(Error*) Trap_Find_Serial_Device(
+    Sink(const SerialDevice*) device,
+    const char* serial_number,
+    int32_t interface
+){
+    *device = nullptr;
+
+    const SerialDevice* devices;
+    Length count;
+    Option(Error*) e = Trap_Get_Serial_Devices(&devices, &count);
+    if (e)
+        return e;
+
+    if (serial_number[0] == '\0')
+        return SUCCESS;
+
+    Length mask = g_by_serial_capacity - 1;
+    Length at = Hash_Serial_Number(serial_number) & mask;
+    for (; g_by_serial[at] != -1; at = (at + 1) & mask) {
+        const SerialDevice* d = &devices[g_by_serial[at]];
+        if (strcmp(d->serial_number, serial_number) != 0)
+            continue;
+        if (interface != -1 and d->interface != interface)
+            continue;
+        if (*device == nullptr or strcmp(d->path, (*device)->path) < 0)
+            *device = d;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,280 @@
+//
+//  file: %serial-framer.c
+//  summary: "Splitting received serial bytes into frames"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. Frames are located without taking anything out of the receive ring, so
+//    a frame that's only partly arrived costs nothing to carry across READs.
+//    Delimiters are searched for with memchr() on the first delimiter byte
+//    (which libc vectorizes), over the ring's two contiguous segments.  The
+//    framer remembers how far it got, so bytes are only scanned once no
+//    matter how many READs it takes for the frame to finish arriving.
+//
+// B. A delimited frame can't be longer than the receive ring.  If the ring
+//    fills without a delimiter showing up, its contents are dropped and so
+//    is everything up to the next delimiter--after which the framer is back
+//    in sync.  SLIP and COBS were designed to recover this way.
+//
+// C. A length prefix that claims more than the ring can hold is an error,
+//    since there's no way to know where the next frame starts.
+//
+// D. SLIP and COBS decode in place, since the decoded frame is never longer
+//    than the encoded one.  A badly encoded frame is dropped, as are empty
+//    ones (SLIP senders commonly emit END before a frame to flush line noise).
+//
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+#define SLIP_END  0xC0
+#define SLIP_ESC  0xDB
+#define SLIP_ESC_END  0xDC
+#define SLIP_ESC_ESC  0xDD
+
+
+//
+//  Find_Delimiter: C
+//
+// See [A] at top of file.  Returns the frame size including the delimiter,
+// or 0 if there isn't a whole delimiter in the ring yet.
+//
+static Size Find_Delimiter(SerialFramer* framer, const SerialRing* ring)
+{
+    const Byte* seg[2];
+    Size len[2];
+    Serial_Ring_Used_Segments(ring, seg, len);
+    Size used = len[0] + len[1];
+
+    const Byte* delimiter = framer->delimiter;
+    Size delimiter_len = framer->delimiter_len;
+
+    Size pos = framer->scanned;
+    while (pos + delimiter_len <= used) {
+        Size at;
+        if (pos < len[0]) {
+            const Byte* hit = cast(const Byte*,
+                memchr(seg[0] + pos, delimiter[0], len[0] - pos)
+            );
+            if (not hit) {
+                pos = len[0];
+                continue;
+            }
+            at = hit - seg[0];
+        }
+        else {
+            const Byte* hit = cast(const Byte*,
+                memchr(seg[1] + (pos - len[0]), delimiter[0], used - pos)
+            );
+            if (not hit) {
+                pos = used;
+                break;
+            }
+            at = len[0] + (hit - seg[1]);
+        }
+
+        if (at + delimiter_len > used) {  // rest of delimiter isn't here yet
+            pos = at;
+            break;
+        }
+
+        Size n = 1;
+        for (; n < delimiter_len; ++n) {
+            if (Serial_Ring_Peek(ring, at + n) != delimiter[n])
+                break;
+        }
+        if (n == delimiter_len) {
+            framer->scanned = 0;  // next frame starts after this one
+            return at + delimiter_len;
+        }
+
+        pos = at + 1;
+    }
+
+    framer->scanned = pos;
+    return 0;
+}
+
+
+//
+//  Trap_Find_Serial_Frame: C
+//
+// Sets raw_size to the number of bytes at the ring's tail making up the next
+// complete frame, or 0 if there isn't one yet.  May drop bytes from the ring
+// to get back in sync, see [B].
+//
+Option(Error*) Trap_Find_Serial_Frame(
+    Sink(Size) raw_size,
+    SerialFramer* framer,
+    SerialRing* ring
+){
+    Size used = Serial_Ring_Used(ring);
+
+    switch (framer->kind) {
+      case SERIAL_FRAMING_DELIMITER:
+      case SERIAL_FRAMING_SLIP:
+      case SERIAL_FRAMING_COBS: {
+        *raw_size = Find_Delimiter(framer, ring);
+        if (*raw_size != 0 or Serial_Ring_Free(ring) != 0)
+            return SUCCESS;
+
+        Size keep = framer->delimiter_len - 1;  // may be a partial delimiter
+        Serial_Ring_Discard(ring, used - keep);
+        framer->scanned = 0;
+        framer->discarding = true;  // see [B]
+        return SUCCESS; }
+
+      case SERIAL_FRAMING_FIXED:
+        *raw_size = (used >= framer->fixed_size) ? framer->fixed_size : 0;
+        return SUCCESS;
+
+      case SERIAL_FRAMING_LENGTH_PREFIX: {
+        *raw_size = 0;
+
+        Size header = framer->prefix_offset + framer->prefix_width;
+        if (used < header)
+            return SUCCESS;
+
+        uint32_t length = 0;
+        for (uint8_t n = 0; n < framer->prefix_width; ++n) {
+            Byte b = Serial_Ring_Peek(
+                ring,
+                framer->prefix_big_endian
+                    ? framer->prefix_offset + n
+                    : header - 1 - n
+            );
+            length = (length << 8) | b;
+        }
+
+        int64_t total = cast(int64_t, header) + length + framer->prefix_adjust;
+        if (total < cast(int64_t, header))
+            return Error_User("Serial frame length prefix smaller than header");
+        if (total > cast(int64_t, ring->capacity))  // see [C]
+            return Error_User("Serial frame length exceeds receive buffer");
+
+        if (used >= cast(Size, total))
+            *raw_size = total;
+        return SUCCESS; }
+
+      default:
+        assert(false);
+        *raw_size = 0;
+        return SUCCESS;
+    }
+}
+
+
+//
+//  Decode_Slip: C
+//
+static bool Decode_Slip(Sink(Size) size, Byte* buf, Size len)
+{
+    Size out = 0;
+    for (Size in = 0; in < len; ++in) {
+        Byte b = buf[in];
+        if (b == SLIP_ESC) {
+            if (++in == len)
+                return false;
+            if (buf[in] == SLIP_ESC_END)
+                b = SLIP_END;
+            else if (buf[in] == SLIP_ESC_ESC)
+                b = SLIP_ESC;
+            else
+                return false;
+        }
+        buf[out++] = b;
+    }
+    *size = out;
+    return true;
+}
+
+
+//
+//  Decode_Cobs: C
+//
+// Each code byte N is followed by N - 1 data bytes, and then a zero unless
+// N was 0xFF or the frame ended.
+//
+static bool Decode_Cobs(Sink(Size) size, Byte* buf, Size len)
+{
+    Size in = 0;
+    Size out = 0;
+    while (in < len) {
+        Byte code = buf[in++];
+        if (code == 0 or in + code - 1 > len)
+            return false;
+
+        memmove(buf + out, buf + in, code - 1);
+        in += code - 1;
+        out += code - 1;
+
+        if (code != 0xFF and in < len)
+            buf[out++] = 0;
+    }
+    *size = out;
+    return true;
+}
+
+
+//
+//  Take_Serial_Frame: C
+//
+// Removes the raw_size bytes found by Trap_Find_Serial_Frame() from the ring,
+// leaving the frame's content in dest (which must have raw_size capacity).
+// Returns false if the frame is to be skipped, see [B] and [D].
+//
+bool Take_Serial_Frame(
+    Sink(Size) size,
+    Byte* dest,
+    SerialFramer* framer,
+    SerialRing* ring,
+    Size raw_size
+){
+    Serial_Ring_Consume(ring, dest, raw_size);
+
+    if (framer->discarding) {  // tail end of a frame too long to keep [B]
+        framer->discarding = false;
+        return false;
+    }
+
+    switch (framer->kind) {
+      case SERIAL_FRAMING_DELIMITER:
+        *size = raw_size - framer->delimiter_len;
+        return true;
+
+      case SERIAL_FRAMING_FIXED:
+      case SERIAL_FRAMING_LENGTH_PREFIX:
+        *size = raw_size;
+        return true;
+
+      case SERIAL_FRAMING_SLIP:
+        return Decode_Slip(size, dest, raw_size - 1) and *size != 0;
+
+      case SERIAL_FRAMING_COBS:
+        return Decode_Cobs(size, dest, raw_size - 1) and *size != 0;
+
+      default:
+        assert(false);
+        return false;
+    }
+}
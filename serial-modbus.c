@@ -0,0 +1,303 @@
+//
+//  file: %serial-modbus.c
+//  summary: "Modbus RTU master transactions over a serial connection"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. An RTU frame (ADU) is the unit ID, the PDU (function code and data), and
+//    a CRC-16 sent low byte first.  Frames are separated by at least 3.5
+//    character times of silence on the line ("t3.5"), a character being the
+//    start bit, data bits, parity bit and stop bits.  Above 19200 baud the
+//    spec fixes t3.5 at 1750 microseconds.
+//
+// B. RTU is half-duplex with one master, so only one request can be out at
+//    a time.  What keeps the bus busy is sending each request as soon as the
+//    line has been quiet for t3.5 after the previous response, which script
+//    code can't do between polls.  All the requests are encoded before the
+//    first is sent, so nothing but waiting happens in between.
+//
+// C. A response's length is known from its first few bytes for the common
+//    function codes (fixed, or a byte count at offset 2), so it's complete
+//    the moment its last byte arrives rather than after a t3.5 timeout.  For
+//    other function codes the frame ends when the line goes quiet for t3.5.
+//
+// D. A response is matched to its request by unit ID and function code (the
+//    latter with the exception bit, 0x80, allowed).  A well-formed frame that
+//    doesn't match, e.g. a late answer to a request that already timed out,
+//    is dropped and the wait continues.  A CRC failure ends the transaction
+//    with an error, since the slave won't send it again.  Either way the
+//    line is then waited on to go quiet, which also discards any remainder.
+//
+// E. The CRC is the CRC16 of %serial-checksum.c, which SERIAL-CHECKSUM also
+//    gives as 'crc16-modbus.
+//
+// F. Bytes in the receive ring when transactions start are stale (as far as
+//    a master is concerned) and dropped.  The port's FRAMING isn't used.
+//
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+
+//
+//  Modbus_Crc16: C
+//
+static uint16_t Modbus_Crc16(const Byte* data, Size size)
+{
+    return Continue_Serial_Checksum(  // see [E]
+        SERIAL_CHECKSUM_CRC16_MODBUS,
+        Empty_Serial_Checksum(SERIAL_CHECKSUM_CRC16_MODBUS),
+        data,
+        size
+    );
+}
+
+
+//
+//  Modbus_Response_Size: C
+//
+// See [C] at top of file.  Gives the whole frame's size once enough of it is
+// here to tell, 0 if more is needed to tell, or -1 if only silence will.
+//
+static int Modbus_Response_Size(const Byte* frame, Size got)
+{
+    if (got < 2)
+        return 0;
+
+    if (frame[1] & 0x80)  // exception: unit, function, code, CRC
+        return 5;
+
+    switch (frame[1]) {
+      case 0x01:  // read coils
+      case 0x02:  // read discrete inputs
+      case 0x03:  // read holding registers
+      case 0x04:  // read input registers
+      case 0x0C:  // get comm event log
+      case 0x11:  // report server ID
+      case 0x14:  // read file record
+      case 0x15:  // write file record
+      case 0x17:  // read/write multiple registers
+        if (got < 3)
+            return 0;
+        return 5 + frame[2];  // unit, function, byte count, data, CRC
+
+      case 0x07:  // read exception status
+        return 5;
+
+      case 0x05:  // write single coil
+      case 0x06:  // write single register
+      case 0x08:  // diagnostics (echoes sub-function and data)
+      case 0x0B:  // get comm event counter
+      case 0x0F:  // write multiple coils
+      case 0x10:  // write multiple registers
+        return 8;
+
+      case 0x16:  // mask write register
+        return 10;
+
+      default:
+        return -1;
+    }
+}
+
+
+//
+//  Trap_Await_Modbus_Silence: C
+//
+// Returns once nothing has arrived for silence_usec, throwing away whatever
+// did arrive in the meantime.
+//
+static Option(Error*) Trap_Await_Modbus_Silence(
+    SerialConnection* serial,
+    int32_t silence_usec
+){
+    SerialRing* in = &serial->in_ring;
+    Serial_Ring_Discard(in, Serial_Ring_Used(in));
+
+    while (true) {
+        Option(Error*) e = Trap_Read_Serial_Within(serial, silence_usec);
+        if (e)
+            return e;
+
+        if (serial->actual == 0)
+            return SUCCESS;
+
+        Serial_Ring_Discard(in, Serial_Ring_Used(in));
+    }
+}
+
+
+//
+//  Trap_Receive_Modbus_Response: C
+//
+// Fills in the transaction's response or error, see [C] and [D] at top of
+// file.  Only a problem with the connection itself is returned as an error.
+//
+static Option(Error*) Trap_Receive_Modbus_Response(
+    SerialModbusTransaction* txn,
+    SerialConnection* serial,
+    Byte function,
+    int64_t deadline_usec,
+    int32_t silence_usec
+){
+    SerialRing* in = &serial->in_ring;
+
+    Byte frame[SERIAL_MODBUS_MAX_ADU];
+    Size got = 0;
+
+    while (true) {
+        Size take = Serial_Ring_Used(in);
+        if (take > SERIAL_MODBUS_MAX_ADU - got)
+            take = SERIAL_MODBUS_MAX_ADU - got;
+        Serial_Ring_Consume(in, frame + got, take);
+        got += take;
+
+        int size = Modbus_Response_Size(frame, got);
+        bool ended = false;
+
+        if (size > 0 and got >= cast(Size, size))
+            ended = true;
+        else if (got == SERIAL_MODBUS_MAX_ADU) {
+            txn->error = Error_User("Modbus response too long");
+            return SUCCESS;
+        }
+        else {
+            int64_t now = Serial_Usec();
+            int32_t wait;
+            if (size == -1)  // frame ends by going quiet
+                wait = silence_usec;
+            else if (now >= deadline_usec) {
+                txn->error = Error_User("Modbus response timed out");
+                return SUCCESS;
+            }
+            else
+                wait = cast(int32_t, deadline_usec - now);
+
+            Option(Error*) e = Trap_Read_Serial_Within(serial, wait);
+            if (e)
+                return e;
+
+            if (serial->actual != 0 or size != -1)
+                continue;
+
+            size = got;
+            ended = true;
+        }
+
+        assert(ended);
+        if (size < 4 or Modbus_Crc16(frame, size - 2) != (
+            frame[size - 2] | (frame[size - 1] << 8)
+        )){
+            txn->error = Error_User("Modbus response failed CRC check");
+            return SUCCESS;
+        }
+
+        if (frame[0] == txn->unit and (frame[1] & 0x7F) == function) {
+            txn->response_size = size - 3;  // unit and CRC aren't the PDU
+            memcpy(txn->response, frame + 1, txn->response_size);
+            return SUCCESS;
+        }
+
+        memmove(frame, frame + size, got - size);  // not ours, see [D]
+        got -= size;
+    }
+}
+
+
+//
+//  Trap_Run_Modbus_Transactions: C
+//
+// Sends each transaction's request and waits for its response, one after
+// another as fast as the bus allows.  See [B] at top of file.
+//
+Option(Error*) Trap_Run_Modbus_Transactions(
+    SerialConnection* serial,
+    SerialModbusTransaction* txns,
+    Length count,
+    const SerialModbusParams* params
+){
+    int64_t char_usec = Serial_Char_Usec(serial);
+
+    int32_t silence_usec = (serial->baud_rate > 19200)  // see [A]
+        ? 1750
+        : cast(int32_t, (char_usec * 7 + 1) / 2);
+
+    Byte* adus = rebAllocN(Byte, count * SERIAL_MODBUS_MAX_ADU);
+    for (Length n = 0; n < count; ++n) {
+        SerialModbusTransaction* txn = &txns[n];
+        assert(txn->pdu_size >= 1 and txn->pdu_size <= SERIAL_MODBUS_MAX_PDU);
+
+        Byte* adu = adus + n * SERIAL_MODBUS_MAX_ADU;
+        adu[0] = txn->unit;
+        memcpy(adu + 1, txn->pdu, txn->pdu_size);
+        uint16_t crc = Modbus_Crc16(adu, txn->pdu_size + 1);
+        adu[txn->pdu_size + 1] = crc & 0xFF;
+        adu[txn->pdu_size + 2] = crc >> 8;
+
+        txn->response_size = 0;
+        txn->error = nullptr;
+    }
+
+    Option(Error*) e = Trap_Await_Modbus_Silence(serial, silence_usec);  // [F]
+
+    for (Length n = 0; n < count and not e; ++n) {
+        SerialModbusTransaction* txn = &txns[n];
+
+        Size adu_size = txn->pdu_size + 3;
+        int64_t sent_usec = Serial_Usec() + adu_size * char_usec;
+
+        e = Trap_Write_Serial_Request(  // drops an RS-485 echo
+            serial,
+            adus + n * SERIAL_MODBUS_MAX_ADU,
+            adu_size,
+            sent_usec + params->timeout_usec
+        );
+        if (e)
+            break;
+
+        if (txn->unit == 0) {  // broadcast, no response
+            int64_t wait = sent_usec + params->turnaround_usec - Serial_Usec();
+            if (wait > 0) {
+                e = Trap_Await_Modbus_Silence(serial, cast(int32_t, wait));
+                if (e)
+                    break;
+            }
+            continue;
+        }
+
+        e = Trap_Receive_Modbus_Response(
+            txn,
+            serial,
+            txn->pdu[0],
+            sent_usec + params->timeout_usec,
+            silence_usec
+        );
+        if (e)
+            break;
+
+        e = Trap_Await_Modbus_Silence(serial, silence_usec);
+    }
+
+    rebFree(adus);
+    return e;
+}
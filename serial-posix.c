@@ -20,20 +20,112 @@
 //
 //=////////////////////////////////////////////////////////////////////////=//
 //
-// This code is being kept compiling, but does not work at present.
-//
 // See README.md for notes about this extension.
 //
 //=//// NOTES /////////////////////////////////////////////////////////////=//
 //
 // A. TTY has many attributes. Refer to "man tcgetattr" for descriptions.
 //
-// B. The original code had an unimplemented Query_Serial() function.  All
-//    it had in it was:
+// B. The original code had an unimplemented Query_Serial() function, which
+//    only poll()'d for input.  QUERY now reports the SerialConnection's
+//    counters (kept as the I/O happens, see SerialStats) along with the
+//    driver's line error counts from TIOCGICOUNT, where it has them.
+//
+// C. The descriptor is opened O_NONBLOCK and registered with the libuv loop
+//    through a uv_poll_t.  When a read() finds nothing or a write() gets
+//    EAGAIN, the interest is added to the poll and the loop is run until the
+//    callback finishes the transfer.  This means a slow device never blocks
+//    the loop itself: other ports (and other libuv clients, like network
+//    sockets) keep being serviced while one READ or WRITE is outstanding.
+//
+// D. If the port spec gives a TIMEOUT, the port is in "blocking mode" and
+//    never touches the loop.  READ and WRITE poll() the descriptor directly
+//    against a deadline, which avoids a loop round trip per transfer.  A READ
+//    returns what arrived by the deadline (possibly nothing), while a WRITE
+//    that can't finish in time is an error.
+//
+// E. WRITE gathers its chunks behind any outbound backlog into one writev(),
+//    so a BLOCK! of BLOB!s costs one syscall.  Whatever the driver doesn't
+//    take is copied into the connection's outbound ring and WRITE returns;
+//    the poll callback flushes the ring as the descriptor becomes writable.
+//    Only when the ring is full does WRITE wait, which is the backpressure.
+//
+// F. With `io-engine: 'thread`, a native thread owns the descriptor and moves
+//    bytes between it and the two rings, so the device is serviced even
+//    while the interpreter is busy (e.g. in a long GC).  Each ring has one
+//    producer and one consumer, so no locks are needed.  The interpreter
+//    wakes the thread through a pipe, and the thread wakes the interpreter's
+//    loop with a uv_async_t.
+//
+// G. Trap_Wait_Serials() on Linux uses one epoll set that all open ports are
+//    registered in when opened, so waiting on many ports costs in proportion
+//    to how many are ready, not how many there are.  A port whose receive
+//    ring is full is taken out of the set until a READ makes room, or it
+//    would be reported ready forever.
+//
+// H. POSIX only has B constants for fixed rates.  Where the platform defines
+//    higher ones they are in the speeds[] table, and on Linux any other rate
+//    is set with `struct termios2` and BOTHER, checking what the driver set
+//    against what was asked for.  The device's own ceiling is probed where
+//    the driver reports one (TIOCGSERIAL's baud_base), otherwise the driver
+//    is left to reject rates it can't do.
+//
+// I. USB serial adapters hold received bytes for a "latency timer" (16ms by
+//    default for FTDI) before sending a partial USB packet to the host, and
+//    UART drivers may defer pushing input to the tty layer.  `latency: 'low`
+//    asks for ASYNC_LOW_LATENCY through TIOCSSERIAL and sets the FTDI-style
+//    latency_timer in sysfs to 1ms, where those exist.  Either may silently
+//    not apply (unsupported driver, no permission to write sysfs), so what
+//    actually took effect is recorded in the SerialConnection.  Both are
+//    put back as they were on close, since they outlive the descriptor.
 //
-//        struct pollfd pfd;
-//        pfd.events = POLLIN;
-//        n = poll(&pfd, 1, 0);
+// J. FIONREAD and TIOCOUTQ give the bytes the driver holds on each side, to
+//    which the rings' contents are added to get what a script can act on.
+//    Draining (like tcdrain(), but without blocking the loop) first waits for
+//    the outbound ring to be flushed, then polls TIOCOUTQ at about the time
+//    the queued bytes should take to go out at the port's baud rate.  Between
+//    polls the loop keeps running, on a uv_timer_t, except in blocking mode.
+//
+// K. A port can be reconfigured while open (e.g. a bootloader protocol that
+//    switches from 115200 to 2M baud mid-session), without the cost of a
+//    close and reopen: no new descriptor, no input flush, no re-registering
+//    with the loop, and nothing buffered is lost.  Data already written goes
+//    out at the old settings first, by draining before a TCSADRAIN change.
+//
+// L. Opening a USB adapter can take tens of milliseconds in open() and
+//    tcsetattr(), so a service with many ports would spend seconds starting
+//    them one after another.  Open_Serials() runs Open_Serial_Device() for
+//    a batch of them on a pool of pthreads instead.  That step makes only
+//    system calls: no API calls (the path and prior_attr are prepared ahead
+//    of time) and no Error* (failures are errno or SERIAL_FAIL_XXX codes).
+//    The libuv and I/O thread registration is done afterward, back on the
+//    interpreter thread, since the loop isn't thread-safe.
+//
+// M. With CAPTURE in the spec, what each read() and write() moves is recorded
+//    by the same thread, right after the call.  Received bytes are recorded
+//    before they're committed to the ring, so the I/O thread never touches
+//    ring memory that the interpreter may already be consuming.  See the
+//    file %serial-capture.c
+//
+// N. WRITE of a FILE! sends it a part at a time.  On Linux each part goes
+//    from the file to the tty with sendfile(), which the kernel does without
+//    copying through user memory (sendfile() to a non-pipe is splice()d via
+//    an internal pipe).  That's not possible through the I/O thread's ring,
+//    or when a capture needs to see the bytes, or on other platforms; then
+//    the part is read into a buffer the size of one part and written as
+//    usual.  Either way a large file never has to be in memory at once.
+//
+// O. With `timestamps: 'yes` in the spec, each read() that gets bytes notes
+//    the time it returned and where the bytes go in the receive ring, on
+//    whichever thread did the read().  See %serial-stamps.c
+//
+// P. With `rs485:` in the spec, TIOCSRS485 puts the driver in RS-485 mode:
+//    it raises (or lowers) RTS to enable the transceiver's driver before it
+//    sends, and puts it back once the last stop bit is out, with optional
+//    delays either side.  The UART's interrupt knows when that is to within
+//    a character, which user space polling TIOCOUTQ can't.  Drivers without
+//    the mode (most USB adapters, which switch in hardware, and ptys) fail
+//    the OPEN, since a bus that's never turned around doesn't work.
 //
 
 #include <stdlib.h>
@@ -42,10 +134,23 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <dirent.h>
 #include <errno.h>
+#include <poll.h>
+#include <time.h>
 #include <termios.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <limits.h>
+#if defined(__linux__)
+    #include <sys/sendfile.h>
+    #include <sys/epoll.h>
+    #include <linux/serial.h>  // TIOCGSERIAL's struct serial_struct
+#endif
+
+#include "uv.h"  // for uv_poll_t, see [C]
 
 #include "sys-core.h"
 
@@ -58,6 +163,25 @@ typedef ssize_t SizeOrNegative;  // holds a size, or negative if error
 
 #define MAX_SERIAL_PATH 128
 
+#define SERIAL_MAX_IOV 64  // chunks gathered per writev(), well under IOV_MAX
+
+#define SERIAL_MAX_EVENTS 64  // epoll events fetched per epoll_wait()
+
+typedef struct {
+    SerialConnection* serial;  // null if the opening was abandoned
+    char path[MAX_SERIAL_PATH];
+    TtyFileDescriptor ttyfd;
+    int failure;  // errno or SERIAL_FAIL_XXX
+} SerialOpening;
+
+// Failures from the steps of opening that may run on a worker thread, where
+// an Error* can't be made (see [L]).  Positive values are errno.
+//
+#define SERIAL_FAIL_ABOVE_MAX_BAUD  (-1)
+#define SERIAL_FAIL_INVALID_BAUD  (-2)
+#define SERIAL_FAIL_INEXACT_BAUD  (-3)
+#define SERIAL_FAIL_NO_RS485  (-4)
+
 const int speeds[] = {  // BXXX constants are defined in termios.h
     50, B50,
     75, B75,
@@ -77,32 +201,421 @@ const int speeds[] = {  // BXXX constants are defined in termios.h
     57600, B57600,
     115200, B115200,
     230400, B230400,
+  #ifdef B460800  // higher rates are not POSIX, but Linux has these
+    460800, B460800,
+  #endif
+  #ifdef B500000
+    500000, B500000,
+  #endif
+  #ifdef B576000
+    576000, B576000,
+  #endif
+  #ifdef B921600
+    921600, B921600,
+  #endif
+  #ifdef B1000000
+    1000000, B1000000,
+  #endif
+  #ifdef B1152000
+    1152000, B1152000,
+  #endif
+  #ifdef B1500000
+    1500000, B1500000,
+  #endif
+  #ifdef B2000000
+    2000000, B2000000,
+  #endif
+  #ifdef B2500000
+    2500000, B2500000,
+  #endif
+  #ifdef B3000000
+    3000000, B3000000,
+  #endif
+  #ifdef B3500000
+    3500000, B3500000,
+  #endif
+  #ifdef B4000000
+    4000000, B4000000,
+  #endif
     0
 };
 
 
+// Rates with no B constant (e.g. 12000000, or 250000 for DMX) can be set on
+// Linux with `struct termios2` and the BOTHER flag, see [H].  Its header can't
+// be included alongside <termios.h> (both define `struct termios`), so the
+// kernel's layout is mirrored here (TCGETS2 expands to a sizeof() of it).
+// The layout and BOTHER value are those of the kernel's asm-generic termbits,
+// which Alpha, MIPS, PowerPC and SPARC don't use.  So it's restricted to the
+// architectures known to use them, and others only get the B constants.
+//
+#if defined(__linux__) && defined(TCGETS2) && ( \
+    defined(__i386__) || defined(__x86_64__) \
+    || defined(__arm__) || defined(__aarch64__) \
+    || defined(__riscv) || defined(__loongarch__) \
+)
+
+    #define SERIAL_HAS_TERMIOS2 1
+
+    #ifndef BOTHER
+        #define BOTHER 0010000
+    #endif
+
+    struct termios2 {
+        tcflag_t c_iflag;
+        tcflag_t c_oflag;
+        tcflag_t c_cflag;
+        tcflag_t c_lflag;
+        cc_t c_line;
+        cc_t c_cc[19];  // kernel NCCS, not glibc's
+        speed_t c_ispeed;
+        speed_t c_ospeed;
+    };
+#else
+    #define SERIAL_HAS_TERMIOS2 0
+#endif
+
+
 //=//// LOCAL FUNCTIONS ///////////////////////////////////////////////////=//
 
 
-static Option(Error*) Trap_Get_Serial_Settings(
-    Sink(TtyAttributes*) attr,
+//
+//  Error_Serial_Failure: C
+//
+static Error* Error_Serial_Failure(int failure)
+{
+    switch (failure) {
+      case SERIAL_FAIL_ABOVE_MAX_BAUD:
+        return Error_User("Baud rate is above what the device supports");
+
+      case SERIAL_FAIL_INVALID_BAUD:
+        return Error_User("Invalid baud rate");
+
+      case SERIAL_FAIL_INEXACT_BAUD:
+        return Error_User("Device can't get within 3% of that baud rate");
+
+      case SERIAL_FAIL_NO_RS485:
+        return Error_User("Device driver has no RS-485 mode (TIOCSRS485)");
+
+      default:
+        assert(failure > 0);
+        return Error_OS(failure);
+    }
+}
+
+
+#if SERIAL_HAS_TERMIOS2
+
+//
+//  Set_Custom_Baud_Rate: C
+//
+// 1. Drivers round to what their clock divisors can produce, and the kernel
+//    reports the result back.  A UART receiver tolerates only a few percent
+//    of mismatch, so beyond that it's better to fail than to get garbage.
+//
+static int Set_Custom_Baud_Rate(
+    TtyFileDescriptor ttyfd,
+    SerialBaudRate baud_rate
+){
+    struct termios2 t2;
+    if (ioctl(ttyfd, TCGETS2, &t2) != 0)
+        return errno;
+
+    t2.c_cflag &= ~CBAUD;
+    t2.c_cflag |= BOTHER;
+    t2.c_ispeed = baud_rate;
+    t2.c_ospeed = baud_rate;
+
+    if (ioctl(ttyfd, TCSETS2, &t2) != 0)
+        return errno;
+
+    if (ioctl(ttyfd, TCGETS2, &t2) != 0)
+        return errno;
+
+    int64_t achieved = t2.c_ospeed;
+    if ((achieved - baud_rate) * 100 > baud_rate * 3  // [1]
+        or (baud_rate - achieved) * 100 > baud_rate * 3
+    ){
+        return SERIAL_FAIL_INEXACT_BAUD;
+    }
+
+    return 0;
+}
+
+#endif
+
+
+//
+//  Probe_Max_Baud_Rate: C
+//
+// Per-device ceiling, or 0 if the driver doesn't say.  See [H].
+//
+static SerialBaudRate Probe_Max_Baud_Rate(TtyFileDescriptor ttyfd)
+{
+  #if defined(__linux__) && defined(TIOCGSERIAL)
+    struct serial_struct info;
+    memset(&info, 0, sizeof(info));
+    if (ioctl(ttyfd, TIOCGSERIAL, &info) == 0 and info.baud_base > 0)
+        return info.baud_base;
+  #else
+    UNUSED(ttyfd);
+  #endif
+
+  #if SERIAL_HAS_TERMIOS2
+    return 0;  // any rate may be attempted, the driver decides
+  #else
+    int max = 0;  // only the B constants can be used, so the table decides
+    for (int n = 0; speeds[n] != 0; n += 2)
+        max = speeds[n];
+    return max;
+  #endif
+}
+
+
+#if defined(__linux__)
+
+//
+//  Get_Latency_Timer_Path: C
+//
+// The sysfs attribute lives on the USB serial device, which the tty's
+// class entry links to, e.g. /sys/class/tty/ttyUSB0/device/latency_timer
+//
+static bool Get_Latency_Timer_Path(
+    char* buf,
+    size_t buf_size,
     TtyFileDescriptor ttyfd
 ){
-    *attr = rebAlloc(TtyAttributes);
-    if (tcgetattr(ttyfd, *attr) != 0) {
-        rebFree(attr);
-        Corrupt_If_Needful(*attr);
-        return Error_OS(errno);
+    char tty_path[MAX_SERIAL_PATH];
+    if (ttyname_r(ttyfd, tty_path, sizeof(tty_path)) != 0)
+        return false;
+
+    const char* name = strrchr(tty_path, '/');
+    name = name ? name + 1 : tty_path;
+
+    int len = snprintf(
+        buf, buf_size, "/sys/class/tty/%s/device/latency_timer", name
+    );
+    return len > 0 and cast(size_t, len) < buf_size;
+}
+
+
+//
+//  Read_Latency_Timer: C
+//
+static int Read_Latency_Timer(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    char text[16];
+    SizeOrNegative n = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (n <= 0)
+        return -1;
+
+    text[n] = '\0';
+    return atoi(text);
+}
+
+
+//
+//  Write_Latency_Timer: C
+//
+static void Write_Latency_Timer(const char* path, int msec)
+{
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+        return;  // typically EACCES unless udev rules grant it, see [I]
+
+    char text[16];
+    int len = snprintf(text, sizeof(text), "%d", msec);
+    SizeOrNegative n = write(fd, text, len);
+    UNUSED(n);
+    close(fd);
+}
+
+#endif
+
+
+//
+//  Apply_Serial_Latency: C
+//
+// See [I] at top of file.  Not being able to lower the latency is not an
+// error, the effective state is just recorded for the port to report.
+//
+static void Apply_Serial_Latency(
+    TtyFileDescriptor ttyfd,
+    SerialConnection* serial
+){
+    serial->low_latency_applied = false;
+    serial->latency_timer_msec = -1;
+
+  #if defined(__linux__)
+    struct serial_struct info;
+    memset(&info, 0, sizeof(info));
+    if (ioctl(ttyfd, TIOCGSERIAL, &info) == 0) {
+        bool was_low = (info.flags & ASYNC_LOW_LATENCY) != 0;
+        serial->low_latency_applied = was_low;
+
+        if (serial->low_latency and not was_low) {
+            info.flags |= ASYNC_LOW_LATENCY;
+            if (ioctl(ttyfd, TIOCSSERIAL, &info) == 0) {
+                serial->set_low_latency = true;
+                serial->low_latency_applied = true;
+            }
+        }
+        else if (not serial->low_latency and serial->set_low_latency) {
+            info.flags &= ~ASYNC_LOW_LATENCY;  // (e.g. MODIFY turned it off)
+            if (ioctl(ttyfd, TIOCSSERIAL, &info) == 0) {
+                serial->set_low_latency = false;
+                serial->low_latency_applied = false;
+            }
+        }
     }
-    return SUCCESS;
+
+    char path[MAX_SERIAL_PATH + 64];
+    if (Get_Latency_Timer_Path(path, sizeof(path), ttyfd)) {
+        int current = Read_Latency_Timer(path);
+        if (current > 1 and serial->low_latency) {
+            Write_Latency_Timer(path, 1);
+            int now = Read_Latency_Timer(path);
+            if (now != current and serial->prior_latency_timer_msec == -1)
+                serial->prior_latency_timer_msec = current;
+            current = now;
+        }
+        else if (
+            not serial->low_latency
+            and serial->prior_latency_timer_msec != -1
+        ){
+            Write_Latency_Timer(path, serial->prior_latency_timer_msec);
+            current = Read_Latency_Timer(path);
+            serial->prior_latency_timer_msec = -1;
+        }
+        serial->latency_timer_msec = current;
+    }
+  #else
+    UNUSED(ttyfd);
+  #endif
+}
+
+
+//
+//  Restore_Serial_Latency: C
+//
+static void Restore_Serial_Latency(
+    TtyFileDescriptor ttyfd,
+    SerialConnection* serial
+){
+  #if defined(__linux__)
+    if (serial->set_low_latency) {
+        struct serial_struct info;
+        if (ioctl(ttyfd, TIOCGSERIAL, &info) == 0) {
+            info.flags &= ~ASYNC_LOW_LATENCY;
+            ioctl(ttyfd, TIOCSSERIAL, &info);
+        }
+    }
+
+    if (serial->prior_latency_timer_msec != -1) {
+        char path[MAX_SERIAL_PATH + 64];
+        if (Get_Latency_Timer_Path(path, sizeof(path), ttyfd))
+            Write_Latency_Timer(path, serial->prior_latency_timer_msec);
+    }
+  #else
+    UNUSED(ttyfd);
+  #endif
+
+    serial->prior_latency_timer_msec = -1;
+    serial->set_low_latency = false;
+    serial->low_latency_applied = false;
+}
+
+
+//
+//  Apply_Serial_Rs485: C
+//
+// See [P] at top of file.  Unlike latency, a bus whose transceiver is never
+// turned around doesn't work at all, so a driver without the mode fails.
+//
+// 1. The kernel rounds the delays to milliseconds and may clamp them (to
+//    100ms on current kernels), writing back what it will actually use.
+//
+static int Apply_Serial_Rs485(
+    TtyFileDescriptor ttyfd,
+    SerialConnection* serial
+){
+  #if defined(__linux__) && defined(TIOCSRS485)
+    SerialRs485* want = &serial->rs485;
+    if (not want->enabled and not serial->set_rs485)
+        return 0;
+
+    struct serial_rs485 kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    if (want->enabled) {
+        kernel.flags = SER_RS485_ENABLED;
+        if (want->rts_high_on_send)
+            kernel.flags |= SER_RS485_RTS_ON_SEND;
+        else
+            kernel.flags |= SER_RS485_RTS_AFTER_SEND;
+        if (want->receive_during_send)
+            kernel.flags |= SER_RS485_RX_DURING_TX;
+        kernel.delay_rts_before_send = (want->delay_before_usec + 999) / 1000;
+        kernel.delay_rts_after_send = (want->delay_after_usec + 999) / 1000;
+    }
+
+    if (ioctl(ttyfd, TIOCSRS485, &kernel) != 0) {  // [1]
+        if (not want->enabled)
+            return 0;  // (turning it off is best effort, as on close)
+        if (errno == ENOTTY)
+            return SERIAL_FAIL_NO_RS485;
+        return errno;
+    }
+    serial->set_rs485 = want->enabled;
+    if (want->enabled) {
+        want->delay_before_usec = kernel.delay_rts_before_send * 1000;
+        want->delay_after_usec = kernel.delay_rts_after_send * 1000;
+    }
+    return 0;
+  #else
+    UNUSED(ttyfd);
+    return serial->rs485.enabled ? SERIAL_FAIL_NO_RS485 : 0;
+  #endif
 }
 
 
-static Option(Error*) Trap_Set_Serial_Settings(
+//
+//  Restore_Serial_Rs485: C
+//
+static void Restore_Serial_Rs485(
     TtyFileDescriptor ttyfd,
-    SerialConnection *serial
+    SerialConnection* serial
 ){
+  #if defined(__linux__) && defined(TIOCSRS485)
+    if (serial->set_rs485) {
+        struct serial_rs485 rs485;
+        memset(&rs485, 0, sizeof(rs485));
+        ioctl(ttyfd, TIOCSRS485, &rs485);
+    }
+  #else
+    UNUSED(ttyfd);
+  #endif
 
+    serial->set_rs485 = false;
+}
+
+
+//
+//  Set_Serial_Settings: C
+//
+// `when` is TCSANOW on open, which also discards any stale input, or
+// TCSADRAIN when reconfiguring a port in use (see [K]).  Gives back 0, or
+// errno or a SERIAL_FAIL_XXX code, since it may run on a worker [L].
+//
+static int Set_Serial_Settings(
+    TtyFileDescriptor ttyfd,
+    SerialConnection *serial,
+    int when
+){
     TtyAttributes attr;
     memset(&attr, 0, sizeof(attr));
 
@@ -110,18 +623,32 @@ static Option(Error*) Trap_Set_Serial_Settings(
     printf("setting attributes: baud_rate %d\n", serial->baud_rate);
   #endif
 
-    int speed;
+    if (
+        serial->max_baud_rate != 0
+        and serial->baud_rate > serial->max_baud_rate
+    ){
+        return SERIAL_FAIL_ABOVE_MAX_BAUD;
+    }
 
-    for (Offset n = 0; true; n += 2) {
-        if (speeds[n] == 0)  // invalid (used default CB115200 before)
-            return Error_User("Invalid baud rate");
+    int speed = 0;
+    bool custom_speed = true;  // no B constant, needs TCSETS2 [H]
 
+    for (Offset n = 0; speeds[n] != 0; n += 2) {
         if (serial->baud_rate == speeds[n]) {
             speed = speeds[n + 1];
+            custom_speed = false;
             break;
         }
     }
 
+    if (custom_speed) {
+      #if SERIAL_HAS_TERMIOS2
+        speed = B38400;  // placeholder, overridden after tcsetattr()
+      #else
+        return SERIAL_FAIL_INVALID_BAUD;
+      #endif
+    }
+
     cfsetospeed(&attr, speed);  // output speed
     cfsetispeed(&attr, speed);  // input speed
 
@@ -188,25 +715,27 @@ static Option(Error*) Trap_Set_Serial_Settings(
         goto stop_bits_1_case;
     }
 
-  #ifdef CNEW_RTSCTS
-    switch (serial->parity) {
+    switch (serial->flow_control) {
       flow_control_none_case:
       case SERIAL_FLOW_CONTROL_NONE:
         break;
 
       case SERIAL_FLOW_CONTROL_HARDWARE:
+      #if defined(CRTSCTS)
+        attr.c_cflag |= CRTSCTS;
+      #elif defined(CNEW_RTSCTS)
         attr.c_cflag |= CNEW_RTSCTS;
+      #endif
         break;
 
       case SERIAL_FLOW_CONTROL_SOFTWARE:
-        attr.c_cflag &= ~CNEW_RTSCTS;
+        attr.c_iflag |= IXON | IXOFF;
         break;
 
       default:
         assert(false);
         goto flow_control_none_case;
     }
-  #endif
 
     attr.c_lflag = 0;  // L-flags: local modes (raw, not ICANON)
 
@@ -214,166 +743,2193 @@ static Option(Error*) Trap_Set_Serial_Settings(
 
     attr.c_oflag = 0;  // O-flags: output modes
 
-    attr.c_cc[VMIN]  = 0;  // control characters...
-    attr.c_cc[VTIME] = 0;  // we use non-blocking IO, so...not needed (?)
-
-    if (tcflush(ttyfd, TCIFLUSH) != 0)  // make sure OS queues are empty
-        return Error_OS(errno);
+    // Control characters.  Every engine waits with poll() and then read()s
+    // what's there, so read() must not block on its own.  VTIME's deciseconds
+    // (max 25.5s) couldn't express the blocking mode deadline anyway, and
+    // VMIN > 0 would let a read() overrun it.  That holds for `latency: 'low`
+    // too [I]: VMIN=0/VTIME=0 already hands over bytes as soon as the driver
+    // has them, and any VTIME > 0 would only add inter-byte waiting.
+    //
+    attr.c_cc[VMIN]  = 0;
+    attr.c_cc[VTIME] = 0;
+
+    if (when == TCSANOW and tcflush(ttyfd, TCIFLUSH) != 0)  // stale input
+        return errno;
+
+    if (tcsetattr(ttyfd, when, &attr) != 0)  // Set new attributes
+        return errno;
+
+  #if SERIAL_HAS_TERMIOS2
+    if (custom_speed) {
+        int failure = Set_Custom_Baud_Rate(ttyfd, serial->baud_rate);
+        if (failure)
+            return failure;
+    }
+  #endif
 
-    if (tcsetattr(ttyfd, TCSANOW, &attr) != 0)  // Set new attributes
-        return Error_OS(errno);
+    Apply_Serial_Latency(ttyfd, serial);  // not an error if it can't [I]
 
-    return SUCCESS;
+    return Apply_Serial_Rs485(ttyfd, serial);  // but this is, see [P]
 }
 
 
-//=//// EXPORTED FUNCTIONS ////////////////////////////////////////////////=//
-
-
 //
-//  Get_Serial_Max_Baud_Rate: C
+//  Capture_Iovecs: C
 //
-SerialBaudRate Get_Serial_Max_Baud_Rate(void) {
-    int max = 0;
-    for (int n = 0; speeds[n] != 0; n += 2)
-        max = speeds[n];
-    return max;
+// Records the first `total` bytes of an iovec list, see [M].
+//
+static void Capture_Iovecs(
+    SerialCapture* capture,
+    SerialCaptureDirection direction,
+    const struct iovec* iov,
+    int count,
+    Size total
+){
+    for (int i = 0; i < count and total != 0; ++i) {
+        Size n = iov[i].iov_len < total ? iov[i].iov_len : total;
+        Capture_Serial_Bytes(
+            capture, direction, cast(const Byte*, iov[i].iov_base), n
+        );
+        total -= n;
+    }
 }
 
+
 //
-//  Trap_Open_Serial: C
+//  Read_Tty_Into_Ring: C
 //
-// serial.path = the /dev name for the serial port
-// serial.baud = speed (baudrate)
+// One readv() into both free segments of the receive ring, so a wrapped ring
+// is filled by a single syscall without staging through a temporary buffer.
 //
-Option(Error*) Trap_Open_Serial(SerialConnection* serial)
-{
-    assert(serial->path != nullptr);
+static SizeOrNegative Read_Tty_Into_Ring(
+    SerialStats* stats,
+    Option(SerialCapture*) capture,
+    SerialStampRing* stamps,
+    TtyFileDescriptor ttyfd,
+    SerialRing* ring
+){
+    Byte* seg[2];
+    Size len[2];
+    Serial_Ring_Free_Segments(ring, seg, len);
+
+    struct iovec iov[2];
+    iov[0].iov_base = seg[0];
+    iov[0].iov_len = len[0];
+    iov[1].iov_base = seg[1];
+    iov[1].iov_len = len[1];
+
+    int count = len[1] == 0 ? 1 : 2;
+    SizeOrNegative result = readv(ttyfd, iov, count);
+    Serial_Stat_Add(stats->reads, 1);
+    if (result > 0) {
+        if (capture)  // before the consumer can see them, see [M]
+            Capture_Iovecs(
+                unwrap capture, SERIAL_CAPTURE_RECEIVED, iov, count, result
+            );
+        if (stamps->buf)  // also before they can be seen, see [O]
+            Push_Serial_Stamp(stamps, ring->head, Serial_Usec());
+        Serial_Ring_Commit(ring, result);
+        Serial_Stat_Add(stats->bytes_in, result);
+    }
+    else if (result == 0 or errno == EAGAIN)  // (0 means idle, see [A])
+        Serial_Stat_Add(stats->would_block, 1);
+    return result;
+}
 
-    char path_utf8[MAX_SERIAL_PATH];
-    Size size = rebSpellInto(
-        path_utf8,
-        MAX_SERIAL_PATH,
-        serial->path
-    );
 
-    if (path_utf8[0] != '/') {  // relative path, insert `/dev` before slash
-        memmove(path_utf8 + 4, path_utf8, size + 1);
-        memcpy(path_utf8, "/dev", 4);
+//
+//  Writev_Tty: C
+//
+// Gather the outbound ring's backlog, followed by the chunks (starting `skip`
+// bytes into the first one), into a single writev().  The backlog goes first
+// so bytes leave in the order that WRITEs accepted them.  See [E].
+//
+static SizeOrNegative Writev_Tty(
+    Sink(Size) requested,
+    SerialStats* stats,
+    Option(SerialCapture*) capture,
+    TtyFileDescriptor ttyfd,
+    const SerialRing* out,
+    const SerialChunk* chunks,
+    int num_chunks,
+    Size skip
+){
+    struct iovec iov[SERIAL_MAX_IOV];
+    int count = 0;
+    *requested = 0;
+
+    const Byte* seg[2];
+    Size len[2];
+    Serial_Ring_Used_Segments(out, seg, len);
+
+    for (int i = 0; i < 2; ++i) {
+        if (len[i] == 0)
+            continue;
+        iov[count].iov_base = m_cast(Byte*, seg[i]);
+        iov[count].iov_len = len[i];
+        *requested += len[i];
+        ++count;
     }
 
-    TtyFileDescriptor ttyfd = open(path_utf8, O_RDWR | O_NOCTTY | O_NONBLOCK);
-    if (ttyfd == -1)
-        return Error_OS(errno);
-
-    TtyAttributes* prior_attr;
-    Option(Error*) e_get = Trap_Get_Serial_Settings(&prior_attr, ttyfd);
-    if (e_get) {
-        close(ttyfd);
-        return e_get;
+    for (int i = 0; i < num_chunks and count < SERIAL_MAX_IOV; ++i) {
+        Size offset = (i == 0) ? skip : 0;
+        if (chunks[i].length == offset)
+            continue;
+        iov[count].iov_base = m_cast(Byte*, chunks[i].data + offset);
+        iov[count].iov_len = chunks[i].length - offset;
+        *requested += chunks[i].length - offset;
+        ++count;
     }
-    serial->prior_attr = prior_attr;
 
-    Option(Error*) e_set = Trap_Set_Serial_Settings(ttyfd, serial);
-    if (e_set) {
-        close(ttyfd);
-        return e_set;
+    if (count == 0)
+        return 0;
+
+    SizeOrNegative result = writev(ttyfd, iov, count);
+    Serial_Stat_Add(stats->writes, 1);
+    if (result >= 0) {
+        if (capture)
+            Capture_Iovecs(
+                unwrap capture, SERIAL_CAPTURE_TRANSMITTED, iov, count, result
+            );
+        Serial_Stat_Add(stats->bytes_out, result);
     }
+    else if (errno == EAGAIN)
+        Serial_Stat_Add(stats->would_block, 1);
+    return result;
+}
 
-    serial->handle = p_cast(void*, i_cast(intptr_t, ttyfd));
-    return SUCCESS;
+
+//
+//  Skip_Written_Chunk_Bytes: C
+//
+// Advance the (index, skip) position in the chunk list past `n` bytes which
+// the driver has taken, stepping over any chunks that are now finished.
+//
+static void Skip_Written_Chunk_Bytes(
+    int* index,
+    Size* skip,
+    const SerialChunk* chunks,
+    int num_chunks,
+    Size n
+){
+    while (*index < num_chunks and chunks[*index].length - *skip <= n) {
+        n -= chunks[*index].length - *skip;
+        ++(*index);
+        *skip = 0;
+    }
+    *skip += n;
 }
 
 
 //
-//  Trap_Read_Serial: C
+//  Serial_Poll_Callback: C
 //
-Option(Error*) Trap_Read_Serial(SerialConnection* serial)
+// Runs inside uv_run() when the descriptor becomes ready for something that
+// was asked for.  Transfers are finished here, and the interest bit is
+// cleared once the request is satisfied (or failed), which is what releases
+// a waiter in Trap_Await_Serial().  UV_WRITABLE interest lasts for as long
+// as there is outbound backlog, whether or not anyone is waiting on it.
+//
+// 1. Errors can't be raised from inside a loop callback, so the errno is
+//    stashed for the next waiter (or WRITE) to turn into an Error*.
+//
+static void Serial_Poll_Callback(uv_poll_t* poll, int status, int events)
 {
-    assert(serial->handle != nullptr);
+    SerialConnection* serial = cast(SerialConnection*, poll->data);
     TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
         p_cast(intptr_t, serial->handle)
     );
 
-    SizeOrNegative result = read(ttyfd, serial->data, serial->length);
+    if (status < 0) {
+        serial->pending_errno = -status;  // libuv codes are -errno on POSIX
+        serial->awaiting = 0;
+        goto update_interest;
+    }
 
-  #if DEBUG_SERIAL_EXTENSION
-    printf("read %d ret: %d\n", serial->length, result);
-  #endif
+    if ((events & UV_READABLE) and (serial->awaiting & UV_READABLE)) {
+        SizeOrNegative result = Read_Tty_Into_Ring(
+            &serial->stats, serial->capture, &serial->stamps,
+            ttyfd, &serial->in_ring
+        );
+        if (result > 0) {
+            serial->actual = result;
+            serial->awaiting &= ~UV_READABLE;
+        }
+        else if (result == -1 and errno != EAGAIN and errno != EINTR) {
+            serial->pending_errno = errno;  // report from waiter [1]
+            serial->awaiting &= ~UV_READABLE;
+        }
+    }
 
-    if (result == -1)
-        return Error_OS(errno);
+    if ((events & UV_WRITABLE) and (serial->awaiting & UV_WRITABLE)) {
+        SerialRing* out = &serial->out_ring;  // flush backlog, see [E]
+        Size requested;
+        SizeOrNegative result = Writev_Tty(
+            &requested, &serial->stats, serial->capture,
+            ttyfd, out, nullptr, 0, 0
+        );
+        if (result >= 0) {
+            Serial_Ring_Discard(out, result);
+            if (Serial_Ring_Used(out) == 0)
+                serial->awaiting &= ~UV_WRITABLE;
+        }
+        else if (errno != EAGAIN and errno != EINTR) {
+            serial->pending_errno = errno;  // report from waiter [1]
+            serial->awaiting &= ~UV_WRITABLE;
+            Serial_Ring_Discard(out, Serial_Ring_Used(out));  // can't send
+        }
+    }
 
-    if (result == 0)
-        panic ("The original implementation queued PENDING here");
+  update_interest: {
 
-    serial->actual = result;
+    if (serial->awaiting == 0)
+        uv_poll_stop(poll);
+    else
+        uv_poll_start(poll, serial->awaiting, &Serial_Poll_Callback);
+}}
 
-    panic ("The original implementation posted a WAS-READ event here");
+
+//
+//  Monotonic_Msec: C
+//
+static int64_t Monotonic_Msec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return cast(int64_t, ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
 }
 
 
 //
-//  Trap_Write_Serial: C
+//  Monotonic_Usec: C
 //
-Option(Error*) Trap_Write_Serial(SerialConnection* serial)
+static int64_t Monotonic_Usec(void)
 {
-    assert(serial->handle != nullptr);
-    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
-        p_cast(intptr_t, serial->handle)
-    );
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return cast(int64_t, ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
 
-    Size len = serial->length - serial->actual;
 
-    if (len <= 0)
-        panic ("The original implementation returned DONE here");
+//
+//  Run_Loop_Once: C
+//
+// One turn of the libuv loop on behalf of a READ or WRITE waiting on the
+// device, with the time charged to the port's stats.
+//
+static void Run_Loop_Once(SerialConnection* serial)
+{
+    int64_t start = Monotonic_Usec();
+    uv_run(uv_default_loop(), UV_RUN_ONCE);
+    Serial_Stat_Add(serial->stats.blocked_usec, Monotonic_Usec() - start);
+}
 
-    SizeOrNegative result = write(ttyfd, serial->data, len);
 
-  #if DEBUG_SERIAL_EXTENSION
-    printf("write %d ret: %d\n", len, result);
-  #endif
+//
+//  Serial_Timer_Callback: C
+//
+static void Serial_Timer_Callback(uv_timer_t* timer)
+{
+    UNUSED(timer);  // only needs to make uv_run() return
+}
 
-    if (result == -1) {
-        if (errno == EAGAIN)
-            panic ("The original implementation queued PENDING here");
 
-        return Error_OS(errno);
-    }
+//
+//  Serial_Timer_Closed: C
+//
+static void Serial_Timer_Closed(uv_handle_t* handle)
+{
+    rebFree(handle);
+}
 
-    serial->actual += result;
-    serial->data += result;
 
-    if (serial->actual >= serial->length)
-        panic ("The original implementation posted a WAS-WRITTEN event here");
+//
+//  Run_Loop_Once_Within: C
+//
+// Like Run_Loop_Once(), but returns after `msec` even if nothing happens.
+//
+static void Run_Loop_Once_Within(SerialConnection* serial, int64_t msec)
+{
+    uv_timer_t* timer = rebAlloc(uv_timer_t);
+    uv_timer_init(uv_default_loop(), timer);
+    uv_timer_start(timer, &Serial_Timer_Callback, msec, 0);
+
+    Run_Loop_Once(serial);
 
-    panic ("The original implementation queued PENDING here");
+    uv_close(cast(uv_handle_t*, timer), &Serial_Timer_Closed);  // stops it
 }
 
 
 //
-//  Trap_Close_Serial: C
+//  Trap_Take_Pending_Error: C
 //
-Option(Error*) Trap_Close_Serial(SerialConnection* serial)
+static Option(Error*) Trap_Take_Pending_Error(SerialConnection* serial)
 {
-    assert(serial->handle != nullptr);
+    if (serial->pending_errno == 0)
+        return SUCCESS;
 
-    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
-        p_cast(intptr_t, serial->handle)
+    int errno_copy = serial->pending_errno;
+    serial->pending_errno = 0;
+    return Error_OS(errno_copy);
+}
+
+
+//
+//  Trap_Want_Serial: C
+//
+// Add `events` to the descriptor's poll interest, without waiting.
+//
+static Option(Error*) Trap_Want_Serial(SerialConnection* serial, int events)
+{
+    uv_poll_t* poll = cast(uv_poll_t*, serial->poll);
+    assert(poll != nullptr);
+
+    if ((serial->awaiting & events) == events)
+        return SUCCESS;
+
+    serial->awaiting |= events;
+    int r = uv_poll_start(poll, serial->awaiting, &Serial_Poll_Callback);
+    if (r < 0) {
+        serial->awaiting &= ~events;
+        return Error_User(uv_strerror(r));
+    }
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Await_Serial: C
+//
+// Add `events` to the descriptor's poll interest and run the libuv loop
+// until the callback has cleared them.  See [C] at top of file.
+//
+static Option(Error*) Trap_Await_Serial(SerialConnection* serial, int events)
+{
+    Option(Error*) e = Trap_Want_Serial(serial, events);
+    if (e)
+        return e;
+
+    while (serial->awaiting & events)
+        Run_Loop_Once(serial);
+
+    return Trap_Take_Pending_Error(serial);
+}
+
+
+//
+//  Serial_Poll_Closed: C
+//
+// uv_close() is asynchronous, so the uv_poll_t can't be freed until the loop
+// says it is done with it.  It is not tied to the SerialConnection's lifetime.
+//
+static void Serial_Poll_Closed(uv_handle_t* handle)
+{
+    rebFree(handle);
+}
+
+
+//
+//  Trap_Poll_Until_Deadline: C
+//
+// Wait for `events` on the descriptor in blocking mode, see [D] at top of
+// file.  Passing the deadline is not an error: it just leaves *ready false.
+//
+// 1. A hung up tty (e.g. the master side of a pty closed, or a USB adapter
+//    unplugged) reports POLLHUP forever, so don't treat it as readable.
+//
+static Option(Error*) Trap_Poll_Until_Deadline(
+    Sink(bool) ready,
+    SerialStats* stats,
+    TtyFileDescriptor ttyfd,
+    short events,
+    int64_t deadline
+){
+    while (true) {
+        int64_t remaining = deadline - Monotonic_Msec();
+        if (remaining < 0)
+            remaining = 0;
+
+        struct pollfd pfd;
+        pfd.fd = ttyfd;
+        pfd.events = events;
+        pfd.revents = 0;
+
+        int64_t start = Monotonic_Usec();
+        int n = poll(&pfd, 1, cast(int, remaining));
+        Serial_Stat_Add(stats->blocked_usec, Monotonic_Usec() - start);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return Error_OS(errno);
+        }
+
+        if (n == 0) {
+            *ready = false;
+            return SUCCESS;
+        }
+
+        if (pfd.revents & POLLNVAL)
+            return Error_OS(EBADF);
+
+        if (pfd.revents & POLLERR)
+            return Error_OS(EIO);
+
+        if ((pfd.revents & POLLHUP) and not (pfd.revents & events))
+            return Error_OS(EIO);  // hung up [1]
+
+        *ready = true;
+        return SUCCESS;
+    }
+}
+
+
+//
+//  Trap_Read_Serial_Blocking: C
+//
+static Option(Error*) Trap_Read_Serial_Blocking(
+    SerialConnection* serial,
+    TtyFileDescriptor ttyfd,
+    int64_t deadline
+){
+    while (true) {
+        bool ready;
+        Option(Error*) e = Trap_Poll_Until_Deadline(
+            &ready, &serial->stats, ttyfd, POLLIN, deadline
+        );
+        if (e)
+            return e;
+
+        if (not ready)
+            return SUCCESS;  // timed out, serial->actual is 0
+
+        SizeOrNegative result = Read_Tty_Into_Ring(
+            &serial->stats, serial->capture, &serial->stamps,
+            ttyfd, &serial->in_ring
+        );
+        if (result > 0) {
+            serial->actual = result;
+            return SUCCESS;
+        }
+
+        if (result == -1 and errno != EAGAIN and errno != EINTR)
+            return Error_OS(errno);
+    }
+}
+
+
+//
+//  Trap_Write_Serial_Blocking: C
+//
+static Option(Error*) Trap_Write_Serial_Blocking(
+    SerialConnection* serial,
+    TtyFileDescriptor ttyfd
+){
+    assert(Serial_Ring_Used(&serial->out_ring) == 0);  // no backlog [D]
+
+    int64_t deadline = Monotonic_Msec() + serial->timeout_msec;
+
+    int index = 0;
+    Size skip = 0;
+
+    while (index < serial->num_chunks) {
+        bool ready;
+        Option(Error*) e = Trap_Poll_Until_Deadline(
+            &ready, &serial->stats, ttyfd, POLLOUT, deadline
+        );
+        if (e)
+            return e;
+
+        if (not ready)
+            return Error_User("Serial WRITE timed out");
+
+        Size requested;
+        SizeOrNegative result = Writev_Tty(
+            &requested,
+            &serial->stats,
+            serial->capture,
+            ttyfd,
+            &serial->out_ring,
+            serial->chunks + index,
+            serial->num_chunks - index,
+            skip
+        );
+        if (result == -1) {
+            if (errno != EAGAIN and errno != EINTR)
+                return Error_OS(errno);
+            continue;
+        }
+
+        Skip_Written_Chunk_Bytes(
+            &index, &skip, serial->chunks, serial->num_chunks, result
+        );
+        serial->actual += result;
+    }
+
+    return SUCCESS;
+}
+
+
+//=//// I/O THREAD ////////////////////////////////////////////////////////=//
+//
+// See [F] at top of file.  Fields shared between the two threads (aside from
+// the rings, which manage themselves) are accessed with __atomic builtins.
+//
+
+typedef struct {
+    pthread_t thread;
+    int wake_fds[2];  // pipe, for the interpreter to wake the thread
+    uv_async_t* async;  // for the thread to wake the interpreter's loop
+    bool stop;  // set by interpreter to ask the thread to exit
+    bool stalled;  // thread stopped reading because the receive ring is full
+    bool idle;  // thread stopped asking for POLLOUT, outbound ring was empty
+    int error;  // errno that ended the thread, 0 if it's still running
+    Size seen;  // receive ring head as of the last read, interpreter only
+} SerialThread;
+
+
+//
+//  Wake_Serial_Thread: C
+//
+static void Wake_Serial_Thread(SerialThread* t)
+{
+    Byte b = 0;
+    SizeOrNegative result = write(t->wake_fds[1], &b, 1);
+    UNUSED(result);  // if the pipe is full, a wakeup is already pending
+}
+
+
+//
+//  Serial_Thread_Main: C
+//
+// 1. When the interpreter falls behind and the receive ring fills, stop
+//    asking for POLLIN (the kernel buffers meanwhile).  The `stalled` flag
+//    tells the reader side it needs to wake the thread after consuming.
+//    The ring is checked again after the flag is set, with a full fence on
+//    both sides: otherwise the interpreter could consume and find the flag
+//    not yet set between the two, and neither side would wake the other.
+//    `idle` does the same for the outbound ring.
+//
+// 2. Bytes in the outbound ring are written as soon as the tty will take
+//    them, and the interpreter is notified since a WRITE may be waiting for
+//    the space.
+//
+static void* Serial_Thread_Main(void* arg)
+{
+    SerialConnection* serial = cast(SerialConnection*, arg);
+    SerialThread* t = cast(SerialThread*, serial->thread);
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+    SerialRing* in = &serial->in_ring;
+    SerialRing* out = &serial->out_ring;
+
+    int error = 0;
+
+    while (not __atomic_load_n(&t->stop, __ATOMIC_ACQUIRE)) {
+        struct pollfd pfd[2];
+        pfd[0].fd = ttyfd;
+        pfd[0].events = 0;
+        pfd[0].revents = 0;
+        pfd[1].fd = t->wake_fds[0];
+        pfd[1].events = POLLIN;
+        pfd[1].revents = 0;
+
+        if (Serial_Ring_Free(in) == 0) {
+            __atomic_store_n(&t->stalled, true, __ATOMIC_RELAXED);  // [1]
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        }
+        if (Serial_Ring_Free(in) != 0)
+            pfd[0].events |= POLLIN;
+
+        if (Serial_Ring_Used(out) == 0) {
+            __atomic_store_n(&t->idle, true, __ATOMIC_RELAXED);  // [1]
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        }
+        if (Serial_Ring_Used(out) != 0)
+            pfd[0].events |= POLLOUT;
+
+        if (poll(pfd, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            error = errno;
+            break;
+        }
+
+        if (pfd[1].revents & POLLIN) {
+            Byte drain[16];
+            while (read(t->wake_fds[0], drain, sizeof(drain)) > 0)
+                continue;
+        }
+
+        if (pfd[0].revents & POLLNVAL) {
+            error = EBADF;
+            break;
+        }
+
+        if (
+            (pfd[0].revents & (POLLERR | POLLHUP))
+            and not (pfd[0].revents & pfd[0].events)
+        ){
+            error = EIO;
+            break;
+        }
+
+        bool notify = false;
+
+        if (pfd[0].revents & POLLIN) {
+            SizeOrNegative result = Read_Tty_Into_Ring(
+                &serial->stats, serial->capture, &serial->stamps,
+                ttyfd, in
+            );
+            if (result > 0)
+                notify = true;
+            else if (result == -1 and errno != EAGAIN and errno != EINTR) {
+                error = errno;
+                break;
+            }
+        }
+
+        if (pfd[0].revents & POLLOUT) {  // [2]
+            Size requested;
+            SizeOrNegative result = Writev_Tty(
+                &requested, &serial->stats, serial->capture,
+                ttyfd, out, nullptr, 0, 0
+            );
+            if (result > 0) {
+                Serial_Ring_Discard(out, result);
+                notify = true;
+            }
+            else if (result == -1 and errno != EAGAIN and errno != EINTR) {
+                error = errno;
+                break;
+            }
+        }
+
+        if (notify)
+            uv_async_send(t->async);
+    }
+
+    __atomic_store_n(&t->error, error, __ATOMIC_RELEASE);
+    uv_async_send(t->async);  // let any waiter notice
+    return nullptr;
+}
+
+
+//
+//  Serial_Async_Callback: C
+//
+// Nothing to do: the point of the uv_async_send() is to make uv_run() return
+// so the waiter rechecks the rings.
+//
+static void Serial_Async_Callback(uv_async_t* async)
+{
+    UNUSED(async);
+}
+
+
+//
+//  Serial_Async_Closed: C
+//
+static void Serial_Async_Closed(uv_handle_t* handle)
+{
+    rebFree(handle);
+}
+
+
+//
+//  Trap_Take_Thread_Error: C
+//
+// Once the thread has died, every further operation reports why.
+//
+static Option(Error*) Trap_Take_Thread_Error(SerialThread* t)
+{
+    int error = __atomic_load_n(&t->error, __ATOMIC_ACQUIRE);
+    if (error == 0)
+        return SUCCESS;
+    return Error_OS(error);
+}
+
+
+//
+//  Trap_Start_Serial_Thread: C
+//
+static Option(Error*) Trap_Start_Serial_Thread(SerialConnection* serial)
+{
+    SerialThread* t = rebAlloc(SerialThread);
+    memset(t, 0, sizeof(SerialThread));
+    t->seen = serial->in_ring.head;
+
+    if (pipe(t->wake_fds) != 0) {
+        int errno_copy = errno;
+        rebFree(t);
+        return Error_OS(errno_copy);
+    }
+    fcntl(t->wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(t->wake_fds[1], F_SETFL, O_NONBLOCK);
+
+    t->async = rebAlloc(uv_async_t);
+    int r = uv_async_init(uv_default_loop(), t->async, &Serial_Async_Callback);
+    if (r < 0) {
+        rebFree(t->async);
+        close(t->wake_fds[0]);
+        close(t->wake_fds[1]);
+        rebFree(t);
+        return Error_User(uv_strerror(r));
+    }
+
+    serial->thread = t;
+
+    int err = pthread_create(&t->thread, nullptr, &Serial_Thread_Main, serial);
+    if (err != 0) {
+        uv_close(cast(uv_handle_t*, t->async), &Serial_Async_Closed);
+        close(t->wake_fds[0]);
+        close(t->wake_fds[1]);
+        rebFree(t);
+        serial->thread = nullptr;
+        return Error_OS(err);
+    }
+
+    return SUCCESS;
+}
+
+
+//
+//  Stop_Serial_Thread: C
+//
+static void Stop_Serial_Thread(SerialConnection* serial)
+{
+    SerialThread* t = cast(SerialThread*, serial->thread);
+
+    __atomic_store_n(&t->stop, true, __ATOMIC_RELEASE);
+    Wake_Serial_Thread(t);
+    pthread_join(t->thread, nullptr);
+
+    uv_close(cast(uv_handle_t*, t->async), &Serial_Async_Closed);
+    close(t->wake_fds[0]);
+    close(t->wake_fds[1]);
+    rebFree(t);
+    serial->thread = nullptr;
+}
+
+
+//
+//  Resume_Serial_Reading: C
+//
+// Called by whatever consumes from the receive ring once it has, so an I/O
+// thread that stopped reading because the ring was full starts again now,
+// rather than at the next READ.  See [1] on Serial_Thread_Main().
+//
+void Resume_Serial_Reading(SerialConnection* serial)
+{
+    SerialThread* t = cast(SerialThread*, serial->thread);
+    if (not t)
+        return;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);  // order vs. consumption
+    if (__atomic_exchange_n(&t->stalled, false, __ATOMIC_ACQ_REL))
+        Wake_Serial_Thread(t);
+}
+
+
+//
+//  Trap_Read_Serial_Threaded: C
+//
+// The thread fills the ring on its own, so bytes in it when this is called
+// may be ones the caller already looked at and left there (e.g. a partial
+// frame).  What counts as read is what the thread added since the last read
+// returned, which may have come in before this was called.
+//
+static Option(Error*) Trap_Read_Serial_Threaded(SerialConnection* serial)
+{
+    SerialThread* t = cast(SerialThread*, serial->thread);
+    SerialRing* in = &serial->in_ring;
+
+    Resume_Serial_Reading(serial);
+
+    t->seen = Serial_Ring_Read_Mark(in, t->seen);
+    while (Serial_Ring_Load(in->head) == t->seen) {
+        Option(Error*) e = Trap_Take_Thread_Error(t);
+        if (e)
+            return e;
+
+        Run_Loop_Once(serial);
+    }
+
+    Size head = Serial_Ring_Load(in->head);
+    serial->actual = head - t->seen;
+    t->seen = head;
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Write_Serial_Threaded: C
+//
+// Copy the chunks into the outbound ring for the thread to send.  The thread
+// only needs waking if it saw the ring empty, since otherwise it is already
+// waiting for POLLOUT (and re-evaluates the ring after each write).  See [1]
+// on Serial_Thread_Main() for why that's decided after producing.
+//
+static Option(Error*) Trap_Write_Serial_Threaded(SerialConnection* serial)
+{
+    SerialThread* t = cast(SerialThread*, serial->thread);
+    SerialRing* out = &serial->out_ring;
+
+    for (int i = 0; i < serial->num_chunks; ++i) {
+        const Byte* at = serial->chunks[i].data;
+        Size left = serial->chunks[i].length;
+
+        while (left != 0) {
+            Option(Error*) e = Trap_Take_Thread_Error(t);
+            if (e)
+                return e;
+
+            Size n = Serial_Ring_Free(out);
+            if (n == 0) {
+                Run_Loop_Once(serial);  // wait for space
+                continue;
+            }
+            if (n > left)
+                n = left;
+
+            Serial_Ring_Produce(out, at, n);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_exchange_n(&t->idle, false, __ATOMIC_ACQ_REL))
+                Wake_Serial_Thread(t);
+            Serial_Stat_Max(&serial->stats.max_backlog, Serial_Ring_Used(out));
+
+            at += n;
+            left -= n;
+            serial->actual += n;
+        }
+    }
+
+    return SUCCESS;
+}
+
+
+//=//// MULTIPLEXED WAIT //////////////////////////////////////////////////=//
+//
+// See [G] at top of file.
+//
+
+static uintptr_t g_serial_wait_tick = 0;  // distinguishes Trap_Wait_Serials()
+
+#if defined(__linux__)
+    static int g_serial_epoll_fd = -1;  // created on first open
+    static uv_poll_t* g_serial_epoll_poll = nullptr;  // loop's view of it
+
+
+//
+//  Trap_Watch_Serial: C
+//
+static Option(Error*) Trap_Watch_Serial(
+    SerialConnection* serial,
+    TtyFileDescriptor ttyfd
+){
+    if (g_serial_epoll_fd == -1) {
+        g_serial_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (g_serial_epoll_fd == -1)
+            return Error_OS(errno);
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = serial;
+    if (epoll_ctl(g_serial_epoll_fd, EPOLL_CTL_ADD, ttyfd, &ev) != 0)
+        return Error_OS(errno);
+
+    serial->wait_disarmed = false;
+    return SUCCESS;
+}
+
+
+//
+//  Set_Serial_Watched: C
+//
+static void Set_Serial_Watched(
+    SerialConnection* serial,
+    TtyFileDescriptor ttyfd,
+    bool watched
+){
+    struct epoll_event ev;
+    ev.events = watched ? EPOLLIN : 0;
+    ev.data.ptr = serial;
+    epoll_ctl(g_serial_epoll_fd, EPOLL_CTL_MOD, ttyfd, &ev);
+    serial->wait_disarmed = not watched;
+}
+
+
+//
+//  Unwatch_Serial: C
+//
+static void Unwatch_Serial(TtyFileDescriptor ttyfd)
+{
+    epoll_ctl(g_serial_epoll_fd, EPOLL_CTL_DEL, ttyfd, nullptr);
+}
+
+
+//
+//  Serial_Epoll_Callback: C
+//
+static void Serial_Epoll_Callback(uv_poll_t* poll, int status, int events)
+{
+    UNUSED(poll);  // only needs to make uv_run() return
+    UNUSED(status);
+    UNUSED(events);
+}
+
+
+//
+//  Trap_Run_Loop_Until_Watched: C
+//
+// One turn of the libuv loop, which returns when a port in the epoll set is
+// readable, or after `msec` if it's not negative.  The epoll descriptor is
+// itself readable when any of its descriptors are, so the loop can watch
+// all the ports through it.
+//
+static Option(Error*) Trap_Run_Loop_Until_Watched(int msec)
+{
+    if (g_serial_epoll_poll == nullptr) {
+        uv_poll_t* poll = rebAlloc(uv_poll_t);
+        int r = uv_poll_init(uv_default_loop(), poll, g_serial_epoll_fd);
+        if (r < 0) {
+            rebFree(poll);
+            return Error_User(uv_strerror(r));
+        }
+        g_serial_epoll_poll = poll;  // lives as long as the epoll descriptor
+    }
+
+    int r = uv_poll_start(
+        g_serial_epoll_poll, UV_READABLE, &Serial_Epoll_Callback
+    );
+    if (r < 0)
+        return Error_User(uv_strerror(r));
+
+    uv_timer_t* timer = nullptr;
+    if (msec >= 0) {
+        timer = rebAlloc(uv_timer_t);
+        uv_timer_init(uv_default_loop(), timer);
+        uv_timer_start(timer, &Serial_Timer_Callback, msec, 0);
+    }
+
+    uv_run(uv_default_loop(), UV_RUN_ONCE);
+
+    uv_poll_stop(g_serial_epoll_poll);  // so it doesn't keep the loop alive
+    if (timer)
+        uv_close(cast(uv_handle_t*, timer), &Serial_Timer_Closed);
+    return SUCCESS;
+}
+
+#endif
+
+
+//
+//  Note_Serial_Readiness: C
+//
+// Called for a descriptor the kernel says is readable.  Pull what's there
+// into the receive ring, and report whether the connection should count as
+// ready (data buffered, or an error that a READ should surface).
+//
+static bool Note_Serial_Readiness(SerialConnection* serial, bool hangup)
+{
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    bool failed = hangup;
+    if (Serial_Ring_Free(&serial->in_ring) != 0) {
+        SizeOrNegative result = Read_Tty_Into_Ring(
+            &serial->stats, serial->capture, &serial->stamps,
+            ttyfd, &serial->in_ring
+        );
+        if (result == -1 and errno != EAGAIN and errno != EINTR)
+            failed = true;
+    }
+
+  #if defined(__linux__)
+    if (failed or Serial_Ring_Free(&serial->in_ring) == 0)
+        Set_Serial_Watched(serial, ttyfd, false);  // until next READ
+  #endif
+
+    return failed or Serial_Ring_Used(&serial->in_ring) != 0;
+}
+
+
+//=//// EXPORTED FUNCTIONS ////////////////////////////////////////////////=//
+
+
+//
+//  Get_Serial_Device_Path: C
+//
+// Fills path_utf8 (of MAX_SERIAL_PATH) with the path to open, giving false
+// if it doesn't fit.
+//
+static bool Get_Serial_Device_Path(char* path_utf8, SerialConnection* serial)
+{
+    assert(serial->path != nullptr);
+
+    Size size = rebSpellInto(
+        path_utf8,
+        MAX_SERIAL_PATH,
+        serial->path
+    );
+    if (size >= MAX_SERIAL_PATH)
+        return false;
+
+    if (path_utf8[0] != '/') {  // relative path, insert `/dev/` before it
+        if (size + 5 >= MAX_SERIAL_PATH)
+            return false;
+        memmove(path_utf8 + 5, path_utf8, size + 1);
+        memcpy(path_utf8, "/dev/", 5);
+    }
+    return true;
+}
+
+
+//
+//  Trap_Prep_Serial_Opening: C
+//
+// The parts of opening that use the API, done before Open_Serial_Device().
+//
+static Option(Error*) Trap_Prep_Serial_Opening(
+    SerialOpening* opening,
+    SerialConnection* serial
+){
+    assert(serial->path != nullptr);
+
+    opening->serial = serial;
+    opening->ttyfd = -1;
+    opening->failure = 0;
+
+    if (not Get_Serial_Device_Path(opening->path, serial))
+        return Error_User("Serial path too long for MAX_SERIAL_PATH");
+
+    serial->prior_attr = rebAlloc(TtyAttributes);
+    return SUCCESS;
+}
+
+
+//
+//  Get_Serial_Share_Key: C
+//
+// The device's path with symlinks resolved, so that two names for the same
+// device share it.  See %serial-share.c
+//
+bool Get_Serial_Share_Key(char* key, Size size, SerialConnection* serial)
+{
+    char path_utf8[MAX_SERIAL_PATH];
+    if (not Get_Serial_Device_Path(path_utf8, serial))
+        return false;
+
+    char resolved[PATH_MAX];
+    const char* path = realpath(path_utf8, resolved)
+        ? resolved
+        : path_utf8;  // let the open report why it doesn't exist
+
+    if (strlen(path) >= size)
+        return false;
+    strcpy(key, path);
+    return true;
+}
+
+
+//
+//  Close_Serial_Device: C
+//
+// Puts back what Open_Serial_Device() changed, the latency [I] and RS-485
+// mode [P] included, and closes the descriptor.  Only makes system calls, so
+// it may run on a worker [L].  Gives back 0, or errno if the prior settings
+// couldn't be put back.  The caller frees prior_attr.
+//
+static int Close_Serial_Device(
+    TtyFileDescriptor ttyfd,
+    SerialConnection* serial
+){
+    Restore_Serial_Latency(ttyfd, serial);
+    Restore_Serial_Rs485(ttyfd, serial);
+
+    int failure = 0;
+    TtyAttributes* prior_attr = cast(TtyAttributes*, serial->prior_attr);
+    if (tcsetattr(ttyfd, TCSANOW, prior_attr) != 0)
+        failure = errno;  // before close() may change errno
+
+    close(ttyfd);
+    return failure;
+}
+
+
+//
+//  Open_Serial_Device: C
+//
+// Opens and configures the device, which is what takes the time (USB adapters
+// do control transfers for it).  May run on a worker thread [L], so it only
+// makes system calls, and reports problems in opening->failure.
+//
+static void Open_Serial_Device(SerialOpening* opening)
+{
+    SerialConnection* serial = opening->serial;
+
+    TtyFileDescriptor ttyfd = open(
+        opening->path, O_RDWR | O_NOCTTY | O_NONBLOCK
+    );
+    if (ttyfd == -1) {
+        opening->failure = errno;
+        return;
+    }
+
+    if (tcgetattr(ttyfd, serial->prior_attr) != 0) {
+        opening->failure = errno;
+        close(ttyfd);
+        return;
+    }
+
+    serial->max_baud_rate = Probe_Max_Baud_Rate(ttyfd);  // see [H]
+    serial->prior_latency_timer_msec = -1;  // see [I]
+    serial->set_low_latency = false;
+    serial->set_rs485 = false;  // see [P]
+
+    int failure = Set_Serial_Settings(ttyfd, serial, TCSANOW);
+    if (failure) {  // (e.g. no RS-485 mode, after latency and termios set)
+        opening->failure = failure;
+        Close_Serial_Device(ttyfd, serial);
+        return;
+    }
+
+    opening->ttyfd = ttyfd;
+}
+
+
+//
+//  Trap_Finish_Serial_Opening: C
+//
+// Registers the device opened by Open_Serial_Device() with the event loop or
+// the I/O thread, or gives back why it couldn't be opened.
+//
+static Option(Error*) Trap_Finish_Serial_Opening(SerialOpening* opening)
+{
+    SerialConnection* serial = opening->serial;
+
+    if (opening->failure) {
+        rebFree(serial->prior_attr);
+        serial->prior_attr = nullptr;
+        return Error_Serial_Failure(opening->failure);
+    }
+
+    TtyFileDescriptor ttyfd = opening->ttyfd;
+
+    Option(Error*) e_capture = Trap_Open_Serial_Capture(serial);  // see [M]
+    if (e_capture) {
+        Close_Serial_Device(ttyfd, serial);
+        rebFree(serial->prior_attr);
+        serial->prior_attr = nullptr;
+        return e_capture;
+    }
+
+    serial->poll = nullptr;
+    serial->thread = nullptr;
+    serial->awaiting = 0;
+    serial->pending_errno = 0;
+
+    if (serial->io_engine == SERIAL_IO_THREAD) {  // thread owns it [F]
+        assert(serial->timeout_msec < 0);
+        serial->handle = p_cast(void*, i_cast(intptr_t, ttyfd));
+        Option(Error*) e_thread = Trap_Start_Serial_Thread(serial);
+        if (e_thread) {
+            serial->handle = nullptr;
+            Close_Serial_Capture(serial);
+            Close_Serial_Device(ttyfd, serial);
+            rebFree(serial->prior_attr);
+            serial->prior_attr = nullptr;
+            return e_thread;
+        }
+        return SUCCESS;
+    }
+
+    if (serial->timeout_msec < 0) {
+        uv_poll_t* poll = rebAlloc(uv_poll_t);  // register with loop [C]
+        int r = uv_poll_init(uv_default_loop(), poll, ttyfd);
+        if (r < 0) {
+            rebFree(poll);
+            Close_Serial_Capture(serial);
+            Close_Serial_Device(ttyfd, serial);
+            rebFree(serial->prior_attr);
+            serial->prior_attr = nullptr;
+            return Error_User(uv_strerror(r));
+        }
+        poll->data = serial;
+        serial->poll = poll;
+    }
+
+  #if defined(__linux__)
+    Option(Error*) e_watch = Trap_Watch_Serial(serial, ttyfd);  // see [G]
+    if (e_watch) {
+        if (serial->poll) {
+            uv_close(cast(uv_handle_t*, serial->poll), &Serial_Poll_Closed);
+            serial->poll = nullptr;
+        }
+        Close_Serial_Capture(serial);
+        Close_Serial_Device(ttyfd, serial);
+        rebFree(serial->prior_attr);
+        serial->prior_attr = nullptr;
+        return e_watch;
+    }
+  #endif
+
+    serial->handle = p_cast(void*, i_cast(intptr_t, ttyfd));
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Open_Serial: C
+//
+// serial.path = the /dev name for the serial port
+// serial.baud = speed (baudrate)
+//
+Option(Error*) Trap_Open_Serial(SerialConnection* serial)
+{
+    SerialOpening opening;
+    Option(Error*) e = Trap_Prep_Serial_Opening(&opening, serial);
+    if (e)
+        return e;
+
+    Open_Serial_Device(&opening);
+    return Trap_Finish_Serial_Opening(&opening);
+}
+
+
+typedef struct {
+    SerialOpening* openings;
+    Length count;
+    Length next;  // next opening for a worker to claim
+} SerialOpeningBatch;
+
+
+//
+//  Serial_Opening_Worker: C
+//
+static void* Serial_Opening_Worker(void* arg)
+{
+    SerialOpeningBatch* batch = cast(SerialOpeningBatch*, arg);
+    while (true) {
+        Length n = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (n >= batch->count)
+            return nullptr;
+
+        SerialOpening* opening = &batch->openings[n];
+        if (opening->serial)  // else its prep failed
+            Open_Serial_Device(opening);
+    }
+}
+
+
+//
+//  Open_Serials: C
+//
+// Opens many connections at once, with up to max_workers of them doing the
+// slow part concurrently.  See [L].  errors[n] says if serials[n] failed.
+//
+void Open_Serials(
+    Option(Error*)* errors,
+    SerialConnection** serials,
+    Length count,
+    Length max_workers
+){
+    SerialOpening* openings = rebAllocN(SerialOpening, count);
+    for (Length n = 0; n < count; ++n) {
+        errors[n] = Trap_Prep_Serial_Opening(&openings[n], serials[n]);
+        if (errors[n])
+            openings[n].serial = nullptr;
+    }
+
+    SerialOpeningBatch batch;
+    batch.openings = openings;
+    batch.count = count;
+    batch.next = 0;
+
+    Length num_threads = (count < max_workers ? count : max_workers);
+    if (num_threads > 0)
+        --num_threads;  // this thread works too
+
+    pthread_t* threads = rebAllocN(pthread_t, num_threads + 1);
+    Length started = 0;
+    for (; started < num_threads; ++started) {
+        if (pthread_create(
+            &threads[started], nullptr, &Serial_Opening_Worker, &batch
+        ) != 0){
+            break;  // fewer workers, but the batch still gets done
+        }
+    }
+
+    Serial_Opening_Worker(&batch);
+
+    for (Length n = 0; n < started; ++n)
+        pthread_join(threads[n], nullptr);
+    rebFree(threads);
+
+    for (Length n = 0; n < count; ++n) {
+        if (openings[n].serial)
+            errors[n] = Trap_Finish_Serial_Opening(&openings[n]);
+    }
+    rebFree(openings);
+}
+
+
+//
+//  Trap_Read_Serial: C
+//
+// Reads whatever fits in the free part of the receive ring, setting
+// serial->actual to the number of bytes added.  If nothing has arrived yet,
+// the read is completed by the loop--so this only returns once at least one
+// byte has been read (or there was an error).  In blocking mode [D] it may
+// return with nothing if the deadline passed.
+//
+// 1. With VMIN=0 and VTIME=0 a read() of an idle tty returns 0 rather than
+//    failing with EAGAIN, so both mean "nothing yet".
+//
+Option(Error*) Trap_Read_Serial(SerialConnection* serial)
+{
+    assert(serial->handle != nullptr);
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    serial->actual = 0;
+
+    assert(Serial_Ring_Free(&serial->in_ring) != 0);  // caller should consume
+
+    if (serial->thread)
+        return Trap_Read_Serial_Threaded(serial);
+
+  #if defined(__linux__)
+    if (serial->wait_disarmed)  // ring was full for the multiplexer [G]
+        Set_Serial_Watched(serial, ttyfd, true);
+  #endif
+
+    if (serial->timeout_msec >= 0)
+        return Trap_Read_Serial_Blocking(
+            serial, ttyfd, Monotonic_Msec() + serial->timeout_msec
+        );
+
+    SizeOrNegative result = Read_Tty_Into_Ring(
+        &serial->stats, serial->capture, &serial->stamps,
+        ttyfd, &serial->in_ring
+    );
+
+  #if DEBUG_SERIAL_EXTENSION
+    printf("read ret: %d\n", result);
+  #endif
+
+    if (result > 0) {
+        serial->actual = result;
+        return SUCCESS;
+    }
+
+    if (result == -1 and errno != EAGAIN and errno != EINTR)
+        return Error_OS(errno);
+
+    return Trap_Await_Serial(serial, UV_READABLE);  // nothing yet [1]
+}
+
+
+//
+//  Trap_Read_Serial_Within: C
+//
+// Like Trap_Read_Serial(), but gives up after timeout_usec with nothing read
+// (serial->actual is 0).  For protocols that time silences on the line, so
+// it waits at least that long, rounding up to the loop's milliseconds.
+//
+// 1. A READABLE interest left behind would let the poll callback read into
+//    the ring later, when no one is waiting to be told about it.
+//
+// 2. Callers may leave bytes in the ring while they wait for more (as in
+//    %serial-transact.c), so what's new is what the I/O thread added since
+//    the last read returned.  See Trap_Read_Serial_Threaded().
+//
+Option(Error*) Trap_Read_Serial_Within(
+    SerialConnection* serial,
+    int32_t timeout_usec
+){
+    assert(serial->handle != nullptr);
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    serial->actual = 0;
+
+    assert(Serial_Ring_Free(&serial->in_ring) != 0);  // caller should consume
+
+    int64_t deadline = Monotonic_Usec() + timeout_usec;
+
+    if (serial->thread) {
+        SerialThread* t = cast(SerialThread*, serial->thread);
+        SerialRing* in = &serial->in_ring;
+
+        Resume_Serial_Reading(serial);
+
+        t->seen = Serial_Ring_Read_Mark(in, t->seen);  // [2]
+        while (Serial_Ring_Load(in->head) == t->seen) {
+            Option(Error*) e = Trap_Take_Thread_Error(t);
+            if (e)
+                return e;
+
+            int64_t left = deadline - Monotonic_Usec();
+            if (left <= 0)
+                return SUCCESS;
+            Run_Loop_Once_Within(serial, (left + 999) / 1000);
+        }
+
+        Size head = Serial_Ring_Load(in->head);
+        serial->actual = head - t->seen;
+        t->seen = head;
+        return SUCCESS;
+    }
+
+  #if defined(__linux__)
+    if (serial->wait_disarmed)
+        Set_Serial_Watched(serial, ttyfd, true);
+  #endif
+
+    if (serial->timeout_msec >= 0)
+        return Trap_Read_Serial_Blocking(
+            serial, ttyfd, (deadline + 999) / 1000
+        );
+
+    SizeOrNegative result = Read_Tty_Into_Ring(
+        &serial->stats, serial->capture, &serial->stamps,
+        ttyfd, &serial->in_ring
     );
+    if (result > 0) {
+        serial->actual = result;
+        return SUCCESS;
+    }
+    if (result == -1 and errno != EAGAIN and errno != EINTR)
+        return Error_OS(errno);
 
-    TtyAttributes* prior_attr = cast(TtyAttributes*, serial->prior_attr);
+    Option(Error*) e = Trap_Want_Serial(serial, UV_READABLE);
+    if (e)
+        return e;
 
-    int ret = tcsetattr(ttyfd, TCSANOW, prior_attr);
-    int errno_copy = errno;  // close() may change errno
+    while (serial->awaiting & UV_READABLE) {
+        int64_t left = deadline - Monotonic_Usec();
+        if (left <= 0)
+            break;
+        Run_Loop_Once_Within(serial, (left + 999) / 1000);
+    }
 
-    // !!! should we free serial->prior_attr?
+    if (serial->awaiting & UV_READABLE) {  // timed out [1]
+        uv_poll_t* poll = cast(uv_poll_t*, serial->poll);
+        serial->awaiting &= ~UV_READABLE;
+        if (serial->awaiting == 0)
+            uv_poll_stop(poll);
+        else
+            uv_poll_start(poll, serial->awaiting, &Serial_Poll_Callback);
+    }
 
-    close(ttyfd);
+    return Trap_Take_Pending_Error(serial);
+}
 
-    if (ret != 0)
-        return Error_OS(errno_copy);
 
+//
+//  Trap_Write_Serial: C
+//
+// Sends serial->chunks in order, setting serial->actual to the number of
+// bytes accepted.  In loop mode "accepted" may mean queued in the outbound
+// ring for the poll callback to finish, see [E].
+//
+// 1. A short writev() means the driver's buffer is full, so don't bother
+//    trying again until the poll says it's writable.
+//
+// 2. If the outbound ring is full, this waits until the callback has flushed
+//    it completely.  That's the backpressure for a writer outrunning the
+//    device, and avoids a wakeup per freed byte.
+//
+Option(Error*) Trap_Write_Serial(SerialConnection* serial)
+{
+    assert(serial->handle != nullptr);
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    serial->actual = 0;
+
+    if (serial->thread)
+        return Trap_Write_Serial_Threaded(serial);
+
+    if (serial->timeout_msec >= 0)
+        return Trap_Write_Serial_Blocking(serial, ttyfd);
+
+    Option(Error*) e = Trap_Take_Pending_Error(serial);  // from a flush
+    if (e)
+        return e;
+
+    SerialRing* out = &serial->out_ring;
+    const SerialChunk* chunks = serial->chunks;
+    int num_chunks = serial->num_chunks;
+
+    int index = 0;
+    Size skip = 0;
+
+    while (index < num_chunks) {
+        Size requested;
+        SizeOrNegative result = Writev_Tty(
+            &requested,
+            &serial->stats,
+            serial->capture,
+            ttyfd,
+            out,
+            chunks + index,
+            num_chunks - index,
+            skip
+        );
+
+      #if DEBUG_SERIAL_EXTENSION
+        printf("writev %d ret: %d\n", requested, result);
+      #endif
+
+        if (result == -1) {
+            if (errno != EAGAIN and errno != EINTR)
+                return Error_OS(errno);
+            break;
+        }
+
+        Size backlog = Serial_Ring_Used(out);
+        if (cast(Size, result) <= backlog) {
+            Serial_Ring_Discard(out, result);
+            break;  // driver full [1]
+        }
+        Serial_Ring_Discard(out, backlog);
+
+        Skip_Written_Chunk_Bytes(
+            &index, &skip, chunks, num_chunks, result - backlog
+        );
+        serial->actual += result - backlog;
+
+        if (cast(Size, result) < requested)
+            break;  // driver full [1]
+    }
+
+    for (; index < num_chunks; ++index, skip = 0) {  // queue what's left
+        const Byte* at = chunks[index].data + skip;
+        Size left = chunks[index].length - skip;
+
+        while (left != 0) {
+            if (Serial_Ring_Free(out) == 0) {
+                e = Trap_Await_Serial(serial, UV_WRITABLE);  // drain [2]
+                if (e)
+                    return e;
+            }
+
+            Size n = Serial_Ring_Free(out);
+            if (n > left)
+                n = left;
+
+            Serial_Ring_Produce(out, at, n);
+            Serial_Stat_Max(&serial->stats.max_backlog, Serial_Ring_Used(out));
+            at += n;
+            left -= n;
+            serial->actual += n;
+        }
+    }
+
+    if (Serial_Ring_Used(out) != 0)
+        return Trap_Want_Serial(serial, UV_WRITABLE);  // flush in callback
+
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Copy_File_To_Serial: C
+//
+// The part is read into a buffer and written like a BLOB!, see [N].
+//
+static Option(Error*) Trap_Copy_File_To_Serial(
+    Sink(Size) sent,
+    SerialConnection* serial,
+    int file_fd,
+    int64_t offset,
+    Size limit
+){
+    *sent = 0;
+
+    Option(Error*) e = SUCCESS;
+
+    Byte* buf = rebAllocN(Byte, limit);
+    Size got = 0;
+    while (got < limit) {
+        ssize_t result = pread(file_fd, buf + got, limit - got, offset + got);
+        if (result == 0)
+            break;
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            e = Error_OS(errno);
+            break;
+        }
+        got += result;
+    }
+
+    if (not e and got != 0) {
+        SerialChunk chunk;
+        chunk.data = buf;
+        chunk.length = got;
+        serial->chunks = &chunk;
+        serial->num_chunks = 1;
+
+        e = Trap_Write_Serial(serial);
+
+        serial->chunks = nullptr;
+        serial->num_chunks = 0;
+        if (not e)
+            *sent = got;
+    }
+
+    rebFree(buf);
+    return e;
+}
+
+
+#if defined(__linux__)
+
+//
+//  Trap_Sendfile_Serial: C
+//
+// See [N] at top of file.  Sets *unsupported instead of returning an error
+// if sendfile() can't be used with this file, so the caller can fall back.
+//
+// 1. Bytes from earlier WRITEs still in the outbound ring have to go first,
+//    and awaiting UV_WRITABLE returns once the callback has flushed them.
+//
+// 2. Since the file is sent as it's read, the timeout in blocking mode is
+//    how long the driver may go without taking anything, rather than a limit
+//    on the whole part.
+//
+static Option(Error*) Trap_Sendfile_Serial(
+    Sink(Size) sent,
+    Sink(bool) unsupported,
+    SerialConnection* serial,
+    TtyFileDescriptor ttyfd,
+    int file_fd,
+    int64_t offset,
+    Size limit
+){
+    *sent = 0;
+    *unsupported = false;
+
+    Option(Error*) e;
+    if (serial->timeout_msec < 0) {
+        e = Trap_Take_Pending_Error(serial);
+        if (e)
+            return e;
+        if (Serial_Ring_Used(&serial->out_ring) != 0) {  // [1]
+            e = Trap_Await_Serial(serial, UV_WRITABLE);
+            if (e)
+                return e;
+        }
+    }
+
+    off_t at = offset;
+    int64_t deadline = Monotonic_Msec() + serial->timeout_msec;
+
+    while (*sent < limit) {
+        ssize_t result = sendfile(ttyfd, file_fd, &at, limit - *sent);
+        Serial_Stat_Add(serial->stats.writes, 1);
+
+        if (result > 0) {
+            Serial_Stat_Add(serial->stats.bytes_out, result);
+            *sent += result;
+            deadline = Monotonic_Msec() + serial->timeout_msec;  // [2]
+            continue;
+        }
+        if (result == 0)
+            break;  // end of file
+
+        if (errno == EINTR)
+            continue;
+        if (errno == EINVAL or errno == ENOSYS) {
+            if (*sent == 0)
+                *unsupported = true;
+            else
+                return Error_OS(errno);
+            break;
+        }
+        if (errno != EAGAIN)
+            return Error_OS(errno);
+
+        Serial_Stat_Add(serial->stats.would_block, 1);
+
+        if (serial->timeout_msec < 0) {
+            e = Trap_Await_Serial(serial, UV_WRITABLE);
+            if (e)
+                return e;
+            continue;
+        }
+
+        bool ready;
+        e = Trap_Poll_Until_Deadline(
+            &ready, &serial->stats, ttyfd, POLLOUT, deadline
+        );
+        if (e)
+            return e;
+        if (not ready)
+            return Error_User("Serial WRITE timed out");
+    }
+
+    serial->actual = *sent;
+    return SUCCESS;
+}
+
+#endif
+
+
+//
+//  Trap_Send_Serial_File: C
+//
+// Sends up to `limit` bytes of the file from `offset`, setting *sent to how
+// many there were (less than `limit` only at the end of the file) and the
+// file's size.  The file is only open during the call.  See [N].
+//
+Option(Error*) Trap_Send_Serial_File(
+    Sink(Size) sent,
+    Sink(int64_t) file_size,
+    SerialConnection* serial,
+    const char* file_path,
+    int64_t offset,
+    Size limit
+){
+    assert(serial->handle != nullptr);
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    *sent = 0;
+    *file_size = 0;
+
+    int file_fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0)
+        return Error_OS(errno);
+
+    Option(Error*) e = SUCCESS;
+
+    struct stat st;
+    if (fstat(file_fd, &st) < 0) {
+        e = Error_OS(errno);
+        goto close_file;
+    }
+    *file_size = st.st_size;
+
+  #if defined(__linux__)
+    if (not serial->thread and not serial->capture) {
+        bool unsupported;
+        e = Trap_Sendfile_Serial(
+            sent, &unsupported, serial, ttyfd, file_fd, offset, limit
+        );
+        if (e or not unsupported)
+            goto close_file;
+    }
+  #else
+    UNUSED(ttyfd);
+  #endif
+
+    e = Trap_Copy_File_To_Serial(sent, serial, file_fd, offset, limit);
+
+  close_file: {
+
+    close(file_fd);
+    return e;
+}}
+
+
+//
+//  Trap_Close_Serial: C
+//
+Option(Error*) Trap_Close_Serial(SerialConnection* serial)
+{
+    assert(serial->handle != nullptr);
+
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    Option(Error*) e = SUCCESS;
+
+    if (serial->thread) {  // let the thread send what's queued, see [F]
+        SerialThread* t = cast(SerialThread*, serial->thread);
+        while (Serial_Ring_Used(&serial->out_ring) != 0) {
+            e = Trap_Take_Thread_Error(t);
+            if (e)
+                break;
+            uv_run(uv_default_loop(), UV_RUN_ONCE);
+        }
+        Stop_Serial_Thread(serial);
+    }
+    else if (Serial_Ring_Used(&serial->out_ring) != 0)  // drain backlog [E]
+        e = Trap_Await_Serial(serial, UV_WRITABLE);
+
+    uv_poll_t* poll = cast(uv_poll_t*, serial->poll);
+    if (poll) {  // not registered in blocking mode, see [D]
+        uv_close(cast(uv_handle_t*, poll), &Serial_Poll_Closed);
+        serial->poll = nullptr;
+        serial->awaiting = 0;
+    }
+
+  #if defined(__linux__)
+    if (g_serial_epoll_fd != -1)
+        Unwatch_Serial(ttyfd);  // (thread mode ports were never watched)
+  #endif
+
+    int failure = Close_Serial_Device(ttyfd, serial);  // see [I] and [P]
+
+    rebFree(serial->prior_attr);
+    serial->prior_attr = nullptr;
     serial->handle = nullptr;
+
+    int capture_failure = Close_Serial_Capture(serial);  // after the thread
+
+    if (e)
+        return e;
+
+    if (failure)
+        return Error_OS(failure);
+
+    if (capture_failure)
+        return Error_OS(capture_failure);
+
+    return SUCCESS;
+}
+
+
+//
+//  Get_Serial_Line_Errors: C
+//
+// See [B] at top of file.  Returns false if the driver doesn't count them.
+//
+bool Get_Serial_Line_Errors(
+    SerialLineErrors* errors,
+    SerialConnection* serial
+){
+    assert(serial->handle != nullptr);
+
+  #if defined(__linux__) && defined(TIOCGICOUNT)
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    struct serial_icounter_struct icount;
+    memset(&icount, 0, sizeof(icount));
+    if (ioctl(ttyfd, TIOCGICOUNT, &icount) == -1)
+        return false;  // e.g. ENOTTY or EINVAL for a pty
+
+    errors->frame = icount.frame;
+    errors->overrun = icount.overrun;
+    errors->parity = icount.parity;
+    errors->brk = icount.brk;
+    errors->buf_overrun = icount.buf_overrun;
+    return true;
+  #else
+    UNUSED(errors);
+    UNUSED(serial);
+    return false;
+  #endif
+}
+
+
+//
+//  Trap_Modify_Serial: C
+//
+// Apply the connection's line settings to the open device.  See [K].
+//
+Option(Error*) Trap_Modify_Serial(SerialConnection* serial)
+{
+    assert(serial->handle != nullptr);
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    bool drained;
+    Option(Error*) e = Trap_Drain_Serial(&drained, serial, -1);
+    if (e)
+        return e;
+
+    int failure = Set_Serial_Settings(ttyfd, serial, TCSADRAIN);
+    if (failure)
+        return Error_Serial_Failure(failure);
+
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Get_Serial_Queues: C
+//
+// Bytes the driver has received that aren't in the receive ring yet, and
+// bytes it has been given that aren't sent yet.  See [J] at top of file.
+//
+Option(Error*) Trap_Get_Serial_Queues(
+    Sink(Size) input,
+    Sink(Size) output,
+    SerialConnection* serial
+){
+    assert(serial->handle != nullptr);
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    int in_count;
+    if (ioctl(ttyfd, FIONREAD, &in_count) == -1)
+        return Error_OS(errno);
+
+    int out_count;
+    if (ioctl(ttyfd, TIOCOUTQ, &out_count) == -1)
+        return Error_OS(errno);
+
+    *input = in_count;
+    *output = out_count;
     return SUCCESS;
 }
+
+
+//
+//  Trap_Drain_Serial: C
+//
+// Wait until everything written has been transmitted, or timeout_msec
+// passes (-1 to wait indefinitely).  See [J] at top of file.
+//
+// 1. Each character is about 10 bits on the wire (start, 8 data, stop).
+//    The poll interval is kept between 1ms and 100ms.
+//
+Option(Error*) Trap_Drain_Serial(
+    Sink(bool) drained,
+    SerialConnection* serial,
+    int32_t timeout_msec
+){
+    assert(serial->handle != nullptr);
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    *drained = false;
+
+    int64_t deadline = (timeout_msec < 0)
+        ? INT64_MAX
+        : Monotonic_Msec() + timeout_msec;
+
+    SerialThread* t = cast(SerialThread*, serial->thread);
+    Option(Error*) e;
+
+    while (Serial_Ring_Used(&serial->out_ring) != 0) {  // blocking mode has 0
+        e = t ? Trap_Take_Thread_Error(t) : Trap_Take_Pending_Error(serial);
+        if (e)
+            return e;
+
+        int64_t remaining = deadline - Monotonic_Msec();
+        if (remaining <= 0)
+            return SUCCESS;
+
+        Run_Loop_Once_Within(serial, remaining);  // flushed by callback [E]
+    }
+
+    while (true) {
+        int queued;
+        if (ioctl(ttyfd, TIOCOUTQ, &queued) == -1) {
+            if (errno != ENOTTY and errno != EINVAL)
+                return Error_OS(errno);
+            if (tcdrain(ttyfd) == -1)  // can't be told, so have to block
+                return Error_OS(errno);
+            queued = 0;
+        }
+
+        if (queued == 0) {
+            *drained = true;
+            return SUCCESS;
+        }
+
+        int64_t remaining = deadline - Monotonic_Msec();
+        if (remaining <= 0)
+            return SUCCESS;
+
+        int64_t msec = cast(int64_t, queued) * 10 * 1000 / serial->baud_rate;
+        if (msec < 1)  // [1]
+            msec = 1;
+        else if (msec > 100)
+            msec = 100;
+        if (msec > remaining)
+            msec = remaining;
+
+        if (serial->timeout_msec >= 0) {  // blocking mode doesn't use loop [D]
+            int64_t start = Monotonic_Usec();
+            poll(nullptr, 0, cast(int, msec));
+            Serial_Stat_Add(
+                serial->stats.blocked_usec, Monotonic_Usec() - start
+            );
+        }
+        else
+            Run_Loop_Once_Within(serial, msec);
+    }
+}
+
+
+//
+//  Abandon_Serial: C
+//
+// Close without reporting errors, for when the PORT! holding the connection
+// is garbage collected while still open (can't create Error* during GC).
+//
+void Abandon_Serial(SerialConnection* serial)
+{
+    if (serial->handle == nullptr)
+        return;
+
+    TtyFileDescriptor ttyfd = cast(TtyFileDescriptor,
+        p_cast(intptr_t, serial->handle)
+    );
+
+    if (serial->thread)
+        Stop_Serial_Thread(serial);
+
+    if (serial->poll) {
+        uv_close(cast(uv_handle_t*, serial->poll), &Serial_Poll_Closed);
+        serial->poll = nullptr;
+        serial->awaiting = 0;
+    }
+
+  #if defined(__linux__)
+    if (g_serial_epoll_fd != -1)
+        Unwatch_Serial(ttyfd);
+  #endif
+
+    Close_Serial_Device(ttyfd, serial);
+    rebFree(serial->prior_attr);
+    serial->prior_attr = nullptr;
+    serial->handle = nullptr;
+
+    Close_Serial_Capture(serial);
+}
+
+
+//
+//  Trap_Wait_Serials: C
+//
+// Wait up to timeout_msec (or indefinitely if negative) for any of the given
+// connections to have data to READ.  Their positions in serials[] are written
+// to ready[], which must have room for `count` entries.  A timeout is not an
+// error, it just leaves *num_ready at 0.  See [G] at top of file.
+//
+// 1. Connections which already have buffered data are ready without asking
+//    the kernel anything.  One listed twice is only reported once, at its
+//    first position.
+//
+// 2. The wait is a turn of the libuv loop, as for READ and WRITE, so other
+//    loop clients aren't held up by it (see [A] in %mod-serial.c).  epoll is
+//    only asked what's ready once the loop says something is.  Elsewhere it
+//    is a poll() of the ports, and the loop doesn't run until it returns.
+//
+Option(Error*) Trap_Wait_Serials(
+    int* num_ready,
+    int ready[],
+    SerialConnection* serials[],
+    int count,
+    int32_t timeout_msec
+){
+    uintptr_t tick = ++g_serial_wait_tick;
+    *num_ready = 0;
+
+    for (int i = 0; i < count; ++i) {
+        SerialConnection* serial = serials[i];
+        assert(serial->handle != nullptr);
+
+        if (serial->thread)
+            return Error_User("Can't wait on IO-ENGINE THREAD serial ports");
+
+        if (serial->wait_tick == tick)
+            continue;  // [1]
+
+        serial->wait_tick = tick;
+        serial->wait_index = i;
+
+        if (Serial_Ring_Used(&serial->in_ring) != 0)
+            ready[(*num_ready)++] = i;  // [1]
+    }
+
+    if (*num_ready != 0 or count == 0)
+        return SUCCESS;
+
+    int64_t deadline = Monotonic_Msec() + timeout_msec;
+
+    while (true) {
+        int remaining = -1;
+        if (timeout_msec >= 0) {
+            int64_t left = deadline - Monotonic_Msec();
+            remaining = left < 0 ? 0 : cast(int, left);
+        }
+
+      #if defined(__linux__)
+        struct epoll_event events[SERIAL_MAX_EVENTS];
+        int n = epoll_wait(g_serial_epoll_fd, events, SERIAL_MAX_EVENTS, 0);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return Error_OS(errno);
+        }
+
+        for (int k = 0; k < n; ++k) {
+            SerialConnection* serial = cast(
+                SerialConnection*, events[k].data.ptr
+            );
+            bool hangup = (events[k].events & (EPOLLHUP | EPOLLERR)) != 0;
+
+            if (
+                Note_Serial_Readiness(serial, hangup)
+                and serial->wait_tick == tick
+            ){
+                ready[(*num_ready)++] = serial->wait_index;
+            }
+        }
+
+        if (*num_ready != 0 or remaining == 0)
+            return SUCCESS;
+
+        Option(Error*) e = Trap_Run_Loop_Until_Watched(remaining);  // [2]
+        if (e)
+            return e;
+      #else
+        struct pollfd* pfds = rebAllocN(struct pollfd, count);
+        for (int i = 0; i < count; ++i) {
+            pfds[i].fd = cast(TtyFileDescriptor,
+                p_cast(intptr_t, serials[i]->handle)
+            );
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+
+        int n = poll(pfds, count, remaining);
+        if (n == -1) {
+            int errno_copy = errno;
+            rebFree(pfds);
+            if (errno_copy == EINTR)
+                continue;
+            return Error_OS(errno_copy);
+        }
+
+        for (int i = 0; i < count and n > 0; ++i) {
+            if (pfds[i].revents == 0)
+                continue;
+            --n;
+            if (serials[i]->wait_index != i)
+                continue;  // listed again after this [1]
+            bool hangup = (pfds[i].revents & (POLLHUP | POLLERR)) != 0;
+            if (Note_Serial_Readiness(serials[i], hangup))
+                ready[(*num_ready)++] = i;
+        }
+        rebFree(pfds);
+
+        if (*num_ready != 0)
+            return SUCCESS;
+
+        if (timeout_msec >= 0 and Monotonic_Msec() >= deadline)
+            return SUCCESS;
+      #endif
+    }
+}
@@ -0,0 +1,328 @@
+//
+//  file: %serial-share.c
+//  summary: "One serial device shared by several PORT!s"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. Two ports that OPEN the same device independently each get their own
+//    descriptor, and whichever reads first takes the bytes from the other.
+//    Ports with `shared: 'yes` instead go through a registry keyed by the
+//    resolved device path (so a symlink like /dev/serial/by-id/... and the
+//    node it points to are the same device).  The first one opens it, the
+//    rest subscribe, and it's closed when the last one closes.
+//
+// B. The device's settings are the ones the first port opened it with.  A
+//    later port's spec gets the device's settings written back into it, and
+//    MODIFY on any of the ports changes the device for all of them.
+//
+// C. What the device receives is copied into every subscriber's own receive
+//    ring, each time any of them reads.  So each port's READ, :PART and
+//    framing work as they would if it had the device to itself.  A port
+//    whose ring is full when data is handed out misses it, rather than
+//    holding up the others; QUERY's DROPPED counts those bytes.
+//
+// D. Writes go through the device's connection, one WRITE at a time.  Since
+//    Trap_Write_Serial() takes all of a WRITE's data before returning (into
+//    the outbound ring if the driver can't take it yet), two ports' WRITEs
+//    are never interleaved on the line.
+//
+// E. The registry belongs to the interpreter thread.  It's a list, since a
+//    process shares few devices and they're only looked up on OPEN.
+//
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+
+static SerialShare* g_shares = nullptr;
+
+
+//
+//  Add_Serial_Subscriber: C
+//
+static void Add_Serial_Subscriber(SerialShare* share, SerialConnection* serial)
+{
+    if (share->num_subscribers == share->subscribers_capacity) {
+        Length capacity = share->subscribers_capacity * 2 + 4;
+        SerialConnection** subscribers = rebAllocN(SerialConnection*, capacity);
+        if (share->subscribers) {
+            memcpy(
+                subscribers,
+                share->subscribers,
+                share->num_subscribers * sizeof(SerialConnection*)
+            );
+            rebFree(share->subscribers);
+        }
+        share->subscribers = subscribers;
+        share->subscribers_capacity = capacity;
+    }
+    share->subscribers[share->num_subscribers++] = serial;
+    serial->share_seen = serial->in_ring.head;
+
+    serial->share = share;
+    serial->handle = share->device.handle;  // so the port counts as open
+}
+
+
+//
+//  Remove_Serial_Subscriber: C
+//
+// Gives back the share if that was its last subscriber, out of the registry
+// and for the caller to close and free.
+//
+static Option(SerialShare*) Remove_Serial_Subscriber(SerialConnection* serial)
+{
+    SerialShare* share = serial->share;
+    assert(share != nullptr);
+
+    Length n = 0;
+    while (share->subscribers[n] != serial)
+        ++n;
+    share->subscribers[n] = share->subscribers[--share->num_subscribers];
+
+    serial->share = nullptr;
+    serial->handle = nullptr;
+
+    if (share->num_subscribers != 0)
+        return nullptr;
+
+    SerialShare** link = &g_shares;
+    while (*link != share)
+        link = &(*link)->next;
+    *link = share->next;
+
+    return share;
+}
+
+
+//
+//  Free_Serial_Share: C
+//
+static void Free_Serial_Share(SerialShare* share)
+{
+    assert(share->device.handle == nullptr);
+
+    rebRelease(share->device.path);
+    if (share->device.capture_path)
+        rebRelease(share->device.capture_path);
+    rebFree(share->device.in_ring.buf);
+    rebFree(share->device.out_ring.buf);
+    if (share->subscribers)
+        rebFree(share->subscribers);
+    rebFree(share);
+}
+
+
+//
+//  Trap_Open_Shared_Serial: C
+//
+// See [A] and [B] at top of file.
+//
+Option(Error*) Trap_Open_Shared_Serial(SerialConnection* serial)
+{
+    char key[MAX_SERIAL_SHARE_KEY];
+    if (not Get_Serial_Share_Key(key, sizeof(key), serial))
+        return Error_User("Serial path too long to share");
+
+    SerialShare* share = g_shares;
+    for (; share != nullptr; share = share->next) {
+        if (strcmp(share->key, key) == 0)
+            break;
+    }
+
+    if (share == nullptr) {
+        share = rebAlloc(SerialShare);
+        memset(share, 0, sizeof(SerialShare));
+        strcpy(share->key, key);
+
+        SerialConnection* device = &share->device;
+        device->path = rebStable("copy", serial->path);
+        device->baud_rate = serial->baud_rate;
+        device->data_bits = serial->data_bits;
+        device->parity = serial->parity;
+        device->stop_bits = serial->stop_bits;
+        device->flow_control = serial->flow_control;
+        device->timeout_msec = serial->timeout_msec;
+        device->io_engine = serial->io_engine;
+        device->low_latency = serial->low_latency;
+        device->rs485 = serial->rs485;
+        if (serial->capture_path)  // traffic is the device's to record
+            device->capture_path = rebStable("copy", serial->capture_path);
+        device->capture_size = serial->capture_size;
+
+        device->in_ring.capacity = serial->in_ring.capacity;
+        device->in_ring.buf = rebAllocN(Byte, device->in_ring.capacity);
+        device->out_ring.capacity = serial->out_ring.capacity;
+        device->out_ring.buf = rebAllocN(Byte, device->out_ring.capacity);
+
+        Option(Error*) e = Trap_Open_Serial(device);
+        if (e) {
+            Free_Serial_Share(share);
+            return e;
+        }
+
+        share->next = g_shares;
+        g_shares = share;
+    }
+
+    const SerialConnection* device = &share->device;  // settings win [B]
+    serial->baud_rate = device->baud_rate;
+    serial->data_bits = device->data_bits;
+    serial->parity = device->parity;
+    serial->stop_bits = device->stop_bits;
+    serial->flow_control = device->flow_control;
+    serial->timeout_msec = device->timeout_msec;
+    serial->io_engine = device->io_engine;
+    serial->low_latency = device->low_latency;
+    serial->low_latency_applied = device->low_latency_applied;
+    serial->latency_timer_msec = device->latency_timer_msec;
+    serial->rs485 = device->rs485;
+
+    Add_Serial_Subscriber(share, serial);
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Close_Shared_Serial: C
+//
+Option(Error*) Trap_Close_Shared_Serial(SerialConnection* serial)
+{
+    Option(SerialShare*) last = Remove_Serial_Subscriber(serial);
+    if (not last)
+        return SUCCESS;
+
+    SerialShare* share = unwrap last;
+    Option(Error*) e = Trap_Close_Serial(&share->device);  // closes anyway
+    Free_Serial_Share(share);
+    return e;
+}
+
+
+//
+//  Abandon_Shared_Serial: C
+//
+// For the GC, see Abandon_Serial().
+//
+void Abandon_Shared_Serial(SerialConnection* serial)
+{
+    if (serial->share == nullptr)
+        return;
+
+    Option(SerialShare*) last = Remove_Serial_Subscriber(serial);
+    if (not last)
+        return;
+
+    SerialShare* share = unwrap last;
+    Abandon_Serial(&share->device);
+    Free_Serial_Share(share);
+}
+
+
+//
+//  Fan_Out_Serial_Share: C
+//
+// Hands what the device has received to every subscriber, see [C].
+//
+void Fan_Out_Serial_Share(SerialShare* share)
+{
+    SerialRing* ring = &share->device.in_ring;
+
+    const Byte* seg[2];
+    Size len[2];
+    Serial_Ring_Used_Segments(ring, seg, len);
+    Size used = len[0] + len[1];
+    if (used == 0)
+        return;
+
+    for (Length n = 0; n < share->num_subscribers; ++n) {
+        SerialConnection* serial = share->subscribers[n];
+        SerialRing* dest = &serial->in_ring;
+
+        Size room = Serial_Ring_Free(dest);
+        Size first = len[0] < room ? len[0] : room;
+        Serial_Ring_Produce(dest, seg[0], first);
+        Size second = len[1] < room - first ? len[1] : room - first;
+        Serial_Ring_Produce(dest, seg[1], second);
+
+        if (first + second < used)
+            Serial_Stat_Add(serial->stats.dropped, used - (first + second));
+    }
+
+    Serial_Ring_Discard(ring, used);
+    Resume_Serial_Reading(&share->device);
+}
+
+
+//
+//  Trap_Read_Shared_Serial: C
+//
+// Like Trap_Read_Serial(), but only goes to the device if nothing has been
+// handed to this port since its last READ.  serial->actual is how much was.
+//
+// 1. Bytes still in the port's ring may be ones its READ already looked at
+//    and left there, e.g. a partial frame.  Those don't count, so the ring
+//    not being empty isn't a reason to skip the device.
+//
+Option(Error*) Trap_Read_Shared_Serial(SerialConnection* serial)
+{
+    SerialShare* share = serial->share;
+    assert(share != nullptr);
+
+    SerialRing* in = &serial->in_ring;
+
+    Fan_Out_Serial_Share(share);
+    serial->share_seen = Serial_Ring_Read_Mark(in, serial->share_seen);
+    if (in->head == serial->share_seen) {  // [1]
+        Option(Error*) e = Trap_Read_Serial(&share->device);
+        if (e)
+            return e;
+
+        Fan_Out_Serial_Share(share);
+    }
+
+    serial->actual = in->head - serial->share_seen;
+    serial->share_seen = in->head;
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Write_Shared_Serial: C
+//
+// See [D] at top of file.
+//
+Option(Error*) Trap_Write_Shared_Serial(SerialConnection* serial)
+{
+    SerialConnection* device = &serial->share->device;
+
+    device->chunks = serial->chunks;
+    device->num_chunks = serial->num_chunks;
+
+    Option(Error*) e = Trap_Write_Serial(device);
+
+    serial->actual = device->actual;
+    device->chunks = nullptr;
+    device->num_chunks = 0;
+    return e;
+}
@@ -0,0 +1,177 @@
+//
+//  file: %serial-stamps.c
+//  summary: "When received bytes arrived, and where the line went quiet"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. Some protocols are defined by timing: a silence of some length ends a
+//    frame (Modbus RTU, many proprietary buses), or bursts on several ports
+//    have to be put in order.  Timing that from script measures when the
+//    interpreter got around to READ, not when the bytes came in.  So with
+//    `timestamps: 'yes` the read() that takes bytes from the driver notes
+//    the monotonic clock as it returns, whichever thread it's on, and READ
+//    hands the times back alongside the data.
+//
+// B. The clock is libuv's uv_hrtime(), which is CLOCK_MONOTONIC on Linux and
+//    QueryPerformanceCounter() on Windows, in microseconds.  A stamp is only
+//    as good as what the driver tells us: a USB adapter delivers in packets
+//    paced by its latency timer (see LOW-LATENCY), so bytes that arrived
+//    apart can come in one read.  On a native UART or an adapter at its
+//    lowest latency, stamps are good to well under a millisecond.
+//
+// C. With no `gap:`, each read's bytes are a chunk of their own.  With one,
+//    reads are put together into a chunk until the line was quiet for the
+//    gap.  The quiet before a read is estimated as the time it returned,
+//    less how long its bytes took on the wire at the port's speed, less the
+//    time the read before it returned.  A chunk at the end of what's been
+//    received isn't known to be complete until the gap has passed with
+//    nothing more arriving, so it's held back until then.
+//
+// D. A stamp is dropped once the bytes of the stamp after it are at the
+//    front of the ring.  A READ :PART can leave some of a chunk's bytes in
+//    the ring, and they keep their stamp.
+//
+
+#include "uv.h"  // for uv_hrtime(), which is monotonic on all platforms
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+
+//
+//  Serial_Usec: C
+//
+// See [B] at top of file.  The protocol code times everything else with it
+// too, so deadlines and stamps can be compared.
+//
+int64_t Serial_Usec(void)
+{
+    return cast(int64_t, uv_hrtime() / 1000);
+}
+
+
+//
+//  Serial_Stamp_At: C
+//
+static const SerialStamp* Serial_Stamp_At(
+    const SerialStampRing* stamps,
+    Size index
+){
+    return &stamps->buf[index & (SERIAL_STAMP_CAPACITY - 1)];
+}
+
+
+//
+//  Measure_Serial_Stamped_Chunk: C
+//
+// Gives the size of the chunk at the front of the receive ring and when its
+// first read returned, or 0 if there isn't a complete one.  If bytes are
+// being held back per [C], settle_usec says how long until they'd be a
+// complete chunk if nothing more arrives.
+//
+// 1. Stamps are pushed before their bytes are committed, so a stamp may be
+//    seen whose bytes aren't in the ring yet.  It belongs to the next READ.
+//
+// 2. A stamp is always pushed with bytes, unless the stamp ring was full.
+//    Bytes without one get the time of the stamp after them, or now if there
+//    isn't one, and are taken to be complete.
+//
+// 3. If the receive ring is full, waiting for the gap won't make room for
+//    anything to arrive, so the chunk is given back as it is.
+//
+Size Measure_Serial_Stamped_Chunk(
+    Sink(int64_t) usec,
+    Sink(int32_t) settle_usec,
+    SerialConnection* serial
+){
+    SerialRing* in = &serial->in_ring;
+    SerialStampRing* stamps = &serial->stamps;
+    assert(stamps->buf);
+
+    *usec = 0;
+    *settle_usec = 0;
+
+    Size tail = in->tail;
+    Size head = Serial_Ring_Load(in->head);
+    if (head == tail)
+        return 0;
+
+    Size stamps_head = Serial_Ring_Load(stamps->head);
+    while (  // see [D] at top of file
+        stamps_head - stamps->tail >= 2
+        and Serial_Stamp_At(stamps, stamps->tail + 1)->position <= tail
+    ){
+        Serial_Ring_Store(stamps->tail, stamps->tail + 1);
+    }
+
+    if (stamps_head == stamps->tail) {  // [2]
+        *usec = Serial_Usec();
+        return head - tail;
+    }
+
+    const SerialStamp* first = Serial_Stamp_At(stamps, stamps->tail);
+    *usec = first->usec;
+    if (first->position >= head)  // [2]
+        return head - tail;
+    if (first->position > tail)  // [2]
+        return first->position - tail;
+
+    int64_t char_nsec = cast(int64_t, Serial_Char_Bits(serial)) * 1000000000
+        / serial->baud_rate;  // (not Serial_Char_Usec(), which rounds up)
+
+    int64_t last_usec = first->usec;
+    for (Size i = stamps->tail + 1; i != stamps_head; ++i) {
+        const SerialStamp* stamp = Serial_Stamp_At(stamps, i);
+        if (stamp->position >= head)
+            break;  // [1]
+
+        if (serial->gap_usec == 0)
+            return stamp->position - tail;
+
+        Size end = head;
+        if (i + 1 != stamps_head) {
+            Size next = Serial_Stamp_At(stamps, i + 1)->position;
+            if (next < head)
+                end = next;
+        }
+        int64_t wire_usec = (end - stamp->position) * char_nsec / 1000;
+        int64_t quiet_usec = stamp->usec - wire_usec - last_usec;
+        if (quiet_usec >= serial->gap_usec)  // see [C] at top of file
+            return stamp->position - tail;
+
+        last_usec = stamp->usec;
+    }
+
+    if (
+        serial->gap_usec != 0
+        and Serial_Ring_Used(in) != in->capacity  // [3]
+    ){
+        int64_t quiet_usec = Serial_Usec() - last_usec;
+        if (quiet_usec < serial->gap_usec) {
+            *settle_usec = cast(int32_t, serial->gap_usec - quiet_usec);
+            return 0;
+        }
+    }
+
+    return head - tail;
+}
@@ -0,0 +1,243 @@
+//
+//  file: %serial-transact.c
+//  summary: "Write a request and collect its reply, in one call"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. A command/response exchange from script is a WRITE and then READs until
+//    the reply is all there, each READ a trip through the interpreter and a
+//    new BLOB!.  Here the reply is collected in the receive ring, and only
+//    copied out once, when it's complete.
+//
+// B. The reply is complete when the first of its rules is met: it ends with
+//    the terminator, it's the given length, or the line has been idle for
+//    the given time after some of it arrived.  Bytes after a terminator or
+//    past the length stay in the ring, for a READ or the next transaction.
+//
+// C. Bytes in the receive ring before the request is written are a previous
+//    exchange's leftovers, and are dropped so they can't pass for the reply.
+//    A reply that times out incomplete is left in the ring, for READ.
+//
+// D. The terminator is searched for in place in the ring, resuming where the
+//    last search left off, so a reply arriving a few bytes at a time isn't
+//    rescanned from the start each time.
+//
+// E. On an RS-485 port whose receiver stays on while sending, the request
+//    comes back ahead of the reply.  Trap_Write_Serial_Request() waits for
+//    it and drops it, and is what Modbus and XMODEM write with too, since
+//    they'd take an echo for the other end's answer just the same.
+//
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+
+//
+//  Find_Serial_Terminator: C
+//
+// Gives the size of the ring's contents up to and including the terminator,
+// or 0 if it isn't there.  Matches are only looked for ending after `from`,
+// see [D] at top of file.
+//
+static Size Find_Serial_Terminator(
+    const SerialRing* ring,
+    const Byte* terminator,
+    Size terminator_size,
+    Size from
+){
+    const Byte* seg[2];
+    Size len[2];
+    Serial_Ring_Used_Segments(ring, seg, len);
+    Size used = len[0] + len[1];
+
+    Size start = (from >= terminator_size) ? from - (terminator_size - 1) : 0;
+
+    Size at = start;
+    while (at + terminator_size <= used) {
+        const Byte* scan;  // memchr() within whichever segment `at` is in
+        const Byte* end;
+        if (at < len[0]) {
+            scan = seg[0] + at;
+            end = seg[0] + len[0];
+        }
+        else {
+            scan = seg[1] + (at - len[0]);
+            end = seg[1] + len[1];
+        }
+        const Byte* found = cast(const Byte*,
+            memchr(scan, terminator[0], end - scan)
+        );
+        if (not found) {
+            at += end - scan;
+            continue;
+        }
+        at += found - scan;
+        if (at + terminator_size > used)
+            break;
+
+        Size n = 1;
+        while (
+            n < terminator_size
+            and Serial_Ring_Peek(ring, at + n) == terminator[n]
+        ){
+            ++n;
+        }
+        if (n == terminator_size)
+            return at + terminator_size;
+
+        ++at;
+    }
+
+    return 0;
+}
+
+
+//
+//  Trap_Write_Serial_Request: C
+//
+// Writes bytes that a device is to answer, see [E] at top of file.  If they
+// come back, this returns once they have and they're dropped, or at the
+// deadline for the answer if they don't all come.
+//
+// 1. The echo can only be taken off the front of the receive ring, so what
+//    was in it before the write is dropped too.  Callers have taken what they
+//    wanted from it already.  On a bus with one talker at a time, nothing
+//    else arrives during the echo.
+//
+Option(Error*) Trap_Write_Serial_Request(
+    SerialConnection* serial,
+    const Byte* data,
+    Size size,
+    int64_t deadline_usec
+){
+    bool echoed = serial->rs485.enabled and serial->rs485.receive_during_send;
+
+    SerialRing* in = &serial->in_ring;
+    if (echoed)
+        Serial_Ring_Discard(in, Serial_Ring_Used(in));  // [1]
+
+    SerialChunk chunk;
+    chunk.data = data;
+    chunk.length = size;
+    serial->chunks = &chunk;
+    serial->num_chunks = 1;
+
+    Option(Error*) e = Trap_Write_Serial(serial);
+
+    serial->chunks = nullptr;
+    serial->num_chunks = 0;
+    if (e or not echoed)
+        return e;
+
+    Size echo = size;
+
+    while (true) {
+        Size used = Serial_Ring_Used(in);
+        Size n = (used < echo) ? used : echo;
+        Serial_Ring_Discard(in, n);
+        echo -= n;
+        if (echo == 0)
+            return SUCCESS;
+
+        int64_t left = deadline_usec - Serial_Usec();
+        if (left <= 0)
+            return SUCCESS;  // let the caller time out waiting for a reply
+
+        e = Trap_Read_Serial_Within(serial, cast(int32_t, left));
+        if (e)
+            return e;
+    }
+}
+
+
+//
+//  Trap_Transact_Serial: C
+//
+// Writes the request and waits for the reply per the rules in [B], leaving
+// it at the front of the receive ring.  reply_size is 0 if time ran out.
+//
+Option(Error*) Trap_Transact_Serial(
+    Sink(Size) reply_size,
+    SerialConnection* serial,
+    const SerialTransaction* txn
+){
+    assert(txn->terminator_size != 0 or txn->length != 0 or txn->idle_usec);
+
+    *reply_size = 0;
+
+    SerialRing* in = &serial->in_ring;
+    Serial_Ring_Discard(in, Serial_Ring_Used(in));  // see [C]
+
+    int64_t deadline_usec = Serial_Usec() + txn->timeout_usec;
+
+    Option(Error*) e = Trap_Write_Serial_Request(  // see [E]
+        serial, txn->request, txn->request_size, deadline_usec
+    );
+    if (e)
+        return e;
+
+    Size scanned = 0;
+
+    while (true) {
+        Size used = Serial_Ring_Used(in);
+
+        if (txn->length != 0 and used >= txn->length) {
+            *reply_size = txn->length;
+            return SUCCESS;
+        }
+
+        if (txn->terminator_size != 0 and used > scanned) {
+            Size size = Find_Serial_Terminator(
+                in, txn->terminator, txn->terminator_size, scanned
+            );
+            if (size != 0) {
+                *reply_size = size;
+                return SUCCESS;
+            }
+            scanned = used;
+        }
+
+        if (used == in->capacity)
+            return Error_User("Serial reply is bigger than the receive buffer");
+
+        int64_t left = deadline_usec - Serial_Usec();
+        if (left <= 0)
+            return SUCCESS;  // timed out, see [C]
+
+        bool idle_rule = (txn->idle_usec != 0 and used != 0);
+        int32_t wait = cast(int32_t, left);
+        if (idle_rule and txn->idle_usec < left)
+            wait = txn->idle_usec;
+        else
+            idle_rule = false;  // the deadline comes first
+
+        e = Trap_Read_Serial_Within(serial, wait);
+        if (e)
+            return e;
+
+        if (serial->actual == 0 and idle_rule) {
+            *reply_size = used;
+            return SUCCESS;
+        }
+    }
+}
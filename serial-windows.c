@@ -20,8 +20,6 @@
 //
 //=////////////////////////////////////////////////////////////////////////=//
 //
-// This code is being kept compiling, but does not work at present.
-//
 // See README.md for notes about this extension.
 //
 
@@ -38,41 +36,138 @@
 
 #define MAX_SERIAL_DEV_PATH 128
 
-const int speeds[] = {
-    110, CBR_110,
-    300, CBR_300,
-    600, CBR_600,
-    1200, CBR_1200,
-    2400, CBR_2400,
-    4800, CBR_4800,
-    9600, CBR_9600,
-    14400, CBR_14400,
-    19200, CBR_19200,
-    38400, CBR_38400,
-    57600, CBR_57600,
-    115200, CBR_115200,
-    128000, CBR_128000,
-    230400, CBR_256000,
+const int max_bauds[] = {  // GetCommProperties() dwMaxBaud to a rate
+    BAUD_075, 75,
+    BAUD_110, 110,
+    BAUD_150, 150,
+    BAUD_300, 300,
+    BAUD_600, 600,
+    BAUD_1200, 1200,
+    BAUD_1800, 1800,
+    BAUD_2400, 2400,
+    BAUD_4800, 4800,
+    BAUD_7200, 7200,
+    BAUD_9600, 9600,
+    BAUD_14400, 14400,
+    BAUD_19200, 19200,
+    BAUD_38400, 38400,
+    BAUD_56K, 56000,
+    BAUD_57600, 57600,
+    BAUD_115200, 115200,
+    BAUD_128K, 128000,
     0
 };
 
 
 //
-//  Get_Serial_Max_Baud_Rate: C
+//  Trap_Set_Comm_State: C
+//
+// Applies the connection's line settings through the device's DCB, leaving
+// the fields that aren't ours (e.g. XonChar) as the driver has them.
+//
+// 1. RTS_CONTROL_TOGGLE raises RTS while there are bytes to send, which is
+//    RS-485 direction control done by the driver.  It can't be inverted or
+//    delayed, and drivers that lack it fail SetCommState().
 //
-SerialBaudRate Get_Serial_Max_Baud_Rate(void) {
-    int max = 0;
-    for (int n = 0; speeds[n] != 0; n += 2)
-        max = speeds[n];
-    return max;
+static Option(Error*) Trap_Set_Comm_State(
+    HANDLE h,
+    SerialConnection* serial
+){
+    if (
+        serial->max_baud_rate != 0
+        and serial->baud_rate > serial->max_baud_rate
+    ){
+        return Error_User("Baud rate is above what the device supports");
+    }
+
+    DCB dcbSerialParams;
+    memset(&dcbSerialParams, '\0', sizeof(dcbSerialParams));
+    dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
+
+    if (not GetCommState(h, &dcbSerialParams))
+        return Error_OS(GetLastError());
+
+    dcbSerialParams.BaudRate = serial->baud_rate;  // CBR_XXX are just rates
+
+    dcbSerialParams.ByteSize = serial->data_bits;
+    if (serial->stop_bits == 1) {
+      stop_bits_1_case:
+        dcbSerialParams.StopBits = ONESTOPBIT;
+    }
+    else if (serial->stop_bits == 2)
+        dcbSerialParams.StopBits = TWOSTOPBITS;
+    else {
+        assert(false);
+        goto stop_bits_1_case;
+    }
+
+    switch (serial->parity) {
+      parity_none_case:
+      case SERIAL_PARITY_NONE:
+        dcbSerialParams.Parity = NOPARITY;
+        break;
+
+      case SERIAL_PARITY_ODD:
+        dcbSerialParams.Parity = ODDPARITY;
+        break;
+
+      case SERIAL_PARITY_EVEN:
+        dcbSerialParams.Parity = EVENPARITY;
+        break;
+
+      default:
+        assert(false);
+        goto parity_none_case;
+    }
+
+    dcbSerialParams.fOutxCtsFlow = FALSE;
+    dcbSerialParams.fRtsControl = RTS_CONTROL_ENABLE;
+    dcbSerialParams.fOutX = FALSE;
+    dcbSerialParams.fInX = FALSE;
+
+    switch (serial->flow_control) {
+      flow_control_none_case:
+      case SERIAL_FLOW_CONTROL_NONE:
+        break;
+
+      case SERIAL_FLOW_CONTROL_HARDWARE:
+        dcbSerialParams.fOutxCtsFlow = TRUE;
+        dcbSerialParams.fRtsControl = RTS_CONTROL_HANDSHAKE;
+        break;
+
+      case SERIAL_FLOW_CONTROL_SOFTWARE:
+        dcbSerialParams.fOutX = TRUE;
+        dcbSerialParams.fInX = TRUE;
+        break;
+
+      default:
+        assert(false);
+        goto flow_control_none_case;
+    }
+
+    if (serial->rs485.enabled) {  // [1]
+        if (
+            not serial->rs485.rts_high_on_send
+            or serial->rs485.delay_before_usec != 0
+            or serial->rs485.delay_after_usec != 0
+        ){
+            return Error_User(
+                "RS-485 on Windows only raises RTS to send, with no delays"
+            );
+        }
+        dcbSerialParams.fRtsControl = RTS_CONTROL_TOGGLE;
+    }
+
+    if (not SetCommState(h, &dcbSerialParams))
+        return Error_OS(GetLastError());
+
+    return SUCCESS;
 }
 
 
 //
 //  Trap_Open_Serial: C
 //
-// !!! This doesn't seem to heed serial->flow_control or serial->data_bits.
-//
 // 1. serial->path should be prefixed with "\\.\" to allow for higher COM
 //    port numbers
 //
@@ -83,10 +178,32 @@ SerialBaudRate Get_Serial_Max_Baud_Rate(void) {
 //
 //    http://msdn.microsoft.com/en-us/library/windows/desktop/aa363190%28v=vs.85%29.aspx
 //
+// 3. When the port spec has a TIMEOUT, MAXDWORD for both the interval and
+//    the multiplier is the documented combination meaning "return at once
+//    if anything is buffered, else wait up to the constant for a byte".
+//    That matches the POSIX blocking mode's poll() deadline.
+//
+// 4. The DCB takes the baud rate as a number, so any rate the driver can do
+//    may be used.  GetCommProperties() gives a ceiling, unless the driver
+//    says BAUD_USER ("programmable"), in which case SetCommState() decides.
+//
+// 5. There's no portable Win32 call for the USB adapter latency timer (FTDI
+//    keeps it in the driver's registry settings), so `latency: 'low` isn't
+//    applied here and OPEN reports it back as 'normal.
+//
 Option(Error*) Trap_Open_Serial(SerialConnection* serial)
 {
     assert(serial->path != nullptr);
 
+    if (serial->io_engine != SERIAL_IO_LOOP)
+        return Error_User("Serial IO-ENGINE THREAD not supported on Windows");
+
+    if (serial->capture_path)
+        return Error_User("Serial CAPTURE not supported on Windows");
+
+    serial->low_latency_applied = false;  // see [5]
+    serial->latency_timer_msec = -1;
+
     WCHAR fullpath[MAX_SERIAL_DEV_PATH] = L"\\\\.\\";  // high port nums [1]
 
     Length buf_left = MAX_SERIAL_DEV_PATH - wcslen(fullpath) - 1;
@@ -110,59 +227,19 @@ Option(Error*) Trap_Open_Serial(SerialConnection* serial)
     if (h == INVALID_HANDLE_VALUE)
         return Error_OS(GetLastError());
 
-    DCB dcbSerialParams;
-    memset(&dcbSerialParams, '\0', sizeof(dcbSerialParams));
-    dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
-
-    if (not GetCommState(h, &dcbSerialParams)) {
-        CloseHandle(h);
-        return Error_OS(GetLastError());
-    }
-
-    for (Offset n = 0; true; n += 2) {
-        if (speeds[n] == 0)  // invalid (used default CBR_115200 before)
-            return Error_User("Invalid baud rate");
-
-        if (serial->baud_rate == speeds[n]) {
-            dcbSerialParams.BaudRate = speeds[n+1];
-            break;
+    COMMPROP props;  // per-device ceiling, see [4]
+    serial->max_baud_rate = 0;
+    if (GetCommProperties(h, &props) and props.dwMaxBaud != BAUD_USER) {
+        for (Offset n = 0; max_bauds[n] != 0; n += 2) {
+            if (props.dwMaxBaud == cast(DWORD, max_bauds[n]))
+                serial->max_baud_rate = max_bauds[n + 1];
         }
     }
 
-    dcbSerialParams.ByteSize = serial->data_bits;
-    if (serial->stop_bits == 1) {
-      stop_bits_1_case:
-        dcbSerialParams.StopBits = ONESTOPBIT;
-    }
-    else if (serial->stop_bits == 2)
-        dcbSerialParams.StopBits = TWOSTOPBITS;
-    else {
-        assert(false);
-        goto stop_bits_1_case;
-    }
-
-    switch (serial->parity) {
-      parity_none_case:
-      case SERIAL_PARITY_NONE:
-        dcbSerialParams.Parity = NOPARITY;
-        break;
-
-      case SERIAL_PARITY_ODD:
-        dcbSerialParams.Parity = ODDPARITY;
-        break;
-
-      case SERIAL_PARITY_EVEN:
-        dcbSerialParams.Parity = EVENPARITY;
-        break;
-
-      default:
-        assert(false);
-        goto parity_none_case;
-    }
-
-    if (not SetCommState(h, &dcbSerialParams)) {
+    Option(Error*) e = Trap_Set_Comm_State(h, serial);
+    if (e) {
         CloseHandle(h);
-        return Error_OS(GetLastError());
+        return e;
     }
 
     if (not PurgeComm(h, PURGE_RXCLEAR | PURGE_TXCLEAR)) {  // clean buffers
@@ -172,11 +249,20 @@ Option(Error*) Trap_Open_Serial(SerialConnection* serial)
 
     COMMTIMEOUTS timeouts;  // comment "add in timeouts? currently unused" [2]
     memset(&timeouts, '\0', sizeof(timeouts));
-    timeouts.ReadIntervalTimeout = MAXDWORD;
-    timeouts.ReadTotalTimeoutMultiplier = 0;
-    timeouts.ReadTotalTimeoutConstant = 0;
-    timeouts.WriteTotalTimeoutMultiplier = 1;  // !!! should this be 0?
-    timeouts.WriteTotalTimeoutConstant = 1;  // !!! should this be 0?
+    if (serial->timeout_msec < 0) {
+        timeouts.ReadIntervalTimeout = MAXDWORD;
+        timeouts.ReadTotalTimeoutMultiplier = 0;
+        timeouts.ReadTotalTimeoutConstant = 0;
+        timeouts.WriteTotalTimeoutMultiplier = 1;  // !!! should this be 0?
+        timeouts.WriteTotalTimeoutConstant = 1;  // !!! should this be 0?
+    }
+    else {  // blocking mode [3]
+        timeouts.ReadIntervalTimeout = MAXDWORD;
+        timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+        timeouts.ReadTotalTimeoutConstant = serial->timeout_msec;
+        timeouts.WriteTotalTimeoutMultiplier = 0;
+        timeouts.WriteTotalTimeoutConstant = serial->timeout_msec;
+    }
 
     if (not SetCommTimeouts(h, &timeouts)) {
         CloseHandle(h);
@@ -188,6 +274,49 @@ Option(Error*) Trap_Open_Serial(SerialConnection* serial)
 }
 
 
+//
+//  Get_Serial_Share_Key: C
+//
+// COM port names are case-insensitive, and may be given with the "\\.\"
+// prefix or without it (see [1] in Trap_Open_Serial()).
+//
+bool Get_Serial_Share_Key(char* key, Size size, SerialConnection* serial)
+{
+    Size len = rebSpellInto(key, size, serial->path);
+    if (len >= size)
+        return false;
+
+    if (strncmp(key, "\\\\.\\", 4) == 0)
+        memmove(key, key + 4, len - 4 + 1);
+
+    for (char* cp = key; *cp != '\0'; ++cp) {
+        if (*cp >= 'a' and *cp <= 'z')
+            *cp -= 'a' - 'A';
+    }
+    return true;
+}
+
+
+//
+//  Open_Serials: C
+//
+// !!! The ports are opened one at a time here.  The POSIX version's worker
+// pool could be used, since Trap_Open_Serial() doesn't involve a loop, but
+// it would need its Error* creation moved off the workers the same way.
+//
+void Open_Serials(
+    Option(Error*)* errors,
+    SerialConnection** serials,
+    Length count,
+    Length max_workers
+){
+    UNUSED(max_workers);
+
+    for (Length n = 0; n < count; ++n)
+        errors[n] = Trap_Open_Serial(serials[n]);
+}
+
+
 //
 //  Trap_Close_Serial: C
 //
@@ -195,74 +324,526 @@ Option(Error*) Trap_Close_Serial(SerialConnection* serial)
 {
     assert(serial->handle != nullptr);
 
-    if (not CloseHandle(serial->handle))
+    BOOL ok = CloseHandle(serial->handle);
+    serial->handle = nullptr;
+
+    if (not ok)
+        return Error_OS(GetLastError());
+
+    return SUCCESS;
+}
+
+
+//
+//  Abandon_Serial: C
+//
+// Close without reporting errors, for when the PORT! holding the connection
+// is garbage collected while still open (can't create Error* during GC).
+//
+void Abandon_Serial(SerialConnection* serial)
+{
+    if (serial->handle == nullptr)
+        return;
+
+    CloseHandle(serial->handle);
+    serial->handle = nullptr;
+}
+
+
+//
+//  Trap_Modify_Serial: C
+//
+// WriteFile() is synchronous, so everything written has at least reached
+// the driver; SetCommState() doesn't purge, so it goes out at the new rate
+// only if it hadn't been transmitted yet.  Drain first for the old rate.
+//
+Option(Error*) Trap_Modify_Serial(SerialConnection* serial)
+{
+    assert(serial->handle != nullptr);
+
+    bool drained;
+    Option(Error*) e = Trap_Drain_Serial(&drained, serial, -1);
+    if (e)
+        return e;
+
+    return Trap_Set_Comm_State(serial->handle, serial);
+}
+
+
+//
+//  Trap_Get_Serial_Queues: C
+//
+Option(Error*) Trap_Get_Serial_Queues(
+    Sink(Size) input,
+    Sink(Size) output,
+    SerialConnection* serial
+){
+    assert(serial->handle != nullptr);
+
+    DWORD errors;
+    COMSTAT status;
+    if (not ClearCommError(serial->handle, &errors, &status))
         return Error_OS(GetLastError());
 
+    *input = status.cbInQue;
+    *output = status.cbOutQue;
     return SUCCESS;
 }
 
 
+//
+//  Trap_Drain_Serial: C
+//
+// WriteFile() is synchronous here, so nothing is ever queued on our side.
+// FlushFileBuffers() waits for the driver to transmit, but can't be given
+// a timeout, so timeout_msec is only honored as "don't wait" when it is 0.
+//
+Option(Error*) Trap_Drain_Serial(
+    Sink(bool) drained,
+    SerialConnection* serial,
+    int32_t timeout_msec
+){
+    assert(serial->handle != nullptr);
+
+    if (timeout_msec == 0) {
+        Size input;
+        Size output;
+        Option(Error*) e = Trap_Get_Serial_Queues(&input, &output, serial);
+        if (e)
+            return e;
+        *drained = (output == 0);
+        return SUCCESS;
+    }
+
+    if (not FlushFileBuffers(serial->handle))
+        return Error_OS(GetLastError());
+
+    *drained = true;
+    return SUCCESS;
+}
+
+
+//
+//  Get_Serial_Line_Errors: C
+//
+// ClearCommError() only has flags for errors since it was last called, not
+// running counts like Linux's TIOCGICOUNT, so there's nothing to report.
+//
+bool Get_Serial_Line_Errors(
+    SerialLineErrors* errors,
+    SerialConnection* serial
+){
+    UNUSED(errors);
+    UNUSED(serial);
+    return false;
+}
+
+
 //
 //  Trap_Read_Serial: C
 //
+// !!! libuv can only poll sockets on Windows, not COMM handles, so there is
+// no loop integration here.  The COMMTIMEOUTS set up at open time make the
+// ReadFile() return immediately with whatever is buffered, which may be 0.
+//
+// There's no readv() equivalent for synchronous COMM reads, so if the first
+// free segment of the ring gets filled the wrapped segment is read too.
+//
 Option(Error*) Trap_Read_Serial(SerialConnection* serial)
 {
     assert(serial->handle != nullptr);
+    assert(Serial_Ring_Free(&serial->in_ring) != 0);  // caller should consume
 
-  #if DEBUG_SERIAL_EXTENSION
-    printf("reading %d bytes\n", serial->length);
-  #endif
+    serial->actual = 0;
 
-    DWORD result;
-    LPOVERLAPPED overlapped = nullptr;
-    if (not ReadFile(
-        serial->handle, serial->data, serial->length, &result, overlapped
-    )){
-        return Error_OS(GetLastError());
+    Byte* seg[2];
+    Size len[2];
+    Serial_Ring_Free_Segments(&serial->in_ring, seg, len);
+
+    for (int i = 0; i < 2 and len[i] != 0; ++i) {
+      #if DEBUG_SERIAL_EXTENSION
+        printf("reading %d bytes\n", len[i]);
+      #endif
+
+        DWORD result;
+        LPOVERLAPPED overlapped = nullptr;
+        if (not ReadFile(serial->handle, seg[i], len[i], &result, overlapped))
+            return Error_OS(GetLastError());
+
+        if (serial->stamps.buf and result != 0)  // see %serial-stamps.c
+            Push_Serial_Stamp(
+                &serial->stamps, serial->in_ring.head, Serial_Usec()
+            );
+        Serial_Ring_Commit(&serial->in_ring, result);
+        serial->actual += result;
+
+        ++serial->stats.reads;
+        serial->stats.bytes_in += result;
+        if (result == 0)
+            ++serial->stats.would_block;
+
+        if (result < len[i])
+            break;
     }
 
-    if (result == 0)
-        panic ("The original implementation queued PENDING here");
+    return SUCCESS;
+}
+
 
-    serial->actual = result;
+//
+//  Resume_Serial_Reading: C
+//
+// There's no I/O thread on Windows to be waiting for room in the ring.
+//
+void Resume_Serial_Reading(SerialConnection* serial)
+{
+    UNUSED(serial);
+}
 
-  #if DEBUG_SERIAL_EXTENSION
-    printf("read %d ret: %d\n", serial->length, serial->actual);
-  #endif
 
-    panic ("The original implementation posted a WAS-READ event here");
+//
+//  Trap_Read_Serial_Within: C
+//
+// Checks the driver's input queue every millisecond until something arrives
+// or timeout_usec passes.  Once there is input, Trap_Read_Serial() returns
+// with it right away in either mode, given the COMMTIMEOUTS in [3].
+//
+Option(Error*) Trap_Read_Serial_Within(
+    SerialConnection* serial,
+    int32_t timeout_usec
+){
+    DWORD start = GetTickCount();
+    DWORD timeout_msec = (timeout_usec + 999) / 1000;
+
+    while (true) {
+        Size input;
+        Size output;
+        Option(Error*) e = Trap_Get_Serial_Queues(&input, &output, serial);
+        if (e)
+            return e;
+
+        if (input != 0)
+            return Trap_Read_Serial(serial);
+
+        if (GetTickCount() - start >= timeout_msec) {
+            serial->actual = 0;
+            return SUCCESS;
+        }
+
+        Sleep(1);
+    }
 }
 
 
 //
 //  Trap_Write_Serial: C
 //
+// WriteFile() is synchronous (no OVERLAPPED), but may time out partially per
+// the COMMTIMEOUTS, so keep going until everything has been written.  There
+// is no gathering write for COMM handles, so it's one call per chunk.
+//
 Option(Error*) Trap_Write_Serial(SerialConnection* serial)
 {
     assert(serial->handle != nullptr);
 
-    Size len = serial->length - serial->actual;
+    serial->actual = 0;
+
+    for (int i = 0; i < serial->num_chunks; ++i) {
+        const SerialChunk* chunk = &serial->chunks[i];
+        Size written = 0;
+
+        while (written < chunk->length) {
+            DWORD result;
+            LPOVERLAPPED overlapped = nullptr;
+            if (not WriteFile(
+                serial->handle,
+                chunk->data + written,
+                chunk->length - written,
+                &result,
+                overlapped
+            )){
+                return Error_OS(GetLastError());
+            }
+
+          #if DEBUG_SERIAL_EXTENSION
+            printf("write %d ret: %d\n", chunk->length - written, result);
+          #endif
+
+            written += result;
+            serial->actual += result;
+
+            ++serial->stats.writes;
+            serial->stats.bytes_out += result;
+
+            if (
+                serial->timeout_msec >= 0  // blocking mode, see [3] on open
+                and written < chunk->length
+            ){
+                return Error_User("Serial WRITE timed out");
+            }
+        }
+    }
+
+    return SUCCESS;
+}
 
-    if (len <= 0)
-        panic ("The original implementation returned DONE here");
 
-    DWORD result;
-    LPOVERLAPPED overlapped = nullptr;
-    if (not WriteFile(
-        serial->handle, serial->data, len, &result, overlapped
+//
+//  Trap_Send_Serial_File: C
+//
+// Windows has no zero-copy path from a file to a COMM handle, so each part
+// is read into a buffer and written like a BLOB!.  The file is only open for
+// the duration of the call.
+//
+Option(Error*) Trap_Send_Serial_File(
+    Sink(Size) sent,
+    Sink(int64_t) file_size,
+    SerialConnection* serial,
+    const char* file_path,
+    int64_t offset,
+    Size limit
+){
+    *sent = 0;
+    *file_size = 0;
+
+    WCHAR wide_path[MAX_PATH];
+    if (0 == MultiByteToWideChar(
+        CP_UTF8, 0, file_path, -1, wide_path, MAX_PATH
     )){
-        rebPanic_OS (GetLastError());
+        return Error_OS(GetLastError());
+    }
+
+    HANDLE h = CreateFileW(
+        wide_path,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL
+    );
+    if (h == INVALID_HANDLE_VALUE)
+        return Error_OS(GetLastError());
+
+    Option(Error*) e = SUCCESS;
+    Byte* buf = rebAllocN(Byte, limit);
+    Size got = 0;
+
+    LARGE_INTEGER size;
+    LARGE_INTEGER at;
+    at.QuadPart = offset;
+    if (
+        not GetFileSizeEx(h, &size)
+        or not SetFilePointerEx(h, at, NULL, FILE_BEGIN)
+    ){
+        e = Error_OS(GetLastError());
+        goto finished;
+    }
+    *file_size = size.QuadPart;
+
+    while (got < limit) {
+        DWORD result;
+        if (not ReadFile(h, buf + got, limit - got, &result, NULL)) {
+            e = Error_OS(GetLastError());
+            goto finished;
+        }
+        if (result == 0)
+            break;
+        got += result;
+    }
+
+    if (got != 0) {
+        SerialChunk chunk;
+        chunk.data = buf;
+        chunk.length = got;
+        serial->chunks = &chunk;
+        serial->num_chunks = 1;
+
+        e = Trap_Write_Serial(serial);
+
+        serial->chunks = nullptr;
+        serial->num_chunks = 0;
+        if (not e)
+            *sent = got;
+    }
+
+  finished: {
+
+    rebFree(buf);
+    CloseHandle(h);
+    return e;
+}}
+
+
+//
+//  Trap_Wait_Serials: C
+//
+// !!! There's no readiness notification used for COMM handles here (that
+// would need OVERLAPPED I/O with WaitCommEvent()), so this just polls each
+// port's non-blocking read in turn, sleeping a millisecond between rounds.
+//
+// 1. A connection listed twice is only reported once, at its first position.
+//
+Option(Error*) Trap_Wait_Serials(
+    int* num_ready,
+    int ready[],
+    SerialConnection* serials[],
+    int count,
+    int32_t timeout_msec
+){
+    static uintptr_t tick = 0;  // distinguishes calls, for [1]
+    ++tick;
+
+    DWORD start = GetTickCount();
+    *num_ready = 0;
+
+    for (int i = 0; i < count; ++i) {
+        if (serials[i]->wait_tick == tick)
+            continue;
+        serials[i]->wait_tick = tick;
+        serials[i]->wait_index = i;
+    }
+
+    while (true) {
+        for (int i = 0; i < count; ++i) {
+            SerialConnection* serial = serials[i];
+            assert(serial->handle != nullptr);
+
+            if (serial->wait_index != i)
+                continue;  // [1]
+
+            if (
+                Serial_Ring_Used(&serial->in_ring) == 0
+                and Serial_Ring_Free(&serial->in_ring) != 0
+            ){
+                Option(Error*) e = Trap_Read_Serial(serial);
+                if (e)
+                    return e;
+            }
+
+            if (Serial_Ring_Used(&serial->in_ring) != 0)
+                ready[(*num_ready)++] = i;
+        }
+
+        if (*num_ready != 0 or count == 0)
+            return SUCCESS;
+
+        if (
+            timeout_msec >= 0
+            and GetTickCount() - start >= cast(DWORD, timeout_msec)
+        ){
+            return SUCCESS;
+        }
+
+        Sleep(1);
     }
+}
+
+
+//
+//  Trap_Run_Serial_Benchmark: C
+//
+// The benchmark runs over a pseudo-terminal pair, which Windows doesn't have.
+//
+Option(Error*) Trap_Run_Serial_Benchmark(
+    SerialBenchResults* results,
+    const SerialBenchParams* params
+){
+    UNUSED(results);
+    UNUSED(params);
+    return Error_User("SERIAL-BENCHMARK needs pseudo-terminals (not Windows)");
+}
+
+
+//
+//  Trap_Start_Serial_Replay: C
+//
+// Replay is onto a pseudo-terminal, which Windows doesn't have.
+//
+Option(Error*) Trap_Start_Serial_Replay(
+    char* pty_path,
+    Size pty_path_size,
+    const char* capture_path,
+    double speed
+){
+    UNUSED(pty_path);
+    UNUSED(pty_path_size);
+    UNUSED(capture_path);
+    UNUSED(speed);
+    return Error_User("SERIAL-REPLAY needs pseudo-terminals (not Windows)");
+}
 
-  #if DEBUG_SERIAL_EXTENSION
-    printf("write %d ret: %d\n", serial->length, serial->actual);
-  #endif
 
-    serial->actual += result;
-    serial->data += result;
+#define MAX_WINDOWS_SERIAL_DEVICES 256
 
-    if (serial->actual >= serial->length)
-        panic ("The original implementation posted a WAS-WRITTEN event here");
+static SerialDevice g_devices[MAX_WINDOWS_SERIAL_DEVICES];
 
-    panic ("The original implementation queued PENDING here");
+
+//
+//  Trap_Get_Serial_Devices: C
+//
+// The COM ports the drivers have registered under SERIALCOMM.  This is one
+// registry read, so nothing is cached.  USB details would need SetupAPI,
+// which isn't used here, so those fields are left unknown.
+//
+Option(Error*) Trap_Get_Serial_Devices(
+    Sink(const SerialDevice*) devices,
+    Sink(Length) count
+){
+    *devices = g_devices;
+    *count = 0;
+
+    HKEY key;
+    LONG status = RegOpenKeyExA(
+        HKEY_LOCAL_MACHINE, "HARDWARE\\DEVICEMAP\\SERIALCOMM",
+        0, KEY_READ, &key
+    );
+    if (status == ERROR_FILE_NOT_FOUND)  // no serial drivers loaded
+        return SUCCESS;
+    if (status != ERROR_SUCCESS)
+        return Error_OS(status);
+
+    Length n = 0;
+    for (DWORD index = 0; n < MAX_WINDOWS_SERIAL_DEVICES; ++index) {
+        SerialDevice* device = &g_devices[n];
+        memset(device, 0, sizeof(SerialDevice));
+
+        DWORD name_len = sizeof(device->driver);  // e.g. "\Device\VCP0"
+        DWORD path_len = sizeof(device->path) - 1;  // e.g. "COM3"
+        DWORD type;
+        status = RegEnumValueA(
+            key, index, device->driver, &name_len, nullptr,
+            &type, cast(LPBYTE, device->path), &path_len
+        );
+        if (status == ERROR_NO_MORE_ITEMS)
+            break;
+        if (status != ERROR_SUCCESS or type != REG_SZ)
+            continue;  // too long for the fields, not worth failing over
+
+        device->vendor_id = -1;
+        device->product_id = -1;
+        device->interface = -1;
+        ++n;
+    }
+
+    RegCloseKey(key);
+    *count = n;
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Find_Serial_Device: C
+//
+// There are no serial numbers to look up, see Trap_Get_Serial_Devices().
+//
+Option(Error*) Trap_Find_Serial_Device(
+    Sink(const SerialDevice*) device,
+    const char* serial_number,
+    int32_t interface
+){
+    UNUSED(serial_number);
+    UNUSED(interface);
+    *device = nullptr;
+    return SUCCESS;
 }
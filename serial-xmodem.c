@@ -0,0 +1,444 @@
+//
+//  file: %serial-xmodem.c
+//  summary: "Sending files by XMODEM, XMODEM-1K, YMODEM and YMODEM-G"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// See README.md for notes about this extension.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. The receiver starts a transfer by sending NAK (for blocks with a one
+//    byte checksum) or 'C' (for a CRC16, the XMODEM variant).  Each block is
+//    SOH or STX (128 or 1024 bytes of data), the block number and its ones'
+//    complement, the data padded with ^Z, and the checksum or CRC.  The
+//    receiver ACKs it or NAKs it to have it sent again.  EOT ends the file.
+//    1K blocks need the CRC, so a receiver asking for checksums gets 128.
+//
+// B. YMODEM is XMODEM-1K with a block 0 before each file, holding its name
+//    and size, and a block 0 with no name after the last one.  A receiver
+//    that starts with 'G' instead of 'C' asks for YMODEM-G: the blocks are
+//    sent without waiting for ACKs, since it's for links that don't lose
+//    data, and any error cancels the transfer.
+//
+// C. The wait for an ACK is the time the block takes on the line (it may
+//    still be in the driver's buffer when Trap_Write_Serial() returns),
+//    twice over, plus a turnaround for the receiver to write the block out,
+//    e.g. to flash.  So a slow line doesn't cause retries, and a fast one
+//    doesn't wait longer than it has to when a reply is lost.
+//
+// D. A transfer that can't go on (too many retries, the receiver going
+//    quiet, a file that can't be read) is cancelled with CAN bytes, so the
+//    receiver doesn't wait out its own timeouts.  Two CANs from the receiver
+//    cancel it from that end.
+//
+// E. The file is read a block at a time, so it's never all in memory.
+//
+
+#include <stdio.h>
+
+#include "sys-core.h"
+
+#include "req-serial.h"
+
+#define XMODEM_SOH  0x01
+#define XMODEM_STX  0x02
+#define XMODEM_EOT  0x04
+#define XMODEM_ACK  0x06
+#define XMODEM_NAK  0x15
+#define XMODEM_CAN  0x18
+#define XMODEM_PAD  0x1A  // ^Z, CP/M's end of file
+
+#define XMODEM_MAX_RETRIES  10
+#define XMODEM_TURNAROUND_USEC  3000000  // see [C]
+
+
+typedef struct {
+    SerialConnection* serial;
+    bool crc;  // else the one byte checksum, see [A]
+    bool streaming;  // YMODEM-G, see [B]
+    int64_t char_usec;  // line time of one character
+    Byte block[3 + 1024 + 2];
+} XmodemSender;
+
+
+//
+//  Trap_Send_Xmodem_Bytes: C
+//
+// An RS-485 echo is dropped, lest its CANs or block bytes be taken for the
+// receiver's replies.  It's given as long as a reply would be, see [C].
+//
+static Option(Error*) Trap_Send_Xmodem_Bytes(
+    XmodemSender* x,
+    const Byte* data,
+    Size size
+){
+    return Trap_Write_Serial_Request(
+        x->serial,
+        data,
+        size,
+        Serial_Usec() + 2 * x->char_usec * size + XMODEM_TURNAROUND_USEC
+    );
+}
+
+
+//
+//  Trap_Await_Xmodem_Reply: C
+//
+// Waits for one of the `wanted` bytes from the receiver, ignoring others.
+// *reply is 0 if the deadline passes, or CAN if the receiver cancelled.
+//
+static Option(Error*) Trap_Await_Xmodem_Reply(
+    Sink(Byte) reply,
+    SerialConnection* serial,
+    const char* wanted,
+    int64_t deadline_usec
+){
+    SerialRing* in = &serial->in_ring;
+    bool cancelling = false;
+
+    while (true) {
+        Byte b;
+        while (Serial_Ring_Consume(in, &b, 1) == 1) {
+            if (b == XMODEM_CAN) {
+                if (cancelling) {
+                    *reply = XMODEM_CAN;
+                    return SUCCESS;
+                }
+                cancelling = true;  // a lone CAN may be line noise
+                continue;
+            }
+            cancelling = false;
+            if (b != 0 and strchr(wanted, b)) {
+                *reply = b;
+                return SUCCESS;
+            }
+        }
+
+        int64_t left = deadline_usec - Serial_Usec();
+        if (left <= 0) {
+            *reply = 0;
+            return SUCCESS;
+        }
+
+        Option(Error*) e = Trap_Read_Serial_Within(
+            serial, left > INT32_MAX ? INT32_MAX : cast(int32_t, left)
+        );
+        if (e)
+            return e;
+    }
+}
+
+
+//
+//  Trap_Send_Xmodem_Block: C
+//
+// Sends a block (`size` is 128 or 1024, `data` already padded) until it's
+// ACKed, or just once when streaming.  See [A] and [C] at top of file.
+//
+static Option(Error*) Trap_Send_Xmodem_Block(
+    XmodemSender* x,
+    Byte number,
+    const Byte* data,
+    Size size
+){
+    Byte* block = x->block;
+    block[0] = (size == 1024) ? XMODEM_STX : XMODEM_SOH;
+    block[1] = number;
+    block[2] = 255 - number;
+    memcpy(block + 3, data, size);
+
+    Size block_size;
+    if (x->crc) {
+        uint16_t crc = Continue_Serial_Checksum(
+            SERIAL_CHECKSUM_CRC16_XMODEM,
+            Empty_Serial_Checksum(SERIAL_CHECKSUM_CRC16_XMODEM),
+            data,
+            size
+        );
+        block[3 + size] = crc >> 8;  // big-endian, unlike Modbus
+        block[4 + size] = crc & 0xFF;
+        block_size = size + 5;
+    }
+    else {
+        Byte sum = 0;
+        for (Size i = 0; i < size; ++i)
+            sum += data[i];
+        block[3 + size] = sum;
+        block_size = size + 4;
+    }
+
+    int64_t wait_usec = 2 * x->char_usec * block_size + XMODEM_TURNAROUND_USEC;
+
+    for (int tries = 0; tries < XMODEM_MAX_RETRIES; ++tries) {
+        Option(Error*) e = Trap_Send_Xmodem_Bytes(x, block, block_size);
+        if (e)
+            return e;
+
+        if (x->streaming)
+            return SUCCESS;
+
+        Byte reply;
+        e = Trap_Await_Xmodem_Reply(
+            &reply, x->serial, "\x06\x15" "C", Serial_Usec() + wait_usec
+        );
+        if (e)
+            return e;
+
+        if (reply == XMODEM_ACK)
+            return SUCCESS;
+        if (reply == XMODEM_CAN)
+            return Error_User("XMODEM transfer cancelled by receiver");
+        // NAK, 'C' (a receiver still asking to start), or no reply: resend
+    }
+
+    return Error_User("XMODEM block not acknowledged after 10 tries");
+}
+
+
+//
+//  Trap_Send_Xmodem_Eot: C
+//
+// YMODEM receivers NAK the first EOT, to be sure of it, so it's repeated
+// until ACKed.
+//
+static Option(Error*) Trap_Send_Xmodem_Eot(XmodemSender* x)
+{
+    const Byte eot = XMODEM_EOT;
+
+    for (int tries = 0; tries < XMODEM_MAX_RETRIES; ++tries) {
+        Option(Error*) e = Trap_Send_Xmodem_Bytes(x, &eot, 1);
+        if (e)
+            return e;
+
+        Byte reply;
+        e = Trap_Await_Xmodem_Reply(
+            &reply, x->serial, "\x06\x15",
+            Serial_Usec() + 2 * x->char_usec + XMODEM_TURNAROUND_USEC
+        );
+        if (e)
+            return e;
+
+        if (reply == XMODEM_ACK)
+            return SUCCESS;
+        if (reply == XMODEM_CAN)
+            return Error_User("XMODEM transfer cancelled by receiver");
+    }
+
+    return Error_User("XMODEM end of file not acknowledged after 10 tries");
+}
+
+
+//
+//  Trap_Await_Xmodem_Start: C
+//
+// Waits for the receiver to ask for the next file (or block 0), and sets up
+// the sender the way it asked.  See [A] and [B] at top of file.
+//
+static Option(Error*) Trap_Await_Xmodem_Start(
+    XmodemSender* x,
+    SerialXmodemProtocol protocol,
+    int64_t deadline_usec
+){
+    const char* wanted;
+    if (protocol == SERIAL_YMODEM)
+        wanted = x->streaming ? "G" : "CG";  // G mode lasts the whole batch
+    else
+        wanted = "\x15" "C";
+
+    Byte reply;
+    Option(Error*) e = Trap_Await_Xmodem_Reply(
+        &reply, x->serial, wanted, deadline_usec
+    );
+    if (e)
+        return e;
+
+    if (reply == 0)
+        return Error_User("XMODEM receiver didn't ask for the transfer");
+    if (reply == XMODEM_CAN)
+        return Error_User("XMODEM transfer cancelled by receiver");
+
+    x->crc = (reply != XMODEM_NAK);
+    x->streaming = (reply == 'G');
+    return SUCCESS;
+}
+
+
+//
+//  Trap_Send_Xmodem_File: C
+//
+// The data blocks of one file, then EOT.  Adds the file's size to *total.
+//
+static Option(Error*) Trap_Send_Xmodem_File(
+    int64_t* total,
+    XmodemSender* x,
+    FILE* f,
+    Size block_size
+){
+    Byte data[1024];
+    Byte number = 1;
+
+    while (true) {
+        Size got = fread(data, 1, block_size, f);
+        if (got == 0) {
+            if (ferror(f))
+                return Error_User("XMODEM couldn't read the file");
+            break;
+        }
+
+        Size size = block_size;
+        if (size == 1024 and got <= 128)  // less padding, see [A]
+            size = 128;
+        memset(data + got, XMODEM_PAD, size - got);
+
+        Option(Error*) e = Trap_Send_Xmodem_Block(x, number, data, size);
+        if (e)
+            return e;
+
+        *total += got;
+        ++number;  // wraps around to 0 after 255
+
+        if (got < block_size)
+            break;
+    }
+
+    return Trap_Send_Xmodem_Eot(x);
+}
+
+
+//
+//  Trap_Send_Ymodem_Header: C
+//
+// Block 0 of YMODEM: the file's name and decimal size, or no name to end the
+// batch.  The receiver answers a header with ACK, then asks for the data
+// with 'C'.  The header ending the batch is only ACKed.  In YMODEM-G there's
+// no ACK, just the 'G' for a file.
+//
+static Option(Error*) Trap_Send_Ymodem_Header(
+    XmodemSender* x,
+    Option(const char*) name,
+    int64_t file_size,
+    int64_t deadline_usec
+){
+    Byte data[1024];
+    memset(data, 0, sizeof(data));
+
+    Size size = 128;
+    if (name) {
+        Size name_len = strlen(unwrap name);
+        if (name_len > 1000)
+            return Error_User("YMODEM file name too long");
+        memcpy(data, unwrap name, name_len);
+        int n = snprintf(
+            cast(char*, data) + name_len + 1, sizeof(data) - name_len - 1,
+            "%lld", cast(long long, file_size)
+        );
+        if (name_len + 1 + n + 1 > 128)
+            size = 1024;
+    }
+
+    Option(Error*) e = Trap_Send_Xmodem_Block(x, 0, data, size);
+    if (e or not name)
+        return e;
+
+    return Trap_Await_Xmodem_Start(x, SERIAL_YMODEM, deadline_usec);
+}
+
+
+//
+//  Trap_Send_Xmodem: C
+//
+// Sends the files (only one for XMODEM) and sets *total to their size.
+//
+Option(Error*) Trap_Send_Xmodem(
+    Sink(int64_t) total,
+    SerialConnection* serial,
+    const SerialXmodemFile* files,
+    Length count,
+    const SerialXmodemParams* params
+){
+    assert(count >= 1);
+    assert(params->protocol == SERIAL_YMODEM or count == 1);
+
+    *total = 0;
+
+    XmodemSender x;
+    x.serial = serial;
+    x.crc = true;
+    x.streaming = false;
+
+    x.char_usec = Serial_Char_Usec(serial);
+
+    SerialRing* in = &serial->in_ring;
+    Serial_Ring_Discard(in, Serial_Ring_Used(in));  // not from this transfer
+
+    int64_t start_usec = cast(int64_t, params->start_msec) * 1000;
+
+    Option(Error*) e = Trap_Await_Xmodem_Start(
+        &x, params->protocol, Serial_Usec() + start_usec
+    );
+
+    for (Length n = 0; n < count and not e; ++n) {
+        FILE* f = fopen(files[n].path, "rb");
+        if (not f) {
+            e = Error_User("XMODEM couldn't open the file");
+            break;
+        }
+
+        Size block_size = 128;
+        if (params->protocol != SERIAL_XMODEM and x.crc)
+            block_size = 1024;
+
+        if (params->protocol == SERIAL_YMODEM) {
+            int64_t file_size = -1;
+            if (fseek(f, 0, SEEK_END) == 0)
+                file_size = ftell(f);
+            if (file_size < 0 or fseek(f, 0, SEEK_SET) != 0)
+                e = Error_User("XMODEM couldn't read the file");
+            else
+                e = Trap_Send_Ymodem_Header(
+                    &x, files[n].name, file_size, Serial_Usec() + start_usec
+                );
+        }
+
+        if (not e)
+            e = Trap_Send_Xmodem_File(total, &x, f, block_size);
+
+        fclose(f);
+
+        if (not e and params->protocol == SERIAL_YMODEM) {
+            e = Trap_Await_Xmodem_Start(
+                &x, SERIAL_YMODEM, Serial_Usec() + start_usec
+            );
+        }
+    }
+
+    if (not e and params->protocol == SERIAL_YMODEM)
+        e = Trap_Send_Ymodem_Header(&x, nullptr, 0, 0);
+
+    if (e) {  // see [D]
+        Byte cancel[8];
+        memset(cancel, XMODEM_CAN, sizeof(cancel));
+        Option(Error*) e_cancel = Trap_Send_Xmodem_Bytes(
+            &x, cancel, sizeof(cancel)
+        );
+        UNUSED(e_cancel);  // the first error is the one to report
+    }
+
+    return e;
+}
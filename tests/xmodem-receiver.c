@@ -0,0 +1,478 @@
+//
+//  file: %xmodem-receiver.c
+//  summary: "XMODEM/YMODEM receiver written to the specs, for testing"
+//  project: "Rebol 3 Interpreter and Run-time (Ren-C branch)"
+//  homepage: https://github.com/metaeducation/ren-c/
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Copyright 2013-2017 Ren-C Open Source Contributors
+// REBOL is a trademark of REBOL Technologies
+//
+// See README.md and CREDITS.md for more information.
+//
+// Licensed under the Lesser GPL, Version 3.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// https://www.gnu.org/licenses/lgpl-3.0.html
+//
+//=////////////////////////////////////////////////////////////////////////=//
+//
+// Used by %xmodem-test.r to check SERIAL-SEND-XMODEM without lrzsz or a
+// device.  It's a plain POSIX program, independent of the extension:
+//
+//     cc -o xmodem-receiver tests/xmodem-receiver.c
+//     xmodem-receiver /tmp/xmodem-tty ymodem /tmp/xmodem-out
+//
+// It makes a pseudo-terminal, links the given path to its far end for the
+// sender to OPEN, and returns, leaving a child process to receive.  That
+// writes what it gets into the directory, and then a `status` file there
+// saying `ok`, or what went wrong.
+//
+//=//// NOTES /////////////////////////////////////////////////////////////=//
+//
+// A. The modes are `checksum` (XMODEM asked for with NAK), `crc` (XMODEM
+//    asked for with 'C', taking 128 or 1024 byte blocks), `ymodem` and
+//    `ymodem-g`.  XMODEM's data goes in `xmodem.bin`, padding included.
+//    YMODEM's files get the names from their headers, cut to their sizes.
+//
+// B. The receiver asks for the transfer again every second, as the specs
+//    say to, until the first block comes.
+//
+// C. Besides checking every block, it exercises the sender's retries: the
+//    second data block is NAKed once.  In YMODEM the first EOT of each file
+//    is NAKed (as receivers do), and so is the first header ending the
+//    batch, which the sender has to send again.  YMODEM-G has no NAKs.
+//
+// D. The pseudo-terminal is kept open until the sender closes it (or for
+//    ten seconds).  Closing it as soon as the last ACK is written would hang
+//    up the sender's end while it may not have read that ACK yet.
+//
+
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <iso646.h>  // `and`, `or`, `not`, as in the extension
+#include <poll.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define SOH  0x01
+#define STX  0x02
+#define EOT  0x04
+#define ACK  0x06
+#define NAK  0x15
+#define CAN  0x18
+
+typedef unsigned char Byte;
+
+static int g_tty = -1;  // master side of the pseudo-terminal
+static const char* g_dir;
+static char g_failure[256];
+
+
+//
+//  Fail: C
+//
+static bool Fail(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(g_failure, sizeof(g_failure), format, args);
+    va_end(args);
+    return false;
+}
+
+
+//
+//  Get_Byte: C
+//
+// The next byte from the sender, or -1 if none comes within `msec`.
+//
+static int Get_Byte(int msec)
+{
+    struct pollfd pfd;
+    pfd.fd = g_tty;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, msec) <= 0)
+        return -1;
+
+    Byte b;
+    if (read(g_tty, &b, 1) != 1)
+        return -1;
+    return b;
+}
+
+
+//
+//  Put_Byte: C
+//
+static void Put_Byte(Byte b)
+{
+    ssize_t result = write(g_tty, &b, 1);
+    (void)result;  // a sender that's gone shows up as a timeout
+}
+
+
+//
+//  Crc16_Xmodem: C
+//
+static uint16_t Crc16_Xmodem(const Byte* data, int size)
+{
+    uint16_t crc = 0;
+    for (int i = 0; i < size; ++i) {
+        crc ^= data[i] << 8;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+
+//
+//  Get_Block: C
+//
+// Reads a block whose first byte was `header`, checking it.  Gives back the
+// data size, or 0 with g_failure set.
+//
+static int Get_Block(Byte* data, int* number, int header, bool crc)
+{
+    if (header != SOH and header != STX) {
+        Fail("expected SOH or STX, got %d", header);
+        return 0;
+    }
+    int size = (header == SOH) ? 128 : 1024;
+    if (size == 1024 and not crc) {
+        Fail("1K block without CRC");
+        return 0;
+    }
+
+    Byte buf[2 + 1024 + 2];
+    int need = 2 + size + (crc ? 2 : 1);
+    for (int i = 0; i < need; ++i) {
+        int b = Get_Byte(1000);
+        if (b == -1) {
+            Fail("block cut short");
+            return 0;
+        }
+        buf[i] = b;
+    }
+
+    if ((buf[0] ^ buf[1]) != 0xFF) {
+        Fail("block number complement wrong");
+        return 0;
+    }
+
+    if (crc) {
+        uint16_t sent = (buf[2 + size] << 8) | buf[3 + size];
+        if (Crc16_Xmodem(buf + 2, size) != sent) {
+            Fail("CRC wrong");
+            return 0;
+        }
+    }
+    else {
+        Byte sum = 0;
+        for (int i = 0; i < size; ++i)
+            sum += buf[2 + i];
+        if (sum != buf[2 + size]) {
+            Fail("checksum wrong");
+            return 0;
+        }
+    }
+
+    *number = buf[0];
+    memcpy(data, buf + 2, size);
+    return size;
+}
+
+
+//
+//  Await_First_Header: C
+//
+// See [B] at top of file.
+//
+static int Await_First_Header(Byte start)
+{
+    for (int tries = 0; tries < 60; ++tries) {
+        Put_Byte(start);
+        int b = Get_Byte(1000);
+        if (b != -1)
+            return b;
+    }
+    return -1;
+}
+
+
+//
+//  Receive_File_Data: C
+//
+// Data blocks up to and including EOT, appended to `out`.  `header` is the
+// first block's first byte, if it was already read by Await_First_Header(),
+// else -1.  See [C] at top of file.
+//
+static bool Receive_File_Data(
+    FILE* out,
+    int header,
+    bool crc,
+    bool ymodem,
+    bool g
+){
+    Byte data[1024];
+    int expect = 1;
+    bool naked_block = g;
+    bool naked_eot = g or not ymodem;
+
+    while (true) {
+        if (header == -1)
+            header = Get_Byte(10000);
+        if (header == -1)
+            return Fail("timed out waiting for block %d", expect);
+
+        if (header == EOT) {
+            header = -1;
+            if (not naked_eot) {
+                naked_eot = true;
+                Put_Byte(NAK);
+                continue;
+            }
+            Put_Byte(ACK);
+            return true;
+        }
+
+        int number;
+        int size = Get_Block(data, &number, header, crc);
+        header = -1;
+        if (size == 0)
+            return false;
+
+        if (number == (Byte)(expect - 1) and not g) {
+            Put_Byte(ACK);  // our ACK was lost, so it's a repeat
+            continue;
+        }
+        if (number != (Byte)expect)
+            return Fail("block %d when %d was next", number, expect);
+
+        if (expect == 2 and not naked_block) {
+            naked_block = true;
+            Put_Byte(NAK);
+            continue;
+        }
+
+        if (fwrite(data, 1, size, out) != (size_t)size)
+            return Fail("couldn't write the output");
+        ++expect;
+        if (not g)
+            Put_Byte(ACK);
+    }
+}
+
+
+//
+//  Receive_Xmodem: C
+//
+static bool Receive_Xmodem(bool crc)
+{
+    int header = Await_First_Header(crc ? 'C' : NAK);
+    if (header == -1)
+        return Fail("sender never started");
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/xmodem.bin", g_dir);
+    FILE* out = fopen(path, "wb");
+    if (not out)
+        return Fail("couldn't create %s", path);
+
+    bool ok = Receive_File_Data(out, header, crc, false, false);
+    if (fclose(out) != 0 and ok)
+        ok = Fail("couldn't write %s", path);
+    return ok;
+}
+
+
+//
+//  Receive_Ymodem: C
+//
+// A header (block 0) before each file, and one with no name to end the
+// batch, see [C] at top of file.
+//
+static bool Receive_Ymodem(bool g)
+{
+    Byte start = g ? 'G' : 'C';
+    Byte data[1024];
+
+    while (true) {
+        int header = Await_First_Header(start);
+        if (header == -1)
+            return Fail("sender never sent a header");
+
+        int number;
+        int size = Get_Block(data, &number, header, true);
+        if (size == 0)
+            return false;
+        if (number != 0)
+            return Fail("header numbered %d", number);
+
+        if (data[0] == '\0') {  // end of the batch
+            if (g)
+                return true;
+            Put_Byte(NAK);
+            header = Get_Byte(10000);
+            if (header == -1)
+                return Fail("header ending the batch not sent again");
+            size = Get_Block(data, &number, header, true);
+            if (size == 0)
+                return false;
+            if (number != 0 or data[0] != '\0')
+                return Fail("wrong block after NAK of the batch's end");
+            Put_Byte(ACK);
+            return true;
+        }
+
+        const char* name = (const char*)data;
+        size_t name_len = strnlen(name, size);
+        if (name_len == (size_t)size or strchr(name, '/'))
+            return Fail("bad file name in header");
+        long long file_size = strtoll(name + name_len + 1, NULL, 10);
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", g_dir, name);
+        FILE* out = fopen(path, "wb");
+        if (not out)
+            return Fail("couldn't create %s", path);
+
+        if (not g)
+            Put_Byte(ACK);
+        Put_Byte(start);
+
+        bool ok = Receive_File_Data(out, -1, true, true, g);
+        if (ok and fflush(out) != 0)
+            ok = Fail("couldn't write %s", path);
+        if (ok and ftruncate(fileno(out), (off_t)file_size) != 0)
+            ok = Fail("couldn't cut %s to its size", path);
+        fclose(out);
+        if (not ok)
+            return false;
+    }
+}
+
+
+//
+//  Open_Pty: C
+//
+// The master side of a new pseudo-terminal in raw mode.  The far end is kept
+// open in *slave, so the master doesn't see a hangup before the sender opens
+// it, and the path to it is linked from `link`.
+//
+static int Open_Pty(int* slave, const char* link)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 or grantpt(master) != 0 or unlockpt(master) != 0)
+        return -1;
+
+    const char* name = ptsname(master);
+    if (not name)
+        return -1;
+
+    *slave = open(name, O_RDWR | O_NOCTTY);
+    if (*slave == -1)
+        return -1;
+
+    struct termios tio;
+    if (tcgetattr(*slave, &tio) != 0)
+        return -1;
+    cfmakeraw(&tio);
+    if (tcsetattr(*slave, TCSANOW, &tio) != 0)
+        return -1;
+
+    unlink(link);
+    if (symlink(name, link) != 0)
+        return -1;
+
+    return master;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s link mode out-dir\n", argv[0]);
+        return 2;
+    }
+    const char* link = argv[1];
+    const char* mode = argv[2];
+    g_dir = argv[3];
+
+    if (
+        strcmp(mode, "checksum") != 0 and strcmp(mode, "crc") != 0
+        and strcmp(mode, "ymodem") != 0 and strcmp(mode, "ymodem-g") != 0
+    ){
+        fprintf(stderr, "unknown mode: %s\n", mode);
+        return 2;
+    }
+
+    char status_path[4096];
+    snprintf(status_path, sizeof(status_path), "%s/status", g_dir);
+    unlink(status_path);
+
+    int slave;
+    g_tty = Open_Pty(&slave, link);
+    if (g_tty == -1) {
+        fprintf(stderr, "couldn't make the pty: %s\n", strerror(errno));
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        fprintf(stderr, "couldn't fork: %s\n", strerror(errno));
+        return 1;
+    }
+    if (pid != 0)
+        return 0;  // the link is there, the child carries on
+
+    setsid();
+    int null = open("/dev/null", O_RDWR);  // don't hold the caller's pipes
+    if (null != -1) {
+        dup2(null, 0);
+        dup2(null, 1);
+        dup2(null, 2);
+    }
+
+    bool ok;
+    if (strcmp(mode, "checksum") == 0)
+        ok = Receive_Xmodem(false);
+    else if (strcmp(mode, "crc") == 0)
+        ok = Receive_Xmodem(true);
+    else
+        ok = Receive_Ymodem(strcmp(mode, "ymodem-g") == 0);
+
+    if (not ok) {  // don't leave the sender waiting out its timeouts
+        for (int i = 0; i < 8; ++i)
+            Put_Byte(CAN);
+    }
+    tcdrain(g_tty);
+    unlink(link);
+
+    FILE* status = fopen(status_path, "w");
+    if (status) {
+        fprintf(status, "%s\n", ok ? "ok" : g_failure);
+        fclose(status);
+    }
+
+    close(slave);  // hangs up when the sender closes, see [D]
+    struct pollfd pfd;
+    pfd.fd = g_tty;
+    pfd.events = 0;
+    pfd.revents = 0;
+    poll(&pfd, 1, 10000);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+Rebol [
+    title: "Serial Extension XMODEM Test"
+    file: %xmodem-test.r
+    type: script
+    license: "Apache 2.0"
+    description: --[
+        Sends files with SERIAL-SEND-XMODEM to %xmodem-receiver.c, which is
+        written from the XMODEM and YMODEM specs and not from the sender, over
+        a pseudo-terminal (so no hardware is needed).  Each way of receiving
+        is tried with each I/O engine, and what arrives is compared with what
+        was sent.  POSIX only, and needs a C compiler as `cc`.
+
+        Panics on the first transfer that goes wrong.
+    ]--
+]
+
+dir: join what-dir %xmodem-test/
+receiver: join dir %xmodem-receiver
+link: join dir %tty
+
+make-dir dir
+if 0 != call:shell unspaced [
+    "cc -o " file-to-local receiver
+    " " file-to-local join system.script.path %xmodem-receiver.c
+][
+    panic "couldn't compile %xmodem-receiver.c"
+]
+
+files: collect [  ; many blocks, just over 128 bytes, just under 1024
+    for-each 'size [20000 129 1000] [
+        let data: copy #{}
+        repeat size [append data (random 256) - 1]
+        let file: join dir unspaced ["f" size ".bin"]
+        write file data
+        keep file
+    ]
+]
+
+cases: [  ; receiver's mode, then :PROTOCOL
+    checksum xmodem
+    crc xmodem
+    crc xmodem-1k
+    ymodem ymodem
+    ymodem-g ymodem
+]
+
+engines: [
+    loop []
+    thread [io-engine: 'thread]
+    blocking [timeout: 2]
+]
+
+for-each [mode protocol] cases [
+    for-each [engine spec] engines [
+        let out: join dir %out/
+        attempt [delete-dir out]
+        make-dir out
+
+        call:shell unspaced [
+            file-to-local receiver " " file-to-local link " " mode
+            " " file-to-local out
+        ]
+
+        let port: open compose [
+            scheme: 'serial path: (link) speed: 115200 (spread spec)
+        ]
+        let sent: serial-send-xmodem:protocol port (
+            either protocol = 'ymodem [files] [first files]
+        ) protocol
+        close port
+
+        let status: null
+        repeat 150 [  ; the receiver times out on its own after 10 seconds
+            if exists? join out %status [
+                status: trim read:string join out %status
+                break
+            ]
+            wait 0.1
+        ]
+        if status != "ok" [
+            panic ["receiver" mode "with" engine "says:" any [status "nothing"]]
+        ]
+
+        if protocol = 'ymodem [
+            for-each 'file files [
+                let name: second split-path file
+                if (read file) != read join out name [
+                    panic ["YMODEM" mode "with" engine "garbled" name]
+                ]
+            ]
+            let total: 0
+            for-each 'file files [total: total + size? file]
+            assert [sent = total]
+        ] else [
+            let data: read first files
+            let got: read join out %xmodem.bin
+            if data != copy:part got length of data [
+                panic ["XMODEM" mode protocol "with" engine "garbled the data"]
+            ]
+            for-each 'byte skip got length of data [  ; padded with ^Z
+                if byte != 26 [panic ["XMODEM" mode "padded with" byte]]
+            ]
+            assert [sent = length of data]
+        ]
+
+        print [mode protocol engine "|" sent "bytes ok"]
+    ]
+]